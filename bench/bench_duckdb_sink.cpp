@@ -0,0 +1,53 @@
+// DuckDBEventSink::Write throughput into an in-memory database: batches of
+// enriched feature_used events (the full envelope plus a few event
+// properties), at the batch sizes a worker drain hands the sink. The table is
+// recreated between cases so every case appends into the same starting state.
+// Prints ns per event and the resulting events/s; the target for on-prem
+// analytics is hundreds of thousands of events per second.
+#include "bench_util.hpp"
+#include "telemetry.hpp"
+#include "telemetry_duckdb.hpp"
+
+#include "duckdb.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace duckdb;
+
+int main() {
+    auto& t = PostHogTelemetry::Instance();
+    DuckDB db(nullptr);
+    Connection con(db);
+
+    int rc = 0;
+    for (size_t batch_size : {100u, 1000u, 10000u}) {
+        std::vector<PostHogEvent> batch;
+        batch.reserve(batch_size);
+        for (size_t i = 0; i < batch_size; i++) {
+            batch.push_back(t.BuildEventForTesting(
+                "feature_used", {{"feature", "odata_read"},
+                                 {"duration_ms", 12.5},
+                                 {"rows", static_cast<int64_t>(i)}}));
+        }
+
+        con.Query("DROP TABLE IF EXISTS bench_events");
+        DuckDBEventSink sink(db, "bench_events");
+        bool ok = true;
+        std::string name = "DuckDBEventSink::Write(" + std::to_string(batch_size) + " events)";
+        bench::Result r = bench::Run(name, [&] {
+            ok = sink.Write(batch) && ok;
+        }, 1.0, 1);
+        if (!ok) {
+            std::fprintf(stderr, "FAIL: %s reported an error\n", name.c_str());
+            rc = 1;
+        }
+        r.ns_per_op /= static_cast<double>(batch_size);
+        r.iterations *= batch_size;
+        r.name += " per event";
+        bench::Print(r);
+        std::printf("  %.0f events/s\n", 1e9 / r.ns_per_op);
+    }
+    return rc;
+}
@@ -0,0 +1,46 @@
+// Drain-side encoding of a 10,000-event backlog (what a worker faces after an
+// outage) into /batch/ request bodies, serial and on 2/4/8 threads. Events
+// carry the shapes that dominate encode cost: an $exception_list JSON array
+// and a $groups object. Scaling should track the cores actually available.
+#include "bench_util.hpp"
+#include "telemetry.hpp"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace duckdb;
+
+int main() {
+    std::vector<PostHogEvent> backlog;
+    backlog.reserve(10000);
+    for (int i = 0; i < 10000; i++) {
+        PropertyMap props;
+        props["error_class"] = "connection_refused";
+        props["$exception_list"] = PropertyValue::Json(
+            "[{\"type\":\"connection_refused\",\"value\":\"connection_refused\"}]");
+        props["$exception_fingerprint"] = "acme/connection_refused";
+        props["$groups"] = PropertyValue::Json("{\"deployment\":\"5f0c2a\",\"account\":\"acme-prod\"}");
+        props["product"] = "acme";
+        props["product_version"] = "1.4.2";
+        props["duckdb_version"] = "v1.4.1";
+        props["os"] = "linux";
+        props["arch"] = "amd64";
+        props["is_ci"] = false;
+        props["seq"] = i;
+        backlog.push_back(PostHogEvent{"$exception", "d3b07384d113edec49eaa6238ad5ff00",
+                                       std::move(props), "2026-01-01T00:00:00Z"});
+    }
+
+    std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    for (size_t threads : {1u, 2u, 4u, 8u}) {
+        TelemetryParallelFor pf = TelemetryThreadParallelFor(threads);
+        std::string name = "PostHogEncodeBatch(10000 events, " + std::to_string(threads) + " threads)";
+        bench::Print(bench::Run(name, [&] {
+            auto payloads = PostHogEncodeBatch("phc_bench", backlog, pf);
+            bench::DoNotOptimize(payloads);
+        }, 1.0, 1));
+    }
+    return 0;
+}
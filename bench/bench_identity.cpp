@@ -0,0 +1,57 @@
+// Cost of deriving the distinct_id against a synthetic /sys/class/net with
+// 5,000 virtual interfaces (a busy Kubernetes node) and one physical device
+// that sorts last, so the MAC lookup has to walk all of them. With a machine
+// id the lookup must not run at all; without one, the identity cache (keyed by
+// hostname) makes it a one-time cost.
+#include "bench_util.hpp"
+#include "telemetry.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace duckdb;
+namespace fs = std::filesystem;
+
+static const int kInterfaces = 5000;
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / "bench_identity";
+    fs::remove_all(dir);
+    fs::path net = dir / "sys" / "class" / "net";
+    char name[32];
+    for (int i = 0; i < kInterfaces; i++) {
+        std::snprintf(name, sizeof(name), "veth%05d", i);
+        fs::create_directories(net / name);
+    }
+    fs::create_directories(net / "zz_phys0" / "device");
+    std::ofstream(net / "zz_phys0" / "device" / "driver") << "e1000\n";
+    std::ofstream(net / "zz_phys0" / "address") << "aa:bb:cc:00:11:22\n";
+    PostHogTelemetry::SetSysfsRootForTesting((dir / "sys").string());
+    PostHogTelemetry::SetHostnameForTesting("bench-host");   // keys the cache without a machine id
+    std::string cache = (dir / "cache" / "identity").string();
+
+    bench::Print(bench::Run("GetMacAddressSafe (5000 interfaces)", [] {
+        bench::DoNotOptimize(PostHogTelemetry::GetMacAddressSafe());
+    }, 0.5, 10));
+    bench::Print(bench::Run("identity, machine id present", [] {
+        bench::DoNotOptimize(PostHogTelemetry::ComputeIdentityForTesting("abcd1234efab5678", ""));
+    }));
+    bench::Print(bench::Run("identity, no machine id, uncached", [] {
+        bench::DoNotOptimize(PostHogTelemetry::ComputeIdentityForTesting("", ""));
+    }, 0.5, 10));
+    bench::Print(bench::Run("identity, no machine id, cached", [&] {
+        bench::DoNotOptimize(PostHogTelemetry::ComputeIdentityForTesting("", cache));
+    }, 0.5, 100));
+
+    uint64_t scans = PostHogTelemetry::MacScansForTesting();
+    PostHogTelemetry::ComputeIdentityForTesting("abcd1234efab5678", "");
+    int rc = 0;
+    if (PostHogTelemetry::MacScansForTesting() != scans) {
+        std::fprintf(stderr, "FAIL: identity with a machine id ran the MAC lookup\n");
+        rc = 1;
+    }
+    fs::remove_all(dir);
+    return rc;
+}
@@ -0,0 +1,61 @@
+// Cost of the capture API in a process started with DATAZOO_DISABLE_TELEMETRY
+// set, against the same calls with telemetry live (sent to a no-op transport).
+// The opted-out numbers should be a few ns — one relaxed atomic load — and the
+// process must end without a worker thread or any buffered event.
+#include "bench_util.hpp"
+#include "telemetry.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace duckdb;
+
+static void SetOptOut(bool on) {
+#ifdef _WIN32
+    _putenv_s("DATAZOO_DISABLE_TELEMETRY", on ? "1" : "");
+#else
+    if (on) {
+        setenv("DATAZOO_DISABLE_TELEMETRY", "1", 1);
+    } else {
+        unsetenv("DATAZOO_DISABLE_TELEMETRY");
+    }
+#endif
+}
+
+static void RunCases(PostHogTelemetry& t, const char* mode) {
+    std::string prefix = std::string(mode) + "/";
+    bench::Print(bench::Run(prefix + "Capture(empty props)", [&] {
+        t.Capture("bench_event");
+    }));
+    bench::Print(bench::Run(prefix + "CaptureFeature(2 props)", [&] {
+        t.CaptureFeature("bench_feature", {{"mode", "scan"}, {"rows", 42}});
+    }));
+    bench::Print(bench::Run(prefix + "RecordFunctionCall", [&] {
+        t.RecordFunctionCall("bench_fn", 0.25);
+    }));
+}
+
+int main() {
+    // Opted out before the instance exists: the state a user with the variable
+    // in their shell profile runs in.
+    SetOptOut(true);
+    auto& t = PostHogTelemetry::Instance();
+    RunCases(t, "opted_out");
+
+    TelemetryStats stats = t.GetStats();
+    if (stats.worker_running || stats.queue_depth != 0 || !stats.functions.empty()) {
+        std::fprintf(stderr, "FAIL: opted-out process did telemetry work "
+                             "(worker_running=%d queue_depth=%llu functions=%zu)\n",
+                     stats.worker_running ? 1 : 0,
+                     static_cast<unsigned long long>(stats.queue_depth), stats.functions.size());
+        return 1;
+    }
+
+    // Baseline: the live pipeline, delivering into a no-op sink.
+    t.SetTransport([](const std::string&, const std::string&, const std::vector<PostHogEvent>&) {});
+    SetOptOut(false);
+    t.RecheckEnvironmentOptOut();
+    RunCases(t, "enabled");
+    PostHogTelemetry::Cleanup();
+    return 0;
+}
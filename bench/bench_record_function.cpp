@@ -0,0 +1,61 @@
+// Cost of RecordFunctionCall on the aggregation path: a hot single function,
+// a rotating set of distinct names, and names passed as string_view slices of
+// one buffer (no std::string built by the caller or the lookup). Then one
+// 2048-row DataChunk recorded per row versus once with RecordFunctionCalls.
+#include "bench_util.hpp"
+#include "telemetry.hpp"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace duckdb;
+
+int main() {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetTransport([](const std::string&, const std::string&, const std::vector<PostHogEvent>&) {});
+    t.SetEnabled(true);
+    t.SetPromptFunctionCallsForTesting(0);
+    t.SetAutoFlushEnabledForTesting(false);
+
+    bench::Print(bench::Run("RecordFunctionCall(literal, 1 function)", [&] {
+        t.RecordFunctionCall("bench_fn", 0.25);
+    }));
+
+    std::vector<std::string> names;
+    for (int i = 0; i < 512; i++) {
+        names.push_back("bench_fn_" + std::to_string(i));
+    }
+    size_t next = 0;
+    bench::Print(bench::Run("RecordFunctionCall(string, 512 functions)", [&] {
+        t.RecordFunctionCall(names[next++ & 511], 0.25);
+    }));
+
+    std::string buffer;
+    std::vector<std::string_view> views;
+    for (auto& n : names) {
+        buffer += n;
+    }
+    for (size_t i = 0, pos = 0; i < names.size(); pos += names[i].size(), i++) {
+        views.emplace_back(buffer.data() + pos, names[i].size());
+    }
+    bench::Print(bench::Run("RecordFunctionCall(string_view, 512 functions)", [&] {
+        t.RecordFunctionCall(views[next++ & 511], 0.25);
+    }));
+
+    constexpr uint64_t kChunkRows = 2048;   // DuckDB's STANDARD_VECTOR_SIZE
+    bench::Print(bench::Run("RecordFunctionCall x 2048 rows (one chunk)", [&] {
+        for (uint64_t row = 0; row < kChunkRows; row++) {
+            t.RecordFunctionCall("bench_fn", 0.25);
+        }
+    }, 0.5, 100));
+    PostHogTelemetry::FunctionId id = t.GetFunctionId("bench_fn");
+    bench::Print(bench::Run("RecordFunctionCalls(id, 2048 rows)", [&] {
+        t.RecordFunctionCalls(id, kChunkRows, kChunkRows * 0.25);
+    }));
+
+    t.DrainFunctionAggregatesForTesting();
+    PostHogTelemetry::Cleanup();
+    return 0;
+}
@@ -0,0 +1,237 @@
+// Replays a shape trace (PostHogTelemetry::StartShapeTrace) against the
+// library: one thread per traced thread, each issuing its Capture /
+// RecordFunctionCall / RecordFunctionCalls calls in order, with names, keys
+// and values regenerated at the recorded lengths and types. Prints the cost
+// spent in the library per replayed call, back to back and (with --paced) at
+// the recorded timing.
+//
+//   bench_replay [trace ...] [--paced]
+//
+// Without arguments it replays every bench/traces/*.trace in the source tree.
+#include "bench_util.hpp"
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace duckdb;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct TraceOp {
+    char kind = 0;           // E, F, B
+    int64_t t_us = 0;
+    uint32_t name = 0;
+    PropertyMap props;       // E
+    double ms = 0;           // F: duration, B: total
+    int64_t n = 0;           // F: label length (-1 none), B: rows
+};
+
+struct Trace {
+    std::vector<std::string> names;                 // by ordinal
+    std::map<uint32_t, std::vector<TraceOp>> threads;
+    size_t ops = 0;
+    size_t events = 0, calls = 0, batches = 0;
+};
+
+// A distinct string of (at least) `len` bytes for ordinal `id`.
+std::string MakeName(uint32_t id, size_t len) {
+    std::string s = "n" + std::to_string(id) + "_";
+    if (s.size() < len) {
+        s.append(len - s.size(), 'x');
+    }
+    return s;
+}
+
+PropertyValue MakeValue(char type, size_t len) {
+    switch (type) {
+        case 's': return std::string(len, 'v');
+        case 'j': return PropertyValue::Json(len >= 2 ? "\"" + std::string(len - 2, 'v') + "\"" : "0");
+        case 'i': return int64_t(42);
+        case 'u': return uint64_t(42);
+        case 'd': return 4.2;
+        default:  return true;
+    }
+}
+
+bool LoadTrace(const std::string& path, Trace& trace) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        char kind;
+        fields >> kind;
+        if (kind == 'N') {
+            uint32_t id;
+            size_t len;
+            fields >> id >> len;
+            if (trace.names.size() <= id) {
+                trace.names.resize(id + 1);
+            }
+            trace.names[id] = MakeName(id, len);
+            continue;
+        }
+        TraceOp op;
+        uint32_t thread;
+        op.kind = kind;
+        fields >> op.t_us >> thread >> op.name;
+        if (kind == 'E') {
+            std::string shape;
+            fields >> shape;
+            std::istringstream props(shape);
+            std::string prop;
+            while (std::getline(props, prop, ',')) {
+                if (prop.size() < 2) {
+                    continue;
+                }
+                size_t colon = prop.find(':');
+                uint32_t key = static_cast<uint32_t>(std::stoul(prop.substr(1, colon)));
+                size_t len = colon == std::string::npos ? 0 : std::stoul(prop.substr(colon + 1));
+                op.props[trace.names.at(key)] = MakeValue(prop[0], len);
+            }
+            trace.events++;
+        } else if (kind == 'F') {
+            fields >> op.ms >> op.n;
+            trace.calls++;
+        } else if (kind == 'B') {
+            fields >> op.n >> op.ms;
+            trace.batches++;
+        } else {
+            continue;
+        }
+        trace.threads[thread].push_back(std::move(op));
+        trace.ops++;
+    }
+    return trace.ops > 0;
+}
+
+// Issues one traced thread's calls; returns the time spent inside them (only
+// measured when paced, so the sleeps between calls don't count).
+double ReplayThread(PostHogTelemetry& t, const Trace& trace, const std::vector<TraceOp>& ops,
+                    std::chrono::steady_clock::time_point start, bool paced) {
+    using Clock = std::chrono::steady_clock;
+    std::string label;
+    Clock::duration busy{};
+    for (const TraceOp& op : ops) {
+        Clock::time_point begin;
+        if (paced) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(op.t_us));
+            begin = Clock::now();
+        }
+        const std::string& name = trace.names[op.name];
+        switch (op.kind) {
+            case 'E':
+                t.Capture(name, op.props);
+                break;
+            case 'F':
+                if (op.n >= 0) {
+                    label.assign(static_cast<size_t>(op.n), 'l');
+                    t.RecordFunctionCall(name, op.ms, label);
+                } else {
+                    t.RecordFunctionCall(name, op.ms);
+                }
+                break;
+            case 'B':
+                t.RecordFunctionCalls(t.GetFunctionId(name), static_cast<uint64_t>(op.n), op.ms);
+                break;
+        }
+        if (paced) {
+            busy += Clock::now() - begin;
+        }
+    }
+    return std::chrono::duration<double, std::nano>(busy).count();
+}
+
+// Caller-side cost of one replay in ns per replayed call: wall time until
+// every thread is done when back to back, time inside the calls when paced.
+// The flush that drains the replay afterwards is not counted.
+double ReplayOnce(PostHogTelemetry& t, const Trace& trace, bool paced) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> busy(trace.threads.size());
+    std::vector<std::thread> threads;
+    size_t i = 0;
+    for (auto& entry : trace.threads) {
+        threads.emplace_back([&, i, ops = &entry.second] {
+            busy[i] = ReplayThread(t, trace, *ops, start, paced);
+        });
+        i++;
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    t.Flush();
+    if (paced) {
+        ns = 0;
+        for (double b : busy) {
+            ns += b;
+        }
+    }
+    return ns / static_cast<double>(trace.ops);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool paced = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--paced") {
+            paced = true;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
+        for (auto& entry : fs::directory_iterator(BENCH_TRACE_DIR)) {
+            if (entry.path().extension() == ".trace") {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+    }
+
+    auto& t = PostHogTelemetry::Instance();
+    t.SetTransport([](const std::string&, const std::string&, const std::vector<PostHogEvent>&) {});
+    for (const std::string& path : paths) {
+        Trace trace;
+        if (!LoadTrace(path, trace)) {
+            std::fprintf(stderr, "FAIL: cannot read shape trace %s\n", path.c_str());
+            return 1;
+        }
+        std::string base = path.substr(path.find_last_of("/\\") + 1);
+        std::printf("%s: %zu calls on %zu threads (%zu events, %zu function calls, %zu batches)\n",
+                    base.c_str(), trace.ops, trace.threads.size(), trace.events, trace.calls,
+                    trace.batches);
+        const int kRuns = paced ? 1 : 7;
+        std::vector<double> runs;
+        ReplayOnce(t, trace, false);   // warm-up: function table, worker, identity
+        for (int r = 0; r < kRuns; r++) {
+            runs.push_back(ReplayOnce(t, trace, paced));
+        }
+        std::sort(runs.begin(), runs.end());
+        bench::Result result;
+        result.name = base + (paced ? " (paced)" : " (back to back)");
+        result.ns_per_op = runs[runs.size() / 2];
+        result.iterations = trace.ops * runs.size();
+        bench::Print(result);
+    }
+    PostHogTelemetry::Cleanup();
+    return 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+// Minimal timing harness for the micro-benchmarks in this directory. No
+// framework dependency: each benchmark is a plain executable that prints one
+// line per case, so results diff cleanly between builds.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// Keep the compiler from discarding a value it can prove unused.
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+struct Result {
+    std::string name;
+    double ns_per_op = 0;     // median over the timed batches
+    uint64_t iterations = 0;  // total timed calls
+};
+
+// Run `fn` in batches until `min_seconds` of timed work has accumulated (after
+// a short warm-up) and report the median batch cost per call. The median keeps
+// one descheduled batch from skewing a sub-nanosecond result. Millisecond-scale
+// cases pass a small `batch`.
+template <typename Fn>
+Result Run(const std::string& name, Fn&& fn, double min_seconds = 0.5, uint64_t batch = 10000) {
+    using Clock = std::chrono::steady_clock;
+    const uint64_t kBatch = batch;
+    for (uint64_t i = 0; i < kBatch; i++) {
+        fn();
+    }
+    std::vector<double> per_op;
+    Result r;
+    r.name = name;
+    double total_s = 0;
+    while (total_s < min_seconds) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < kBatch; i++) {
+            fn();
+        }
+        double s = std::chrono::duration<double>(Clock::now() - start).count();
+        total_s += s;
+        per_op.push_back(s * 1e9 / kBatch);
+        r.iterations += kBatch;
+    }
+    std::sort(per_op.begin(), per_op.end());
+    r.ns_per_op = per_op[per_op.size() / 2];
+    return r;
+}
+
+inline void Print(const Result& r) {
+    std::printf("%-48s %14.2f ns/op  (%llu iterations)\n", r.name.c_str(), r.ns_per_op,
+                static_cast<unsigned long long>(r.iterations));
+}
+
+} // namespace bench
@@ -0,0 +1,33 @@
+# Prebuilt DuckDB library (for duckdb_re2, exception types, and anything that
+# runs a real database) matching DUCKDB_VERSION. Sets DUCKDB_LIBRARY and
+# duckdb_prebuilt_SOURCE_DIR. Shared by the unit tests and the benchmarks.
+
+include(FetchContent)
+
+# Platform-specific DuckDB prebuilt library
+if(WIN32)
+    set(DUCKDB_LIB_ZIP "libduckdb-windows-amd64.zip")
+elseif(APPLE)
+    set(DUCKDB_LIB_ZIP "libduckdb-osx-universal.zip")
+elseif(CMAKE_SYSTEM_PROCESSOR MATCHES "aarch64|arm64")
+    set(DUCKDB_LIB_ZIP "libduckdb-linux-aarch64.zip")
+else()
+    set(DUCKDB_LIB_ZIP "libduckdb-linux-amd64.zip")
+endif()
+
+FetchContent_Declare(duckdb_prebuilt
+    URL https://github.com/duckdb/duckdb/releases/download/${DUCKDB_VERSION}/${DUCKDB_LIB_ZIP}
+    DOWNLOAD_EXTRACT_TIMESTAMP TRUE
+)
+FetchContent_GetProperties(duckdb_prebuilt)
+if(NOT duckdb_prebuilt_POPULATED)
+    FetchContent_Populate(duckdb_prebuilt)
+endif()
+
+find_library(DUCKDB_LIBRARY
+    NAMES duckdb libduckdb
+    PATHS ${duckdb_prebuilt_SOURCE_DIR}
+    NO_DEFAULT_PATH
+    REQUIRED
+)
+message(STATUS "Found DuckDB library: ${DUCKDB_LIBRARY}")
@@ -6,20 +6,27 @@
 // then compiles to an inline no-op and telemetry.cpp must not be compiled.
 #if !defined(POSTHOG_TELEMETRY_DISABLED)
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <vector>
 #include <map>
+#include <memory>
 #include <set>
 #include <mutex>
 #include <thread>
-#include <queue>
+#include <array>
+#include <deque>
+#include <unordered_map>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <atomic>
+#include <cstdio>
 
 namespace duckdb {
 
@@ -89,21 +96,401 @@ struct PostHogEvent {
     std::string GetNowISO8601() const;
 };
 
+// Event categories for PostHogTelemetry::SetCategoryMask, one bit each.
+// Every event belongs to exactly one; names outside the schema count as metric.
+enum TelemetryCategory : uint32_t {
+    kTelemetryLifecycle = 1u << 0,   // extension_loaded, application_start / _stop
+    kTelemetryFeature   = 1u << 1,   // feature_used
+    kTelemetryError     = 1u << 2,   // $exception
+    kTelemetryFunction  = 1u << 3,   // RecordFunctionCall(s): function_executed / _stats
+    kTelemetryGroup     = 1u << 4,   // $groupidentify
+    kTelemetryMetric    = 1u << 5,   // IngestQueryProfile, custom Capture events
+    kTelemetryAllCategories = (1u << 6) - 1
+};
+
+// Point-in-time view of one function's current (not yet flushed) aggregation
+// window, as returned by PostHogTelemetry::GetStats().
+struct TelemetryFunctionStats {
+    std::string function_name;
+    uint64_t call_count = 0;
+    double duration_ms_p50 = 0;
+    double duration_ms_p95 = 0;
+    double duration_ms_p99 = 0;
+    double first_call_ms = -1;   // the session's first (cold) call; < 0 = not tracked
+};
+
+// Live pipeline counters plus the aggregator contents. Counters are cumulative
+// for the process; `functions` is the in-flight window (what the next flush
+// would emit), in function-name order.
+struct TelemetryStats {
+    bool worker_running = false;               // background worker thread started
+    uint64_t queue_depth = 0;                  // events buffered awaiting a send
+    uint64_t dropped_buffer_full = 0;          // events dropped by the buffer cap
+    uint64_t dropped_untracked_functions = 0;  // calls past the distinct-function cap
+    uint64_t sampled_out_calls = 0;            // calls decimated by SetSampling
+    uint64_t suppressed_aggregates = 0;        // stable windows folded, not emitted
+    uint64_t dropped_remote_config = 0;        // events disabled / rate-limited remotely
+    uint64_t memory_limit_bytes = 0;           // cgroup v2 memory.max; 0 = none
+    double memory_pressure_avg10 = 0;          // cgroup memory.pressure "some avg10" (%)
+    uint64_t max_pending_events = 0;           // current buffer budget
+    uint64_t max_tracked_functions = 0;        // current distinct-function budget
+    uint64_t budget_shrinks = 0;               // refreshes that lowered a budget
+    uint64_t governor_level = 0;               // CPU governor step, 0 (off) .. 3
+    uint64_t cpu_usage_ppm = 0;                // telemetry CPU, last interval (ppm of a core)
+    uint64_t cpu_budget_ppm = 0;               // SetCpuBudget; 0 = governor disabled
+    uint64_t governor_shed_events = 0;         // prompt events / profiles shed over budget
+    uint64_t truncated_events = 0;             // events trimmed to the byte budget
+    uint64_t category_mask = 0;                // SetCategoryMask (TelemetryCategory bits)
+    uint64_t cardinality_violations = 0;       // (event, key) pairs past the cardinality limit
+    uint64_t cardinality_bucketed = 0;         // values replaced by "__other__"
+    std::vector<TelemetryFunctionStats> functions;
+    // Operator window from IngestQueryProfile (function_name = operator type,
+    // call_count = operator instances).
+    std::vector<TelemetryFunctionStats> operators;
+};
+
+// Runtime knobs fetched from a remote JSON document (see
+// PostHogTelemetry::SetRemoteConfig). Default-constructed = the compiled
+// behaviour, which is what applies until a fetch (or the disk cache) succeeds.
+//
+//   {"sampling_rate": 0.1,
+//    "disabled_events": ["function_executed"],
+//    "rate_limits": {"feature_used": 600},
+//    "flush_interval_ms": 30000}
+struct TelemetryRemoteConfig {
+    double sampling_rate = 1.0;                   // caps SetSampling (function calls)
+    std::set<std::string> disabled_events;        // dropped before enrichment
+    std::map<std::string, uint32_t> rate_limits;  // event name -> max events per minute
+    uint32_t flush_interval_ms = 0;               // 0 = send promptly
+    std::string etag;                             // validator sent as If-None-Match
+};
+
 // Free function for processing events (exposed for testing). Single-event
 // convenience: POSTs one event to the default host as a batch of one.
 void PostHogProcess(const std::string api_key, const PostHogEvent &event);
 
-// Coalesced transport: POST N events to `host` + "/batch/" as one request.
+// Runs fn(0) … fn(n-1), in any order and on any threads, returning once all
+// have finished. Lets the transport encode a large backlog's chunks
+// concurrently, on its own helpers (TelemetryThreadParallelFor) or the host's
+// thread pool.
+using TelemetryParallelFor = std::function<void(size_t n, const std::function<void(size_t)>& fn)>;
+
+// A TelemetryParallelFor on up to `max_threads` short-lived threads, the
+// caller included. Empty (serial) for max_threads <= 1.
+TelemetryParallelFor TelemetryThreadParallelFor(size_t max_threads);
+
+// Encode events as /batch/ request bodies of at most 250 events each, in
+// event order; chunks are encoded through `parallel_for` when given.
+std::vector<std::string> PostHogEncodeBatch(const std::string &api_key,
+                                            const std::vector<PostHogEvent> &events,
+                                            const TelemetryParallelFor &parallel_for = {});
+
+// Coalesced transport: POST N events to `host` + "/batch/", split into
+// payload-limit chunks that are encoded first (see PostHogEncodeBatch) and
+// posted in order.
 void PostHogProcessBatch(const std::string &api_key, const std::string &host,
-                         const std::vector<PostHogEvent> &events);
+                         const std::vector<PostHogEvent> &events,
+                         const TelemetryParallelFor &parallel_for = {});
+
+// Delivery function for coalesced batches: the PostHog /batch/ transport by
+// default, or a local sink (see DuckDBEventSink in telemetry_duckdb.hpp).
+// Always invoked on the telemetry worker thread, one call per drained batch.
+using TelemetryTransport = std::function<void(const std::string& api_key,
+                                              const std::string& host,
+                                              const std::vector<PostHogEvent>& events)>;
+
+// One function's row of an emitted aggregation window, as handed to a window
+// sink: the window's recorded call count (prompt-phase calls included), its
+// bounded duration reservoir (`weights` parallel to `duration_ms`, empty =
+// weight 1 each; see RecordFunctionCalls), the process's cold first call
+// (-1 = not recorded) and the effective sample rate the calls were recorded
+// at, so call_count / sample_rate estimates the calls actually made.
+struct TelemetryWindowFunction {
+    std::string function_name;
+    uint64_t call_count = 0;
+    std::vector<double> duration_ms;
+    std::vector<uint64_t> weights;
+    double first_call_ms = -1;
+    double sample_rate = 1.0;
+};
+
+// Observer of emitted function-aggregate windows (see
+// PostHogTelemetry::SetWindowSink). `pipeline` carries the GetStats counters;
+// its functions/operators lists are left empty.
+using TelemetryWindowSink = std::function<void(const std::vector<TelemetryWindowFunction>& functions,
+                                               const TelemetryStats& pipeline)>;
+
+// Hierarchical timer wheel over integer ticks (the queue uses milliseconds).
+// Four levels of 64 slots cover 2^24 ticks (~4.6 h at 1 ms); later deadlines
+// wait on an overflow list that is re-placed every 2^24 ticks. A timer sits in
+// the lowest level whose slot it shares with "now" above that level, so slots
+// only ever hold future ticks and a level cascades into the one below when
+// "now" crosses its block boundary. Nodes are pooled and linked intrusively:
+// Insert and Cancel are O(1); Advance skips empty level-0 runs with an
+// occupancy bitmap. Not thread-safe; TelemetryTaskQueue guards it.
+template <typename P>
+class TelemetryTimerWheel {
+public:
+    using Id = uint64_t;   // 0 is never issued
+
+    explicit TelemetryTimerWheel(uint64_t now_tick = 0) : _now(now_tick) {
+        _head.fill(kNil);
+        _tail.fill(kNil);
+        _occupied.fill(0);
+    }
+
+    uint64_t Now() const { return _now; }
+    size_t size() const { return _live; }
+
+    // Schedule `payload` for `due_tick`; a tick not after Now() fires on the
+    // next Advance.
+    Id Insert(uint64_t due_tick, P payload) {
+        uint32_t idx;
+        if (_free != kNil) {
+            idx = _free;
+            _free = _nodes[idx].next;
+        } else {
+            idx = static_cast<uint32_t>(_nodes.size());
+            _nodes.emplace_back();
+        }
+        Node& n = _nodes[idx];
+        n.payload = std::move(payload);
+        n.due = std::max(due_tick, _now + 1);
+        n.live = true;
+        Place(idx, _now);
+        _live++;
+        return (static_cast<uint64_t>(n.gen) << 32) | (idx + 1);
+    }
+
+    // Unschedule a pending timer. False if it already fired or was cancelled.
+    bool Cancel(Id id) {
+        uint32_t idx = static_cast<uint32_t>(id & 0xFFFFFFFFu) - 1;
+        if (id == 0 || idx >= _nodes.size() || !_nodes[idx].live ||
+            _nodes[idx].gen != static_cast<uint32_t>(id >> 32)) {
+            return false;
+        }
+        Unlink(idx);
+        Release(idx);
+        return true;
+    }
+
+    // Move "now" to `to_tick`, calling on_expire(Id, P&&) for every timer due
+    // by then, in deadline order (insertion order within a tick).
+    template <typename F>
+    void Advance(uint64_t to_tick, F&& on_expire) {
+        while (_now < to_tick) {
+            uint64_t t = _now + 1;
+            if ((t & kMask) == 0) {
+                Cascade(t);
+            }
+            uint64_t ahead = _occupied[0] >> (t & kMask);   // slots t..end of block
+            if (ahead == 0) {
+                _now = std::min(t | kMask, to_tick);
+                continue;
+            }
+            t += static_cast<uint64_t>(CountTrailingZeros(ahead));
+            if (t > to_tick) {
+                _now = to_tick;
+                break;
+            }
+            _now = t;
+            uint32_t list = static_cast<uint32_t>(t & kMask);
+            uint32_t idx = Detach(list);
+            while (idx != kNil) {
+                uint32_t next = _nodes[idx].next;
+                Id id = (static_cast<uint64_t>(_nodes[idx].gen) << 32) | (idx + 1);
+                P payload = std::move(_nodes[idx].payload);
+                Release(idx);
+                on_expire(id, std::move(payload));
+                idx = next;
+            }
+        }
+    }
 
-// Simple thread-safe task queue for background telemetry processing
+    // A tick at or before the earliest deadline (exact when it is within the
+    // current level-0 block); false when empty. Waking there and advancing is
+    // always safe: a cascade at worst finds the next lower bound.
+    bool NextDeadline(uint64_t& tick) const {
+        if (_live == 0) {
+            return false;
+        }
+        for (uint32_t level = 0; level < kLevels; level++) {
+            uint32_t shift = level * kBits;
+            uint32_t digit = static_cast<uint32_t>((_now >> shift) & kMask);
+            // Level 0 slots hold ticks after now; higher levels only digits
+            // strictly above now's.
+            uint32_t from = digit + 1;
+            if (from < kSlots) {
+                uint64_t ahead = _occupied[level] >> from;
+                if (ahead != 0) {
+                    uint64_t slot = from + static_cast<uint64_t>(CountTrailingZeros(ahead));
+                    uint64_t block = (_now >> (shift + kBits)) << (shift + kBits);
+                    tick = block + (slot << shift);
+                    return true;
+                }
+            }
+        }
+        // Only overflow timers: the next top-level wrap re-places them.
+        tick = ((_now >> kRange) + 1) << kRange;
+        return true;
+    }
+
+    void Clear() {
+        _nodes.clear();
+        _head.fill(kNil);
+        _tail.fill(kNil);
+        _occupied.fill(0);
+        _free = kNil;
+        _live = 0;
+    }
+
+private:
+    static constexpr uint32_t kBits = 6;
+    static constexpr uint32_t kSlots = 1u << kBits;
+    static constexpr uint64_t kMask = kSlots - 1;
+    static constexpr uint32_t kLevels = 4;
+    static constexpr uint32_t kRange = kBits * kLevels;       // ticks covered: 2^kRange
+    static constexpr uint32_t kOverflow = kLevels * kSlots;   // list index past the wheel
+    static constexpr uint32_t kNil = 0xFFFFFFFFu;
+
+    struct Node {
+        P payload{};
+        uint64_t due = 0;
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+        uint32_t list = kNil;
+        uint32_t gen = 0;
+        bool live = false;
+    };
+
+    static int CountTrailingZeros(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(v);
+#else
+        int n = 0;
+        while ((v & 1) == 0) {
+            v >>= 1;
+            n++;
+        }
+        return n;
+#endif
+    }
+
+    // Link a node into its slot relative to `now`.
+    void Place(uint32_t idx, uint64_t now) {
+        uint64_t due = _nodes[idx].due;
+        uint32_t list = kOverflow;
+        for (uint32_t level = 0; level < kLevels; level++) {
+            uint32_t above = (level + 1) * kBits;
+            if ((due >> above) == (now >> above)) {
+                list = level * kSlots + static_cast<uint32_t>((due >> (level * kBits)) & kMask);
+                break;
+            }
+        }
+        Node& n = _nodes[idx];
+        n.list = list;
+        n.next = kNil;
+        n.prev = _tail[list];
+        if (_tail[list] != kNil) {
+            _nodes[_tail[list]].next = idx;
+        } else {
+            _head[list] = idx;
+        }
+        _tail[list] = idx;
+        if (list != kOverflow) {
+            _occupied[list / kSlots] |= uint64_t(1) << (list % kSlots);
+        }
+    }
+
+    void Unlink(uint32_t idx) {
+        Node& n = _nodes[idx];
+        if (n.prev != kNil) {
+            _nodes[n.prev].next = n.next;
+        } else {
+            _head[n.list] = n.next;
+        }
+        if (n.next != kNil) {
+            _nodes[n.next].prev = n.prev;
+        } else {
+            _tail[n.list] = n.prev;
+        }
+        if (_head[n.list] == kNil && n.list != kOverflow) {
+            _occupied[n.list / kSlots] &= ~(uint64_t(1) << (n.list % kSlots));
+        }
+    }
+
+    // Take a whole list; returns its first node (chained through `next`).
+    uint32_t Detach(uint32_t list) {
+        uint32_t first = _head[list];
+        _head[list] = kNil;
+        _tail[list] = kNil;
+        if (list != kOverflow) {
+            _occupied[list / kSlots] &= ~(uint64_t(1) << (list % kSlots));
+        }
+        return first;
+    }
+
+    void Release(uint32_t idx) {
+        Node& n = _nodes[idx];
+        n.payload = P();
+        n.live = false;
+        n.gen++;
+        n.next = _free;
+        _free = idx;
+        _live--;
+    }
+
+    // `t` starts a new level-0 block: pull every level whose block also starts
+    // at `t` one step down, highest first, so nodes can fall several levels.
+    // They are placed relative to `t` itself (Advance is about to enter it),
+    // so a node due at `t` lands in level 0 and fires right away.
+    void Cascade(uint64_t t) {
+        if ((t & ((uint64_t(1) << kRange) - 1)) == 0) {
+            Replace(Detach(kOverflow), t);
+        }
+        for (uint32_t level = kLevels - 1; level >= 1; level--) {
+            uint32_t shift = level * kBits;
+            if ((t & ((uint64_t(1) << shift) - 1)) == 0) {
+                uint32_t slot = static_cast<uint32_t>((t >> shift) & kMask);
+                Replace(Detach(level * kSlots + slot), t);
+            }
+        }
+    }
+
+    void Replace(uint32_t idx, uint64_t now) {
+        while (idx != kNil) {
+            uint32_t next = _nodes[idx].next;
+            Place(idx, now);
+            idx = next;
+        }
+    }
+
+    std::vector<Node> _nodes;
+    std::array<uint32_t, kOverflow + 1> _head;
+    std::array<uint32_t, kOverflow + 1> _tail;
+    std::array<uint64_t, kLevels> _occupied;
+    uint32_t _free = kNil;
+    size_t _live = 0;
+    uint64_t _now;   // every timer due at or before this tick has fired
+};
+
+// Thread-safe task queue for background telemetry processing. Immediate tasks
+// run in enqueue order; ScheduleAt / ScheduleEvery arm one-shot and periodic
+// timers (delayed flushes, the remote-config refresh) on a timer wheel that
+// the single worker services between immediate tasks, alternating the two so
+// neither starves the other. Nothing ever sleeps on the worker.
 template<typename T>
 class TelemetryTaskQueue {
 public:
     using TaskFunction = std::function<void(T)>;
-
-    TelemetryTaskQueue() : stop_processing(false) {
+    using Clock = std::chrono::steady_clock;
+    using TimerId = uint64_t;   // 0 = none
+
+    // `now` replaces the steady clock (tests drive a virtual clock and call
+    // Wake() after moving it).
+    explicit TelemetryTaskQueue(std::function<Clock::time_point()> now = {})
+        : stop_processing(false), clock(std::move(now)) {
+        epoch = Now();
         worker_thread = std::thread(&TelemetryTaskQueue::ProcessQueue, this);
     }
 
@@ -117,11 +504,47 @@ public:
             if (stop_processing) {
                 return;
             }
-            tasks.push({task, data});
+            immediate.push_back({std::move(task), data});
         }
         condition.notify_one();
     }
 
+    // Run `task` once, no earlier than `due`; equal deadlines stay FIFO (at the
+    // queue's 1 ms resolution).
+    TimerId ScheduleAt(TaskFunction task, T data, Clock::time_point due) {
+        return Arm(std::move(task), data, due, Clock::duration::zero());
+    }
+
+    // Run `task` every `period`, first one period from now. A run that comes
+    // due while the previous one is still executing is skipped, not queued.
+    TimerId ScheduleEvery(TaskFunction task, T data, Clock::duration period) {
+        if (period < std::chrono::milliseconds(1)) {
+            period = std::chrono::milliseconds(1);
+        }
+        return Arm(std::move(task), data, Now() + period, period);
+    }
+
+    // Stop a timer. True if it was still armed; a run already in progress
+    // completes, but a periodic timer is not re-armed after it.
+    bool Cancel(TimerId id) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        auto it = timers.find(id);
+        if (it == timers.end()) {
+            return false;
+        }
+        if (it->second != 0) {
+            wheel.Cancel(it->second);
+        }
+        timers.erase(it);
+        return true;
+    }
+
+    // Re-read the clock now: a test that advanced its virtual clock calls this
+    // so the worker fires whatever became due.
+    void Wake() {
+        condition.notify_all();
+    }
+
     void Stop() {
         {
             std::lock_guard<std::mutex> lock(queue_mutex);
@@ -130,7 +553,10 @@ public:
             // the atexit shutdown handler, and executing queued tasks there
             // starts new HTTPS requests whose httplib function-local statics
             // (URL-parsing regexes) may already be destroyed at that point.
-            std::queue<QueueItem>().swap(tasks);
+            immediate.clear();
+            ready.clear();
+            wheel.Clear();
+            timers.clear();
         }
         condition.notify_all();
         idle_condition.notify_all();
@@ -139,14 +565,37 @@ public:
         }
     }
 
-    // Block until the queue is empty and no task is in flight, or until
-    // timeout_ms elapses. Returns true if the queue drained, false on timeout.
-    // Used by PostHogTelemetry::Flush() for a bounded synchronous drain.
+    // Block until no task is due or in flight (timers armed for a future
+    // deadline don't count), or until timeout_ms elapses. Returns true if the
+    // queue drained, false on timeout. Used by PostHogTelemetry::Flush() for a
+    // bounded synchronous drain.
     bool DrainFor(int timeout_ms) {
         std::unique_lock<std::mutex> lock(queue_mutex);
         return idle_condition.wait_for(
             lock, std::chrono::milliseconds(timeout_ms),
-            [this] { return stop_processing || (tasks.empty() && !task_in_flight); });
+            [this] { return stop_processing || (!HasDueTask() && !task_in_flight); });
+    }
+
+    // fork() support for PostHogTelemetry's pthread_atfork handlers. Pause
+    // stops the worker from starting new tasks and waits up to timeout_ms for
+    // the one in flight; false if it is still running. LockForFork /
+    // UnlockAfterFork hold queue_mutex across fork() itself so the child never
+    // inherits it mid-update. Resume undoes Pause in the parent; the child
+    // abandons the queue instead, since its worker thread does not exist there.
+    bool PauseForFork(int timeout_ms) {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        paused = true;
+        return idle_condition.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                       [this] { return stop_processing || !task_in_flight; });
+    }
+    void LockForFork() { queue_mutex.lock(); }
+    void UnlockAfterFork() { queue_mutex.unlock(); }
+    void Resume() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            paused = false;
+        }
+        condition.notify_all();
     }
 
 private:
@@ -154,31 +603,129 @@ private:
         TaskFunction task;
         T data;
     };
+    struct Timer {
+        TaskFunction task;
+        T data{};
+        Clock::time_point due;
+        Clock::duration period;   // zero = one-shot
+        TimerId id = 0;
+    };
+
+    Clock::time_point Now() const {
+        return clock ? clock() : Clock::now();
+    }
+
+    // Ticks are whole milliseconds since construction; deadlines round up so a
+    // timer never fires early.
+    uint64_t DueTick(Clock::time_point due) const {
+        if (due <= epoch) {
+            return 0;
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(due - epoch).count();
+        return static_cast<uint64_t>((ns + 999999) / 1000000);
+    }
+    uint64_t NowTick() const {
+        auto now = Now();
+        if (now <= epoch) {
+            return 0;
+        }
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - epoch).count());
+    }
+
+    TimerId Arm(TaskFunction task, T data, Clock::time_point due, Clock::duration period) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (stop_processing) {
+            return 0;
+        }
+        TimerId id = ++next_timer_id;
+        timers[id] = 0;
+        ArmLocked(Timer{std::move(task), data, due, period, id});
+        return id;
+    }
+
+    // Under queue_mutex; `timers` already tracks the id. Notifying under the
+    // lock is fine: the worker re-checks before it waits again.
+    void ArmLocked(Timer timer) {
+        uint64_t tick = DueTick(timer.due);
+        TimerId id = timer.id;
+        if (tick <= wheel.Now()) {
+            ready.push_back(std::move(timer));   // already due
+            timers[id] = 0;
+        } else {
+            timers[id] = wheel.Insert(tick, std::move(timer));
+        }
+        condition.notify_one();
+    }
+
+    // Must be called under queue_mutex.
+    void AdvanceTimers() {
+        wheel.Advance(NowTick(), [this](uint64_t, Timer&& timer) {
+            timers[timer.id] = 0;   // fired: no longer in the wheel
+            ready.push_back(std::move(timer));
+        });
+    }
+
+    // Must be called under queue_mutex.
+    bool HasDueTask() {
+        AdvanceTimers();
+        return !immediate.empty() || !ready.empty();
+    }
 
     void ProcessQueue() {
+        bool timer_turn = true;
         while (true) {
             QueueItem item;
+            Timer timer;
+            bool is_timer = false;
             {
                 std::unique_lock<std::mutex> lock(queue_mutex);
-                condition.wait(lock, [this] { return stop_processing || !tasks.empty(); });
-
-                // Exit as soon as a stop is requested; Stop() has already
-                // discarded whatever was still queued.
-                if (stop_processing) {
-                    return;
+                while (true) {
+                    // Exit as soon as a stop is requested; Stop() has already
+                    // discarded whatever was still queued.
+                    if (stop_processing) {
+                        return;
+                    }
+                    if (paused) {
+                        condition.wait(lock);
+                        continue;
+                    }
+                    AdvanceTimers();
+                    // Drop fired timers cancelled while they waited to run.
+                    while (!ready.empty() && !timers.count(ready.front().id)) {
+                        ready.pop_front();
+                    }
+                    if (!immediate.empty() || !ready.empty()) {
+                        break;
+                    }
+                    idle_condition.notify_all();
+                    uint64_t tick;
+                    if (!wheel.NextDeadline(tick)) {
+                        condition.wait(lock);
+                    } else {
+                        // Wakes early on Stop(), Wake() or a new task/timer.
+                        auto due = epoch + std::chrono::milliseconds(tick);
+                        condition.wait_until(lock, Clock::now() + (due - Now()));
+                    }
                 }
-
-                if (!tasks.empty()) {
-                    item = tasks.front();
-                    tasks.pop();
-                    task_in_flight = true;
+                is_timer = !ready.empty() && (timer_turn || immediate.empty());
+                if (is_timer) {
+                    timer = std::move(ready.front());
+                    ready.pop_front();
                 } else {
-                    continue;
+                    item = std::move(immediate.front());
+                    immediate.pop_front();
                 }
+                timer_turn = !is_timer;
+                task_in_flight = true;
             }
 
             try {
-                item.task(item.data);
+                if (is_timer) {
+                    timer.task(timer.data);
+                } else {
+                    item.task(item.data);
+                }
             } catch (...) {
                 // Swallowing exceptions to prevent thread crash
             }
@@ -186,20 +733,174 @@ private:
             {
                 std::lock_guard<std::mutex> lock(queue_mutex);
                 task_in_flight = false;
-                if (tasks.empty()) {
-                    idle_condition.notify_all();
+                if (is_timer && timers.count(timer.id)) {
+                    if (timer.period > Clock::duration::zero() && !stop_processing) {
+                        // Fixed rate; beats missed while busy are skipped.
+                        auto now = Now();
+                        timer.due += timer.period;
+                        if (timer.due <= now) {
+                            timer.due = now + timer.period;
+                        }
+                        ArmLocked(std::move(timer));
+                    } else {
+                        timers.erase(timer.id);
+                    }
                 }
+                // Unconditional: PauseForFork waits only for the task to end,
+                // DrainFor re-checks for due work itself.
+                idle_condition.notify_all();
             }
         }
     }
 
-    std::queue<QueueItem> tasks;
+    std::deque<QueueItem> immediate;
+    std::deque<Timer> ready;                   // fired, waiting for the worker
+    TelemetryTimerWheel<Timer> wheel;
+    std::unordered_map<TimerId, uint64_t> timers;   // armed id -> wheel id (0 = ready/running)
     std::mutex queue_mutex;
     std::condition_variable condition;
     std::condition_variable idle_condition;
     std::thread worker_thread;
     bool stop_processing;
     bool task_in_flight = false;
+    bool paused = false;   // PauseForFork .. Resume
+    TimerId next_timer_id = 0;
+    std::function<Clock::time_point()> clock;
+    Clock::time_point epoch;
+};
+
+// Open-addressing hash table keyed by std::string and looked up by
+// std::string_view with a caller-computed hash, so a hot path hashes a literal
+// once and probes without building a std::string. Values live in a dense
+// vector in insertion order and are never erased, so an index is a stable
+// handle to its entry. Linear probing over a power-of-two slot array kept at
+// most half full. Not thread-safe.
+template <typename V>
+class TelemetryStringTable {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    static uint64_t Hash(std::string_view key) {
+        uint64_t h = 14695981039346656037ULL;   // FNV-1a
+        for (unsigned char c : key) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // Index of `key`, or npos.
+    size_t Find(std::string_view key, uint64_t hash) const {
+        if (_slots.empty()) {
+            return npos;
+        }
+        size_t mask = _slots.size() - 1;
+        for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+            uint32_t slot = _slots[i];
+            if (slot == 0) {
+                return npos;
+            }
+            const Entry& e = _entries[slot - 1];
+            if (e.hash == hash && e.key == key) {
+                return slot - 1;
+            }
+        }
+    }
+
+    // Index of `key`, inserting a value-initialized entry if it is absent.
+    size_t Insert(std::string_view key, uint64_t hash) {
+        size_t idx = Find(key, hash);
+        if (idx != npos) {
+            return idx;
+        }
+        if ((_entries.size() + 1) * 2 > _slots.size()) {
+            Rehash(_slots.empty() ? 16 : _slots.size() * 2);
+        }
+        _entries.push_back(Entry{std::string(key), hash, V()});
+        Place(_entries.size() - 1);
+        return _entries.size() - 1;
+    }
+
+    size_t size() const { return _entries.size(); }
+    const std::string& KeyAt(size_t idx) const { return _entries[idx].key; }
+    V& ValueAt(size_t idx) { return _entries[idx].value; }
+    const V& ValueAt(size_t idx) const { return _entries[idx].value; }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t hash;
+        V value;
+    };
+
+    void Place(size_t idx) {
+        size_t mask = _slots.size() - 1;
+        size_t i = static_cast<size_t>(_entries[idx].hash) & mask;
+        while (_slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        _slots[i] = static_cast<uint32_t>(idx + 1);
+    }
+
+    void Rehash(size_t slot_count) {
+        _slots.assign(slot_count, 0);
+        for (size_t idx = 0; idx < _entries.size(); idx++) {
+            Place(idx);
+        }
+    }
+
+    std::vector<Entry> _entries;
+    std::vector<uint32_t> _slots;   // 0 = empty, else entry index + 1
+};
+
+// HyperLogLog distinct-value estimate in 256 one-byte registers (~6.5%
+// standard error), with linear counting below 2.5 x 256 where a cardinality
+// limit sits. Add() takes any 64-bit hash and remixes it, so FNV-1a is fine.
+// Not thread-safe.
+class TelemetryCardinalitySketch {
+public:
+    static constexpr uint32_t kBits = 8;
+    static constexpr size_t kRegisters = size_t(1) << kBits;
+
+    // True when a register grew, i.e. the estimate may have moved.
+    bool Add(uint64_t hash) {
+        hash ^= hash >> 33;   // murmur3 fmix64
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        size_t idx = static_cast<size_t>(hash >> (64 - kBits));
+        // Rank = leading zeros of the remaining bits + 1; the guard bit bounds it.
+        uint64_t rest = (hash << kBits) | (uint64_t(1) << (kBits - 1));
+        uint8_t rank = 1;
+        while ((rest & (uint64_t(1) << 63)) == 0) {
+            rest <<= 1;
+            rank++;
+        }
+        if (rank <= _registers[idx]) {
+            return false;
+        }
+        _registers[idx] = rank;
+        return true;
+    }
+
+    double Estimate() const {
+        const double m = static_cast<double>(kRegisters);
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : _registers) {
+            sum += std::ldexp(1.0, -static_cast<int>(r));
+            zeros += r == 0;
+        }
+        double raw = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+        if (raw <= 2.5 * m && zeros > 0) {
+            return m * std::log(m / static_cast<double>(zeros));
+        }
+        return raw;
+    }
+
+private:
+    std::array<uint8_t, kRegisters> _registers{};
 };
 
 class PostHogTelemetry {
@@ -233,6 +934,10 @@ public:
     // Also stores extension_name as default for CaptureFunctionExecution
     void CaptureExtensionLoad(const std::string& extension_name,
                               const std::string& extension_version = "0.1.0");
+    // Same, with load timing (load_ms, phase_<name>_ms) merged into the event;
+    // normally called by ScopedExtensionLoad rather than directly.
+    void CaptureExtensionLoad(const std::string& extension_name,
+                              const std::string& extension_version, PropertyMap timing);
 
     // Capture application lifecycle events
     void CaptureApplicationStart(const std::string& app_name,
@@ -274,8 +979,110 @@ public:
     // calls collapse into one `function_executed` event per function (carrying
     // call_count and duration_ms_p50), flushed on Flush()/session end — this is
     // what tames the per-call firehose. Cheap and lock-guarded.
-    void RecordFunctionCall(const std::string& function_name,
+    void RecordFunctionCall(std::string_view function_name,
                             double duration_ms = 0);
+    // Same, tagging the call with a bounded, enumerated context label (e.g.
+    // InputSizeBucket(rows)) that travels with it if it becomes one of the
+    // window's slowest exemplars. Never pass free-form or per-call-unique data.
+    void RecordFunctionCall(std::string_view function_name, double duration_ms,
+                            std::string_view context_label);
+
+    // Vector-at-a-time recording (a DuckDB scalar function over a DataChunk).
+    // Resolve the name once, e.g. at bind time, into a FunctionId (0 when the
+    // distinct-function cap is reached or function capture is off; recording
+    // to 0 is counted as dropped).
+    // RecordFunctionCalls then adds `rows` to the call count and one sample
+    // of total_ms / rows, weighted by `rows`, to the percentiles: per-row
+    // accuracy at per-chunk cost, with no hash lookup. Sampling decimates
+    // whole chunks. Ids stay valid for the life of the process.
+    using FunctionId = uint32_t;
+    FunctionId GetFunctionId(std::string_view function_name);
+    void RecordFunctionCalls(FunctionId id, uint64_t rows, double total_ms);
+
+    // Number of slowest-call exemplars kept per function per aggregation window
+    // (a bounded min-heap) and emitted as `slowest_ms` on function_executed.
+    // 0 disables exemplars. Default 5.
+    void SetSlowestExemplars(size_t k);
+
+    // Change-triggered emission for long-running servers: function windows
+    // close once a minute on the worker (other drains leave them open), each
+    // closed window updates a per-function EWMA baseline of call rate (calls/s)
+    // and p50 latency, and a function's aggregate is emitted only when either
+    // moves by more than `relative_threshold` (e.g. 0.25 = 25%) from its
+    // baseline, or as a heartbeat once `heartbeat_windows` minutes have passed
+    // since its last emission. Suppressed windows are folded into the next
+    // emitted event (call_count summed, `windows` = number of windows it
+    // covers), so sum(call_count) stays exact. Flush() always emits.
+    // relative_threshold <= 0 disables (the default: every window is emitted).
+    void SetChangeTriggeredEmission(double relative_threshold,
+                                    uint32_t heartbeat_windows = 10,
+                                    double ewma_alpha = 0.3);
+
+    // Emit function aggregates packed: one `function_stats` event per flush
+    // whose `functions` property is a JSON array of {name, count, p50_ms,
+    // p95_ms, p99_ms, ...}, instead of one `function_executed` event (with its
+    // own envelope) per function. Default off; see TELEMETRY-SCHEMA.md for the
+    // HogQL arrayJoin queries.
+    void SetPackedFunctionStats(bool enabled);
+
+    // Cardinality guard: a HyperLogLog sketch per (event, string property
+    // key) estimates how many distinct values the key has carried. Once that
+    // passes `limit`, the key's values on that event are sent as "__other__",
+    // and the pair is reported once as `telemetry_cardinality_violation`
+    // (violating_event, property_key, estimated_distinct) and in GetStats().
+    // Keys starting with '$' are PostHog's and exempt. Setting the limit
+    // restarts every sketch; 0 disables. Default 200.
+    void SetCardinalityLimit(uint32_t limit);
+
+    // Per-event budget for the serialised properties (bytes). Enrichment keeps
+    // the envelope first, then the caller's properties smallest first; the
+    // rest are dropped and the event gets `properties_truncated` (the number
+    // dropped). Packed function_stats events split to fit. Default 64 KiB.
+    void SetMaxEventBytes(size_t bytes);
+
+    // Fold one DuckDB JSON query profile (the profiling_output file written
+    // under PRAGMA enable_profiling = 'json', or EXPLAIN (ANALYZE, FORMAT JSON))
+    // into the aggregator as per-operator-type metrics, emitted alongside the
+    // function aggregates as `operator_executed` (operator_type, call_count,
+    // duration_ms_p50/p95, rows_total). Only the operator type survives: query
+    // text, extra_info (table names, filters, expressions) and plan shape are
+    // dropped. Types that aren't plain enum names, or arrive past the distinct
+    // cap, are counted as "OTHER". Returns false when nothing was recorded:
+    // telemetry is off, or the document is not a query profile.
+    bool IngestQueryProfile(const std::string& profile_json);
+
+    // Power-of-ten bucket label for an input size ("0", "1-9", "10-99", …,
+    // "1e9+"): an enumerated context label for RecordFunctionCall.
+    static std::string InputSizeBucket(uint64_t n);
+
+    // Non-destructive snapshot of the pipeline counters and the aggregator:
+    // copies the current window under the aggregator lock without draining or
+    // resetting it, so it is safe to poll (e.g. from a `telemetry_stats()`
+    // table function, see telemetry_duckdb.hpp).
+    TelemetryStats GetStats();
+
+    // Size the event buffer and the distinct-function cap from the process's
+    // cgroup v2 memory.max (a fixed fraction of it) and halve / quarter them
+    // while memory.pressure reports stalls. Runs at startup and every 30 s on
+    // the worker; outside a memory-limited cgroup the compiled caps apply.
+    void RefreshMemoryBudget();
+    // Testing seam: read memory.max / memory.pressure from `dir` instead of
+    // the process's own cgroup ("" restores it), then refresh.
+    void SetCgroupDirForTesting(const std::string& dir);
+
+    // Telemetry's CPU budget as a fraction of one core (default 0.005, i.e.
+    // 0.5%; 0 disables the governor). Every 5 s the worker adds its own thread
+    // CPU time and that of chunks encoded on other threads to the sampled
+    // capture-path cost. While that exceeds the budget
+    // the governor steps up one level per interval (max 3). Each level doubles
+    // the sampling stride and lengthens the send linger. Level 2 also sheds the
+    // per-call prompt events, and level 3 ignores query profiles. It steps back
+    // down once usage falls under half the budget. State is in GetStats().
+    void SetCpuBudget(double fraction);
+    // Testing seam: replace the worker's thread CPU clock (ns), and run one
+    // governor interval now (wall time comes from SetClockForTesting).
+    void SetCpuClockForTesting(std::function<uint64_t()> thread_cpu_ns);
+    void GovernorTickForTesting();
 
     // Client-side sampling for still-hot events: rate in [0,1]. Recorded events
     // are decimated and stamped with sample_rate so counts scale back up.
@@ -288,6 +1095,26 @@ public:
     bool IsEnabled();
     void SetEnabled(bool enabled);
 
+    // Capture only the categories in `mask` (TelemetryCategory bits), e.g.
+    // from a DuckDB setting. Calls in a masked category return at the same
+    // single relaxed load as a disabled call, before building anything.
+    // Windows already aggregated still emit. Default kTelemetryAllCategories.
+    void SetCategoryMask(uint32_t mask);
+    uint32_t GetCategoryMask();
+    // Parse "all", "none" or a comma-separated list of lifecycle, feature,
+    // error, function, group, metric. Returns false, leaving `mask` alone, on
+    // an unknown name.
+    static bool ParseCategoryMask(const std::string& list, uint32_t& mask);
+    // The category an event name is captured under.
+    static uint32_t CategoryOf(const std::string& event);
+
+    // DATAZOO_DISABLE_TELEMETRY is read once when the instance is created; an
+    // opted-out process skips all capture work and never starts the worker.
+    // Call RecheckEnvironmentOptOut() after changing the variable at runtime;
+    // it returns the new opt-out state.
+    bool RecheckEnvironmentOptOut();
+    bool IsOptedOutByEnvironment();
+
     std::string GetAPIKey();
     void SetAPIKey(std::string new_key);
 
@@ -296,6 +1123,56 @@ public:
     void SetHost(const std::string& host);
     std::string GetHost();
 
+    // Route batches to a custom sink instead of PostHog (e.g. a local DuckDB
+    // database for on-prem analytics). The sink receives fully enriched events
+    // on the worker thread and must not throw. Pass {} to restore the PostHog
+    // transport.
+    void SetTransport(TelemetryTransport fn);
+
+    // Observe every non-empty function-aggregate window as it is emitted (e.g.
+    // a Prometheus textfile, see telemetry_prometheus.hpp), independent of the
+    // transport. Runs on the worker thread, after the drain that emitted the
+    // window, and must not throw or capture. Pass {} to remove. A worker timer
+    // also calls it every 15 s with no functions, so the pipeline counters stay
+    // current in a process that records no function calls.
+    void SetWindowSink(TelemetryWindowSink fn);
+
+    // Shape tracing for benchmark corpora: append one line per Capture,
+    // RecordFunctionCall and RecordFunctionCalls to `path` (time offset,
+    // thread ordinal, value types and lengths, durations), with every name
+    // and key replaced by an ordinal and no value ever written.
+    // bench/bench_replay regenerates the load from the file. Returns false if
+    // the file can't be opened; a running trace is stopped first.
+    bool StartShapeTrace(const std::string& path);
+    void StopShapeTrace();
+
+    // Encode the /batch/ chunks of a large drain (a backlog after an outage)
+    // on up to `max_threads` threads, the worker included; 1 = serial.
+    // Default min(4, hardware threads). Only the PostHog transport encodes;
+    // SetTransport sinks receive events.
+    void SetEncodeParallelism(size_t max_threads);
+    // Same, on the host's own threads (e.g. its task scheduler).
+    void SetEncodeExecutor(TelemetryParallelFor parallel_for);
+
+    // Fleet-wide runtime config: the worker GETs `url` (a small JSON document,
+    // see TelemetryRemoteConfig) now and every `refresh_seconds`, sending
+    // If-None-Match so an unchanged config costs a 304. A good response is
+    // applied atomically and written to `cache_path` (optional), which is also
+    // read here so a restart applies the last config before the first fetch.
+    // A failed fetch or malformed document keeps the last good config, or the
+    // compiled defaults if there never was one. Pass an empty url to stop
+    // fetching and revert to the compiled defaults.
+    void SetRemoteConfig(const std::string& url, const std::string& cache_path = "",
+                         uint32_t refresh_seconds = 300);
+    // Fetch once on the calling thread (the periodic refresh runs this on the
+    // worker). Returns true on 200 (applied) or 304 (unchanged).
+    bool FetchRemoteConfigNow();
+    // The config currently in effect (defaults if none was applied).
+    TelemetryRemoteConfig GetRemoteConfig();
+    // Parse a remote config document. Unknown keys are ignored (forward
+    // compatible); returns false on malformed JSON or out-of-range values.
+    static bool ParseRemoteConfig(const std::string& json, TelemetryRemoteConfig& out);
+
     // Coalesce and synchronously send all buffered events (and drain the
     // function aggregator), blocking up to a bounded timeout. CLIs/servers call
     // this before exit so short runs don't lose events. The at-exit *discard*
@@ -304,10 +1181,8 @@ public:
 
     // Testing seam: intercept the transport so tests can count /batch/ POSTs and
     // inspect coalesced payloads without any network I/O. Pass {} to restore the
-    // real HTTPS transport.
-    void SetTransportForTesting(
-        std::function<void(const std::string& api_key, const std::string& host,
-                           const std::vector<PostHogEvent>& events)> fn);
+    // real HTTPS transport. Same mechanism as SetTransport().
+    void SetTransportForTesting(TelemetryTransport fn);
 
     // Testing seam: disable the automatic per-event / threshold flush so tests
     // buffer events and drive sending deterministically via Flush()/Drain.
@@ -318,6 +1193,11 @@ public:
     // can assert exact aggregate counts).
     void SetPromptFunctionCallsForTesting(int n);
 
+    // Testing seam: replace the steady clock used to time aggregation windows
+    // (the rate baseline of change-triggered emission) and ScopedExtensionLoad.
+    // Pass {} to restore.
+    void SetClockForTesting(std::function<std::chrono::steady_clock::time_point()> now);
+
     // Testing seam: clear the cached is_ci detection so a test can re-fake the
     // environment (CI status is cached once in production).
     static void ResetDetectionCacheForTesting();
@@ -354,6 +1234,25 @@ public:
         const std::string& machine_id, const std::string& mac,
         const std::string& session_id);
 
+    // Opt-in cache file for a distinct_id derived from the MAC address (hosts
+    // without a machine id), keyed by a hash of the hostname and not written
+    // without one, so later processes skip the interface scan. A machine id
+    // is hashed directly and never cached. Default "" (no file is written);
+    // e.g. "$XDG_CACHE_HOME/<product>/identity". Takes effect only before the
+    // first event derives the identity.
+    static void SetIdentityCachePath(const std::string& path);
+
+    // Testing/benchmark seams: derive {distinct_id, identity_source} the way
+    // the process does, from the given machine id and cache file (no static
+    // caching); the MAC lookup reads `<root>/class/net` after
+    // SetSysfsRootForTesting (Linux), and SetHostnameForTesting stands in for
+    // the host's name ("" restores it). MacScansForTesting counts MAC lookups.
+    static std::pair<std::string, std::string> ComputeIdentityForTesting(
+        const std::string& machine_id, const std::string& cache_path);
+    static void SetSysfsRootForTesting(const std::string& root);
+    static void SetHostnameForTesting(const std::string& hostname);
+    static uint64_t MacScansForTesting();
+
     // Testing seam: returns the fully enriched event (common envelope merged
     // with the given props, event props winning on collision, string values
     // length-clamped) WITHOUT checking the enabled flag or enqueuing. Not part
@@ -364,19 +1263,47 @@ public:
     // Testing seam: drain the function aggregator and return the raw (un-sent)
     // `function_executed` events it would produce. Clears the aggregator.
     std::vector<PostHogEvent> DrainFunctionAggregatesForTesting();
+    // Testing seam: the change-window timer's drain (see
+    // SetChangeTriggeredEmission), returning the events instead of sending them.
+    std::vector<PostHogEvent> CloseChangeWindowForTesting();
+    // Testing seam: the window-sink refresh timer's tick, run synchronously.
+    void RefreshWindowSinkForTesting();
+    // Testing seam: same for the operator window (`operator_executed`).
+    std::vector<PostHogEvent> DrainOperatorAggregatesForTesting();
 
 private:
     PostHogTelemetry();
     ~PostHogTelemetry();
 
     static void ShutdownAtExit();
+    // pthread_atfork handlers, registered once by Instance().
+    static void AtForkPrepare();
+    static void AtForkParent();
+    static void AtForkChild();
+    static std::string& SessionIdSlot();
     void Shutdown();
     void EnsureQueueInitialized();   // starts the worker queue (lazily)
-    // True only when telemetry may do work: enabled and not shutting down.
+    void ArmRemoteRefreshLocked();   // periodic remote-config fetch (under _thread_lock)
+    void GovernorTick();             // CPU governor interval (worker timer)
+    uint32_t SendLingerMs();         // deferral of a prompt send; 0 = immediate
+    // True only when telemetry may do work: enabled, not opted out by the
+    // environment, and not shutting down. One relaxed atomic load.
     bool CanAcceptTelemetry();
-    // Enrich + buffer an event; sends promptly (coalesced on the worker) unless
-    // auto-flush is disabled for testing.
-    void EnqueueTelemetryEvent(const PostHogEvent &event);
+    // CanAcceptTelemetry() and `category` not masked off. One relaxed load.
+    bool CaptureOpen(uint32_t category) const
+    {
+        return (_capture_categories.load(std::memory_order_relaxed) & category) != 0;
+    }
+    void UpdateCaptureGateLocked();  // recompute the capture gates (under _thread_lock)
+    // Admit, enrich + buffer an event; sends promptly (coalesced on the worker)
+    // unless auto-flush is disabled for testing. Capture's caller properties
+    // also pass the cardinality guard, after admission.
+    void EnqueueTelemetryEvent(PostHogEvent event, bool guard_cardinality = false);
+    // Capture, with the cardinality guard optional (its own violation reports
+    // bypass it).
+    void CaptureEvent(const std::string& event, PropertyMap props, bool guard_cardinality);
+    // $exception_list / $exception_fingerprint from a (guarded) error_class.
+    void AddExceptionProperties(PropertyMap& props);
     // Append an already-enriched event to the buffer (no send).
     void BufferEvent(const PostHogEvent &enriched);
     // Schedule at most one pending drain task on the worker (coalesces bursts,
@@ -385,9 +1312,15 @@ private:
     // Worker task body: swap the buffer and POST it as one /batch/ request.
     void DrainAndSend();
 
+    // Remote config: drop events the fleet config disables or rate-limits.
+    bool AdmitEvent(const std::string& event_name);
+    void ApplyRemoteConfig(std::shared_ptr<const TelemetryRemoteConfig> config);
+    void ApplySamplingLocked();          // under _agg_lock
+
     // Merge the common envelope into a copy of the event (event props win),
-    // then length-clamp every string value.
+    // then length-clamp every string value and apply the event byte budget.
     PostHogEvent EnrichEvent(const PostHogEvent &event) const;
+    void ApplyEventBudget(PropertyMap& props, const PropertyMap& env) const;
     // Build the common envelope (product / version / os / arch / is_ci /
     // is_container / telemetry_schema / $session_id). One choke point so every
     // event is stamped identically.
@@ -399,17 +1332,103 @@ private:
     static const std::string& DetectArch();
 
     // Function-call aggregation ------------------------------------------------
+    struct Exemplar {
+        double duration_ms;
+        std::string label;    // optional enumerated context label
+    };
     struct FunctionStat {
         uint64_t count = 0;   // recorded after sampling (== call_count)
         std::vector<double> duration_samples;  // bounded reservoir for p50
+        // Rows per sample, parallel to duration_samples once a batch was
+        // recorded (RecordFunctionCalls); empty = every sample weighs 1.
+        std::vector<uint64_t> sample_weights;
+        size_t ring_next = 0;                  // next slot overwritten once full
+        std::vector<Exemplar> slowest;         // min-heap of the K slowest calls
     };
+    // Change-detection state for one function; unlike FunctionStat it persists
+    // across windows.
+    struct FunctionBaseline {
+        bool primed = false;
+        double rate_ewma = 0;           // calls per second
+        double p50_ewma = 0;            // ms
+        FunctionStat carried;           // suppressed windows awaiting emission
+        uint32_t carried_windows = 0;   // of them, windows that had calls
+        std::chrono::steady_clock::time_point last_emit;   // heartbeat clock
+    };
+    // Everything tracked for one function, in one table entry (one hash probe
+    // per call): the persistent sampling / prompt-phase counters, the current
+    // window, and the change-triggered-emission baseline.
+    struct FunctionRecord {
+        uint64_t seen = 0;              // calls seen (pre-sampling), persists across flushes
+        uint64_t prompt_recorded = 0;   // calls recorded, for the prompt phase
+        double first_call_ms = -1;      // cold call, kept out of every window's samples
+        uint64_t prompt_calls = 0;      // sent per call since the last window (window sink)
+        FunctionStat window;            // drained on every flush
+        FunctionBaseline baseline;
+    };
+    void ResetFunctionWindowsLocked();   // drop every window and baseline (under _agg_lock)
+    // One function's row in an emitted window (`windows` > 1 when suppressed
+    // windows of change-triggered emission were folded in).
+    struct FunctionAggregate {
+        std::string name;
+        FunctionStat stat;
+        uint32_t windows;
+        double first_call_ms = -1;
+    };
+    static bool SlowestExemplarsJson(std::vector<Exemplar> slowest, std::string& ms,
+                                     std::string& labels);
+    static void AddSlowestExemplars(PropertyMap& props, std::vector<Exemplar> slowest);
+    // Packed format: `function_stats` events carrying a `functions` array.
+    std::vector<PostHogEvent> PackFunctionStats(std::vector<FunctionAggregate>& rows,
+                                                double sample_rate);
+    static void FoldFunctionStat(FunctionStat& into, FunctionStat& from, size_t slowest_k);
+    std::chrono::steady_clock::time_point Now() const;   // under _agg_lock
+    std::chrono::steady_clock::time_point ClockNow();    // takes _agg_lock
+    friend class ScopedExtensionLoad;   // times the load on the same clock
     // Drain the aggregator into raw `function_executed` events (clears it).
-    std::vector<PostHogEvent> BuildFunctionAggregateEvents();
+    // With change-triggered emission on, function windows only close on the
+    // worker's change-window timer (`close_window`) or when `force`d; any other
+    // drain leaves them open. On close, stable functions are folded into their
+    // baseline instead of emitted, unless `force`.
+    std::vector<PostHogEvent> BuildFunctionAggregateEvents(bool force = false,
+                                                           bool close_window = false);
+    // Per operator type from IngestQueryProfile: timings in the window's
+    // samples, count = operator instances, plus the summed cardinality.
+    struct OperatorRecord {
+        FunctionStat window;
+        uint64_t rows = 0;
+    };
+    // Drain the operator window into raw `operator_executed` events.
+    std::vector<PostHogEvent> BuildOperatorAggregateEvents();
     // Drain the aggregator into the pending buffer (no send). Returns true if
     // anything was buffered.
-    bool BufferFunctionAggregates();
+    bool BufferFunctionAggregates(bool force = false, bool close_window = false);
     // BufferFunctionAggregates + ScheduleSend (one coalesced send task).
     void FlushFunctionAggregates();
+    // Worker timer: close the change-triggered emission window.
+    void CloseChangeWindow();
+    // Worker timer: hand the window sink the current pipeline counters.
+    void RefreshWindowSink();
+    // The process-wide counters of GetStats (no window copies).
+    void FillPipelineStats(TelemetryStats& stats);
+    // Calls the prompt phase sent per call since the last window.
+    struct PromptedCalls {
+        std::string name;
+        uint64_t calls;
+        double first_call_ms;
+    };
+    // Hand an emitted window (plus the prompted calls) to the window sink, if
+    // one is set.
+    void NotifyWindowSink(const std::vector<FunctionAggregate>& emit,
+                          const std::vector<PromptedCalls>& prompted, double sample_rate);
+
+    // Shape trace lines (StartShapeTrace). _trace_lock is a leaf: the batch
+    // line is written under _agg_lock.
+    void TraceEvent(const std::string& event, const PropertyMap& props);
+    void TraceFunctionCall(std::string_view name, double duration_ms, std::string_view label);
+    void TraceFunctionCalls(std::string_view name, uint64_t rows, double total_ms);
+    void TraceLinePrefixLocked(char kind);
+    uint32_t TraceNameLocked(std::string_view name);
 
     // A derived person identity and the source it came from.
     struct Identity { std::string id; std::string source; };
@@ -417,6 +1436,10 @@ private:
                                  const std::string& mac,
                                  const std::string& session_id);
     static Identity ComputeIdentity();
+    static Identity ComputeIdentity(const std::string& machine_id, const std::string& cache_path);
+    static std::string& IdentityCachePathSlot();
+    static std::string& SysfsRootSlot();
+    static std::string& HostnameSlot();
     static const Identity& GetIdentity();   // computed once per process
     static std::string Sha256Hex(const std::string& input);
 
@@ -427,6 +1450,10 @@ private:
 
     std::atomic<bool> _telemetry_enabled;
     bool _shutdown_requested;
+    bool _env_opted_out = false;            // DATAZOO_DISABLE_TELEMETRY at init / recheck
+    std::atomic<bool> _capture_open{false}; // enabled && !shutdown && !env opt-out
+    uint32_t _category_mask = kTelemetryAllCategories;   // SetCategoryMask
+    std::atomic<uint32_t> _capture_categories{0};         // _capture_open ? _category_mask : 0
     std::string _api_key;
     std::string _extension_name;   // Default extension name for CaptureFunctionExecution
     std::string _product;          // Envelope product; empty = fall back to _extension_name
@@ -440,61 +1467,302 @@ private:
     // concurrent Shutdown() resets the member (avoids a use-after-free). The
     // task payload is an unused signal — each task drains _pending itself.
     std::shared_ptr<TelemetryTaskQueue<int>> _queue;
+    std::shared_ptr<TelemetryTaskQueue<int>> _fork_paused_queue;   // AtForkPrepare .. Parent
 
     // Events are sent promptly per-capture (coalesced on the worker); tests can
     // disable this to buffer and drive sending explicitly.
     std::atomic<bool> _auto_flush{true};
 
     std::vector<PostHogEvent> _pending;   // buffered events awaiting a batch POST
+    std::atomic<uint64_t> _dropped_buffer_full{0};          // GetStats() counters
+    std::atomic<uint64_t> _dropped_untracked_functions{0};
+    std::atomic<uint64_t> _sampled_out_calls{0};
+    std::atomic<size_t> _max_pending_events;     // RefreshMemoryBudget
+    std::atomic<size_t> _max_tracked_functions;
+    std::atomic<uint64_t> _budget_shrinks{0};
+    std::atomic<size_t> _max_event_bytes;        // SetMaxEventBytes
+    mutable std::atomic<uint64_t> _truncated_events{0};   // EnrichEvent is const
+    std::string _cgroup_dir;                     // under _thread_lock; "" = not in cgroup v2
+    bool _cgroup_dir_is_override = false;
+    uint64_t _memory_limit_bytes = 0;
+    double _memory_pressure_avg10 = 0;
     bool _flush_scheduled = false;        // a drain task is already queued (coalescing)
     std::mutex _batch_lock;
-    std::function<void(const std::string&, const std::string&,
-                       const std::vector<PostHogEvent>&)> _transport;  // test seam
-
-    std::map<std::string, FunctionStat> _function_stats;
-    std::map<std::string, uint64_t> _sample_seen;      // persistent per-fn decimation counter
-    std::map<std::string, uint64_t> _prompt_recorded;  // per-fn recorded count (prompt phase)
+    TelemetryTransport _transport;        // custom sink / test seam; empty = PostHog
+    TelemetryWindowSink _window_sink;     // under _thread_lock; empty = none
+    std::atomic<bool> _shape_trace_on{false};
+    std::mutex _trace_lock;
+    std::FILE* _trace_file = nullptr;                        // under _trace_lock
+    std::unordered_map<std::string, uint32_t> _trace_names;  // name/key -> ordinal
+    std::chrono::steady_clock::time_point _trace_start;
+    TelemetryParallelFor _encode_parallel_for;   // chunk encoding of large drains
+
+    TelemetryStringTable<FunctionRecord> _functions;   // bounded by _max_tracked_functions
+    std::vector<size_t> _active_functions;             // indices with a non-empty window
+    std::vector<size_t> _prompted_functions;           // indices with prompt_calls > 0
+    std::vector<bool> _in_closing_window;              // scratch for the change pass
+    TelemetryStringTable<OperatorRecord> _operators;   // bounded by kMaxOperatorTypes
+    std::vector<size_t> _active_operators;
     int _prompt_function_calls = 3;                    // first-N calls emitted per-call
+    size_t _slowest_k = 5;                             // exemplars kept per function/window
+    bool _packed_function_stats = false;               // function_stats instead of function_executed
     uint64_t _recorded_since_flush = 0;                // triggers volume-based aggregate flush
+    bool _baselines_active = false;                    // some record holds baseline state
+    double _change_threshold = 0;                      // relative; 0 = emit every window
+    uint32_t _heartbeat_windows = 10;
+    double _ewma_alpha = 0.3;
+    std::chrono::steady_clock::time_point _window_start;
+    std::function<std::chrono::steady_clock::time_point()> _clock;  // empty = steady_clock
+    std::atomic<uint64_t> _suppressed_aggregates{0};
     std::mutex _agg_lock;
     double _sampling_rate = 1.0;          // requested rate; 1.0 = record every call
     uint64_t _sample_stride = 1;          // effective decimation: record 1 of N
     double _effective_sample_rate = 1.0;  // 1.0 / _sample_stride, stamped on events
 
+    // CPU governor; the bookkeeping is under _agg_lock, the level is read
+    // lock-free on the capture path.
+    double _cpu_budget = 0.005;
+    std::atomic<int> _governor_level{0};
+    std::atomic<uint64_t> _capture_cost_ns{0};     // extrapolated, cumulative
+    std::atomic<uint64_t> _encode_helper_cpu_ns{0}; // encode chunks run off the worker, cumulative
+    std::atomic<uint64_t> _cpu_usage_ppm{0};
+    std::atomic<uint64_t> _governor_shed_events{0};
+    std::function<uint64_t()> _cpu_clock;          // empty = the worker's thread CPU clock
+    uint64_t _governor_last_cpu_ns = 0;
+    uint64_t _governor_last_capture_ns = 0;
+    uint64_t _governor_last_helper_ns = 0;
+    std::chrono::steady_clock::time_point _governor_last_tick;
+
+    // Remote config. The pointer is read with std::atomic_load on the capture
+    // path (null = compiled defaults) and replaced wholesale on apply.
+    std::shared_ptr<const TelemetryRemoteConfig> _remote_config;
+    std::string _remote_config_url;      // under _thread_lock; empty = not fetching
+    std::string _remote_config_cache;
+    uint32_t _remote_refresh_s = 300;
+    uint64_t _remote_timer = 0;          // periodic refresh on _queue (0 = none)
+    double _remote_sampling_rate = 1.0;  // under _agg_lock
+    struct RateBucket {
+        double tokens;
+        std::chrono::steady_clock::time_point last;
+    };
+    std::map<std::string, RateBucket> _rate_buckets;
+    std::mutex _rate_lock;
+    std::atomic<uint64_t> _dropped_remote_config{0};
+
+    // Cardinality guard (Capture), keyed "event\x1fkey". _cardinality_lock is
+    // a leaf; violations are captured after it is released.
+    struct CardinalityGuard {
+        TelemetryCardinalitySketch sketch;
+        bool violated = false;
+    };
+    void GuardCardinality(const std::string& event, PropertyMap& props);
+    TelemetryStringTable<CardinalityGuard> _cardinality;   // under _cardinality_lock
+    std::string _cardinality_key;                          // scratch, under _cardinality_lock
+    std::mutex _cardinality_lock;
+    std::atomic<uint32_t> _cardinality_limit;
+    std::atomic<uint64_t> _cardinality_violations{0};
+    std::atomic<uint64_t> _cardinality_bucketed{0};
+
     std::map<std::string, std::string> _groups;      // group type -> key ($groups)
     std::set<std::string> _identified_groups;        // (type,key) already $groupidentify'd
 };
 
+// Times an extension's LOAD on a monotonic clock. Construct it at the top of
+// the load entry point and Mark() the end of each phase; Finish() (or the
+// destructor) emits `extension_loaded` with `load_ms` and one
+// `phase_<name>_ms` per marked phase, via CaptureExtensionLoad. A phase is the
+// time since the previous mark (or construction); marking a name again adds
+// to it. Phase names are an enumeration the extension controls
+// ("register_functions", "init_config", ...); they are lower-cased and
+// anything outside [a-z0-9_] becomes '_'. If the scope is left by an
+// exception nothing is emitted: a failed LOAD is not a load.
+//
+//   ScopedExtensionLoad load("acme", "1.2.0");
+//   RegisterFunctions(loader);   load.Mark("register_functions");
+//   InitConfig(db);              load.Mark("init_config");
+class ScopedExtensionLoad {
+public:
+    ScopedExtensionLoad(std::string extension_name, std::string extension_version = "0.1.0");
+    ~ScopedExtensionLoad();
+
+    ScopedExtensionLoad(const ScopedExtensionLoad&) = delete;
+    ScopedExtensionLoad& operator=(const ScopedExtensionLoad&) = delete;
+
+    void Mark(const std::string& phase);
+    // Emit now rather than at scope exit; later calls (and the destructor) are
+    // no-ops.
+    void Finish();
+
+private:
+    std::string _extension_name;
+    std::string _extension_version;
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _last;
+    std::vector<std::pair<std::string, double>> _phases;   // mark order
+    int _uncaught_at_start;
+    bool _finished = false;
+};
+
 } // namespace duckdb
 
 #else // POSTHOG_TELEMETRY_DISABLED
 
 // No-op stubs: every telemetry call compiles to nothing. Keep this in sync
-// with the real public API above.
+// with the real public API above; test/disabled/caller.cpp is compiled against
+// both halves and its disabled object is checked for leftover references (see
+// test/CMakeLists.txt), so drift or a stray allocation fails the build/tests.
+#include <cstddef>
 #include <cstdint>
-#include <map>
+#include <functional>
+#include <initializer_list>
 #include <string>
-#include <type_traits>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace duckdb {
 
-// Minimal PropertyValue/PropertyMap so call sites passing typed properties to
-// the generalised Capture API compile unchanged when telemetry is disabled.
+// Accepts any argument and keeps nothing, so string parameters don't make the
+// caller materialise a std::string for a call that does nothing.
+struct TelemetryStubArg {
+    template <typename T>
+    constexpr TelemetryStubArg(const T&) {}
+};
+
+// Empty PropertyValue/PropertyMap: call sites that build typed properties
+// compile unchanged, and since nothing is stored the optimizer drops the
+// construction entirely (no map nodes, no strings).
 struct PropertyValue {
-    PropertyValue() {}
-    PropertyValue(const char*) {}
-    PropertyValue(std::string) {}
-    template <typename T,
-              typename std::enable_if<(std::is_integral<T>::value ||
-                                       std::is_enum<T>::value) &&
-                                          !std::is_same<T, bool>::value,
-                                      int>::type = 0>
-    PropertyValue(T) {}
-    PropertyValue(double) {}
-    PropertyValue(bool) {}
-    static PropertyValue Json(std::string) { return PropertyValue(); }
+    constexpr PropertyValue() {}
+    template <typename T>
+    constexpr PropertyValue(const T&) {}
+    template <typename T>
+    PropertyValue& operator=(const T&) { return *this; }
+    template <typename T>
+    static constexpr PropertyValue Json(const T&) { return PropertyValue(); }
 };
-using PropertyMap = std::map<std::string, PropertyValue>;
+
+struct PropertyMap {
+    struct Entry {
+        template <typename K, typename V>
+        constexpr Entry(const K&, const V&) {}
+    };
+    constexpr PropertyMap() {}
+    PropertyMap(std::initializer_list<Entry>) {}
+    template <typename K>
+    PropertyValue operator[](const K&) { return PropertyValue(); }
+    template <typename K, typename V>
+    void emplace(const K&, const V&) {}
+    template <typename P>
+    void insert(const P&) {}
+    template <typename K>
+    size_t count(const K&) const { return 0; }
+    template <typename K>
+    size_t erase(const K&) { return 0; }
+    bool empty() const { return true; }
+    size_t size() const { return 0; }
+    void clear() {}
+};
+
+struct TelemetryRemoteConfig {
+    // Always-empty stand-ins for the std::set / std::map members: enough for
+    // read-only callers, with nothing to allocate.
+    struct EventSet {
+        template <typename K>
+        size_t count(const K&) const { return 0; }
+        bool empty() const { return true; }
+        size_t size() const { return 0; }
+        const std::string* begin() const { return nullptr; }
+        const std::string* end() const { return nullptr; }
+    };
+    struct RateLimitMap {
+        using value_type = std::pair<const std::string, uint32_t>;
+        template <typename K>
+        size_t count(const K&) const { return 0; }
+        template <typename K>
+        const value_type* find(const K&) const { return nullptr; }
+        bool empty() const { return true; }
+        size_t size() const { return 0; }
+        const value_type* begin() const { return nullptr; }
+        const value_type* end() const { return nullptr; }
+    };
+    double sampling_rate = 1.0;
+    EventSet disabled_events;
+    RateLimitMap rate_limits;
+    uint32_t flush_interval_ms = 0;
+    std::string etag;
+};
+
+enum TelemetryCategory : uint32_t {
+    kTelemetryLifecycle = 1u << 0,
+    kTelemetryFeature   = 1u << 1,
+    kTelemetryError     = 1u << 2,
+    kTelemetryFunction  = 1u << 3,
+    kTelemetryGroup     = 1u << 4,
+    kTelemetryMetric    = 1u << 5,
+    kTelemetryAllCategories = (1u << 6) - 1
+};
+
+using TelemetryParallelFor = std::function<void(size_t n, const std::function<void(size_t)>& fn)>;
+inline TelemetryParallelFor TelemetryThreadParallelFor(size_t) { return {}; }
+
+struct PostHogEvent {
+    std::string event_name;
+    std::string distinct_id;
+    PropertyMap properties;
+    std::string timestamp;
+};
+
+using TelemetryTransport = std::function<void(const std::string& api_key,
+                                              const std::string& host,
+                                              const std::vector<PostHogEvent>& events)>;
+
+// Same fields as the real structs, so health checks compile; always zero.
+struct TelemetryFunctionStats {
+    std::string function_name;
+    uint64_t call_count = 0;
+    double duration_ms_p50 = 0;
+    double duration_ms_p95 = 0;
+    double duration_ms_p99 = 0;
+    double first_call_ms = -1;
+};
+
+struct TelemetryStats {
+    bool worker_running = false;
+    uint64_t queue_depth = 0;
+    uint64_t dropped_buffer_full = 0;
+    uint64_t dropped_untracked_functions = 0;
+    uint64_t sampled_out_calls = 0;
+    uint64_t suppressed_aggregates = 0;
+    uint64_t dropped_remote_config = 0;
+    uint64_t memory_limit_bytes = 0;
+    double memory_pressure_avg10 = 0;
+    uint64_t max_pending_events = 0;
+    uint64_t max_tracked_functions = 0;
+    uint64_t budget_shrinks = 0;
+    uint64_t governor_level = 0;
+    uint64_t cpu_usage_ppm = 0;
+    uint64_t cpu_budget_ppm = 0;
+    uint64_t governor_shed_events = 0;
+    uint64_t truncated_events = 0;
+    uint64_t category_mask = 0;
+    uint64_t cardinality_violations = 0;
+    uint64_t cardinality_bucketed = 0;
+    std::vector<TelemetryFunctionStats> functions;
+    std::vector<TelemetryFunctionStats> operators;
+};
+
+struct TelemetryWindowFunction {
+    std::string function_name;
+    uint64_t call_count = 0;
+    std::vector<double> duration_ms;
+    std::vector<uint64_t> weights;
+    double first_call_ms = -1;
+    double sample_rate = 1.0;
+};
+
+using TelemetryWindowSink = std::function<void(const std::vector<TelemetryWindowFunction>& functions,
+                                               const TelemetryStats& pipeline)>;
 
 class PostHogTelemetry {
 public:
@@ -508,29 +1776,68 @@ public:
     PostHogTelemetry(const PostHogTelemetry&) = delete;
     PostHogTelemetry& operator=(const PostHogTelemetry&) = delete;
 
-    void SetProduct(const std::string&, const std::string&, const std::string& = "oss") {}
-    void CaptureExtensionLoad(const std::string&, const std::string& = "0.1.0") {}
-    void CaptureApplicationStart(const std::string&, const std::string&) {}
-    void CaptureApplicationStop(const std::string&, const std::string&) {}
-    void Capture(const std::string&, PropertyMap = {}) {}
-    void CaptureFeature(const std::string&, PropertyMap = {}) {}
-    void CaptureError(const std::string&, PropertyMap = {}) {}
-    void AssociateGroup(const std::string&, const std::string&, PropertyMap = {}) {}
-    void CaptureFunctionExecution(const std::string&, const std::string&, const std::string&) {}
-    void CaptureFunctionExecution(const std::string&, const std::string& = "0.1.0") {}
-    void RecordFunctionCall(const std::string&, double = 0) {}
+    using Arg = TelemetryStubArg;
+    void SetProduct(Arg, Arg, Arg = "oss") {}
+    void CaptureExtensionLoad(Arg, Arg = "0.1.0") {}
+    void CaptureExtensionLoad(Arg, Arg, PropertyMap) {}
+    void CaptureApplicationStart(Arg, Arg) {}
+    void CaptureApplicationStop(Arg, Arg) {}
+    void Capture(Arg, PropertyMap = {}) {}
+    void CaptureFeature(Arg, PropertyMap = {}) {}
+    void CaptureError(Arg, PropertyMap = {}) {}
+    void AssociateGroup(Arg, Arg, PropertyMap = {}) {}
+    void CaptureFunctionExecution(Arg, Arg, Arg) {}
+    void CaptureFunctionExecution(Arg, Arg = "0.1.0") {}
+    void RecordFunctionCall(std::string_view, double = 0) {}
+    void RecordFunctionCall(std::string_view, double, std::string_view) {}
+    using FunctionId = uint32_t;
+    FunctionId GetFunctionId(std::string_view) { return 0; }
+    void RecordFunctionCalls(FunctionId, uint64_t, double) {}
+    void SetSlowestExemplars(size_t) {}
+    void SetChangeTriggeredEmission(double, uint32_t = 10, double = 0.3) {}
+    void SetPackedFunctionStats(bool) {}
+    void SetCardinalityLimit(uint32_t) {}
+    void SetMaxEventBytes(size_t) {}
+    bool StartShapeTrace(TelemetryStubArg) { return false; }
+    void StopShapeTrace() {}
+    bool IngestQueryProfile(Arg) { return false; }
+    void RefreshMemoryBudget() {}
+    void SetCpuBudget(double) {}
+    static std::string InputSizeBucket(uint64_t) { return ""; }
     void SetSampling(double) {}
-    void SetExtensionName(const std::string&) {}
+    void SetExtensionName(Arg) {}
     std::string GetExtensionName() { return ""; }
     bool IsEnabled() { return false; }
     void SetEnabled(bool) {}
+    void SetCategoryMask(uint32_t) {}
+    uint32_t GetCategoryMask() { return 0; }
+    static bool ParseCategoryMask(Arg, uint32_t& mask) { mask = 0; return true; }   // "none"
+    static uint32_t CategoryOf(Arg) { return kTelemetryMetric; }
+    bool RecheckEnvironmentOptOut() { return false; }
+    bool IsOptedOutByEnvironment() { return false; }
     std::string GetAPIKey() { return ""; }
-    void SetAPIKey(std::string) {}
-    void SetHost(const std::string&) {}
+    void SetAPIKey(Arg) {}
+    void SetHost(Arg) {}
     std::string GetHost() { return ""; }
     void Flush() {}
-    void SetDuckDBVersion(const std::string&) {}
-    void SetDuckDBPlatform(const std::string&) {}
+    // Lambdas bind to the templates, so no std::function is built.
+    void SetTransport(TelemetryTransport) {}
+    template <typename F>
+    void SetTransport(const F&) {}
+    void SetWindowSink(TelemetryWindowSink) {}
+    template <typename F>
+    void SetWindowSink(const F&) {}
+    TelemetryStats GetStats() { return TelemetryStats(); }
+    void SetEncodeParallelism(size_t) {}
+    void SetEncodeExecutor(TelemetryParallelFor) {}
+    template <typename F>
+    void SetEncodeExecutor(const F&) {}
+    void SetRemoteConfig(Arg, Arg = "", uint32_t = 300) {}
+    bool FetchRemoteConfigNow() { return false; }
+    TelemetryRemoteConfig GetRemoteConfig() { return TelemetryRemoteConfig(); }
+    static bool ParseRemoteConfig(Arg, TelemetryRemoteConfig&) { return false; }
+    void SetDuckDBVersion(Arg) {}
+    void SetDuckDBPlatform(Arg) {}
     std::string GetDuckDBVersion() { return ""; }
     std::string GetDuckDBPlatform() { return ""; }
 
@@ -540,12 +1847,22 @@ public:
     static std::string GetIdentitySource() { return ""; }
     static std::string GetMachineId() { return ""; }
     static std::string GetSessionId() { return ""; }
+    static void SetIdentityCachePath(TelemetryStubArg) {}
 
 private:
     PostHogTelemetry() = default;
     ~PostHogTelemetry() = default;
 };
 
+class ScopedExtensionLoad {
+public:
+    ScopedExtensionLoad(TelemetryStubArg, TelemetryStubArg = "0.1.0") {}
+    ScopedExtensionLoad(const ScopedExtensionLoad&) = delete;
+    ScopedExtensionLoad& operator=(const ScopedExtensionLoad&) = delete;
+    void Mark(TelemetryStubArg) {}
+    void Finish() {}
+};
+
 } // namespace duckdb
 
 #endif // POSTHOG_TELEMETRY_DISABLED
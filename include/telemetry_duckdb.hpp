@@ -0,0 +1,84 @@
+#pragma once
+
+// DuckDB-facing helpers for extensions that embed the telemetry library. The
+// declarations only need forward-declared DuckDB types; the implementations
+// (telemetry_duckdb*.cpp) are compiled against the host DuckDB headers.
+#include "telemetry.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace duckdb {
+
+class Appender;
+class Connection;
+class DuckDB;
+class ExtensionLoader;
+
+#if !defined(POSTHOG_TELEMETRY_DISABLED)
+
+// Register `telemetry_stats()` — a table function over PostHogTelemetry::
+// GetStats(), so users and support can inspect live telemetry with plain SQL:
+//
+//   SELECT * FROM telemetry_stats() WHERE kind = 'function' ORDER BY value DESC;
+//
+// Columns: kind ('pipeline' | 'function' | 'operator'), name (counter,
+// function name or operator type), value (counter value / call_count), p50_ms,
+// p95_ms, p99_ms (function and operator rows only, NULL otherwise). Reading it never drains or resets the aggregator.
+void RegisterTelemetryStatsFunction(ExtensionLoader &loader);
+
+// Local sink for on-prem analytics: writes every coalesced batch into a DuckDB
+// table instead of PostHog. Runs on the telemetry worker thread and appends
+// each batch through one Appender, kept open across batches and flushed at the
+// end of each. The envelope becomes typed columns
+// (timestamp, event, distinct_id, session_id, product, ..., is_ci,
+// telemetry_schema); every other property is kept in `properties` (JSON), so
+// HogQL-style `properties.x` becomes `properties->>'x'`.
+class DuckDBEventSink {
+public:
+    // Open (or create) a database file owned by the sink.
+    explicit DuckDBEventSink(const std::string &database_path,
+                             const std::string &table = "events");
+    // Write into an existing database; the sink's connection keeps it alive.
+    explicit DuckDBEventSink(DuckDB &database, const std::string &table = "events");
+    ~DuckDBEventSink();
+
+    DuckDBEventSink(const DuckDBEventSink &) = delete;
+    DuckDBEventSink &operator=(const DuckDBEventSink &) = delete;
+
+    // Append one batch. Best-effort like the HTTP transport: errors are
+    // swallowed and reported as false, never thrown into the worker.
+    bool Write(const std::vector<PostHogEvent> &events);
+
+private:
+    void CreateTable();
+
+    std::unique_ptr<DuckDB> _owned_db;   // only for the path constructor
+    std::unique_ptr<Connection> _con;
+    std::unique_ptr<Appender> _appender;   // opened by the first Write
+    std::string _table;
+    std::mutex _lock;
+};
+
+// Route all telemetry batches into `sink` (via PostHogTelemetry::SetTransport).
+void UseDuckDBEventSink(std::shared_ptr<DuckDBEventSink> sink);
+
+#else // POSTHOG_TELEMETRY_DISABLED
+
+inline void RegisterTelemetryStatsFunction(ExtensionLoader &) {}
+
+class DuckDBEventSink {
+public:
+    explicit DuckDBEventSink(const std::string &, const std::string & = "events") {}
+    explicit DuckDBEventSink(DuckDB &, const std::string & = "events") {}
+    template <typename Events>
+    bool Write(const Events &) { return false; }
+};
+
+inline void UseDuckDBEventSink(std::shared_ptr<DuckDBEventSink>) {}
+
+#endif // POSTHOG_TELEMETRY_DISABLED
+
+} // namespace duckdb
@@ -0,0 +1,92 @@
+#pragma once
+
+// Prometheus textfile exporter: telemetry performance for node_exporter's
+// textfile collector (or any scraper that reads a file), with no network
+// egress from the host process.
+#include "telemetry.hpp"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace duckdb {
+
+#if !defined(POSTHOG_TELEMETRY_DISABLED)
+
+// Rewrites one `.prom` file (OpenMetrics text) on every emitted aggregation
+// window and on the worker's periodic refresh (no functions, fresh counters),
+// atomically (write `<path>.tmp.*`, then rename), so a scrape never sees a torn
+// file. Families, with `<prefix>` defaulting to "telemetry":
+//
+//   <prefix>_function_calls_total{function}           counter
+//   <prefix>_function_duration_seconds{function,le}   histogram
+//   <prefix>_function_first_call_seconds{function}    gauge (cold call)
+//   <prefix>_dropped_events_total{reason}             counter
+//   <prefix>_sampled_out_calls_total                  counter
+//   <prefix>_queue_depth                              gauge
+//
+// Counters are cumulative over the sink's lifetime. A window's call_count is
+// scaled by 1/sample_rate, so the calls counter estimates every call made,
+// sampled-out ones included. The histogram spreads those calls over the
+// buckets in proportion to the window's duration reservoir, so sampled and
+// batched (RecordFunctionCalls) windows still add one observation per call.
+class PrometheusTextfileSink {
+public:
+    explicit PrometheusTextfileSink(const std::string &path,
+                                    const std::string &prefix = "telemetry");
+
+    PrometheusTextfileSink(const PrometheusTextfileSink &) = delete;
+    PrometheusTextfileSink &operator=(const PrometheusTextfileSink &) = delete;
+
+    // Fold one window in and rewrite the file. Best-effort like the other
+    // sinks: I/O errors are reported as false, never thrown.
+    bool Write(const std::vector<TelemetryWindowFunction> &functions,
+               const TelemetryStats &pipeline);
+
+    // The exposition as Write would store it (without folding anything in).
+    std::string Render();
+
+    // Upper bounds (seconds) of the duration histogram; +Inf is implied.
+    static const std::vector<double> &BucketBounds();
+
+private:
+    struct FunctionSeries {
+        uint64_t calls = 0;
+        std::vector<uint64_t> buckets;  // per bucket (not cumulative), +Inf last
+        uint64_t observations = 0;
+        double sum_seconds = 0;
+        double first_call_ms = -1;
+    };
+
+    std::string RenderLocked() const;
+
+    std::string _path;
+    std::string _prefix;
+    std::map<std::string, FunctionSeries> _functions;  // name order in the file
+    TelemetryStats _pipeline;                          // latest counters
+    std::mutex _lock;
+};
+
+// Export every aggregation window to `sink` (via PostHogTelemetry::
+// SetWindowSink) and discard event batches instead of posting them, so the
+// process makes no telemetry network calls at all.
+void UsePrometheusTextfileSink(std::shared_ptr<PrometheusTextfileSink> sink);
+
+#else // POSTHOG_TELEMETRY_DISABLED
+
+class PrometheusTextfileSink {
+public:
+    explicit PrometheusTextfileSink(const std::string &, const std::string & = "telemetry") {}
+    template <typename Functions, typename Stats>
+    bool Write(const Functions &, const Stats &) { return false; }
+    std::string Render() { return std::string(); }
+};
+
+inline void UsePrometheusTextfileSink(std::shared_ptr<PrometheusTextfileSink>) {}
+
+#endif // POSTHOG_TELEMETRY_DISABLED
+
+} // namespace duckdb
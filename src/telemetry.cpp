@@ -1,13 +1,18 @@
 #define NOMINMAX
 
 #include "telemetry.hpp"
+#include "telemetry_file.hpp"
+#include "telemetry_json.hpp"
+#include "telemetry_probes.hpp"
 
 #include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
+#include <exception>
 #include <fstream>
 #include <limits>
 #include <random>
@@ -21,6 +26,14 @@
 #include <dirent.h>
 #endif
 
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#endif
+
 #ifdef _WIN32
 #include <iomanip>
 #include <sstream>
@@ -147,6 +160,63 @@ static bool ComputeContainer()
 #endif
 }
 
+// The process's own cgroup v2 directory ("0::/path" in /proc/self/cgroup under
+// the unified mount), or "" outside cgroup v2.
+static std::string OwnCgroupDir()
+{
+#ifdef __linux__
+    std::ifstream f("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            std::string dir = "/sys/fs/cgroup" + line.substr(3);
+            while (dir.size() > 1 && dir.back() == '/') {
+                dir.pop_back();
+            }
+            return access((dir + "/cgroup.controllers").c_str(), F_OK) == 0 ? dir : "";
+        }
+    }
+#endif
+    return "";
+}
+
+// The tightest memory.max from `leaf` up to `top` (an ancestor's limit caps its
+// children too) and the leaf's memory.pressure "some avg10" (percent of wall
+// time with a task stalled on memory). False when no limit is set anywhere.
+static bool ReadCgroupMemory(std::string leaf, const std::string& top,
+                             uint64_t& limit_bytes, double& some_avg10)
+{
+    limit_bytes = 0;
+    some_avg10 = 0;
+    {
+        std::ifstream f(leaf + "/memory.pressure");
+        std::string line;
+        while (std::getline(f, line)) {
+            size_t at = line.find("avg10=");
+            if (line.compare(0, 5, "some ") == 0 && at != std::string::npos) {
+                some_avg10 = std::atof(line.c_str() + at + 6);
+            }
+        }
+    }
+    while (true) {
+        std::ifstream f(leaf + "/memory.max");
+        std::string value;
+        // "max" = unlimited at this level.
+        if (f >> value && !value.empty() && value[0] >= '0' && value[0] <= '9') {
+            uint64_t bytes = std::strtoull(value.c_str(), nullptr, 10);
+            if (bytes > 0 && (limit_bytes == 0 || bytes < limit_bytes)) {
+                limit_bytes = bytes;
+            }
+        }
+        size_t slash = leaf.find_last_of('/');
+        if (leaf == top || leaf.size() <= top.size() || slash == std::string::npos) {
+            break;
+        }
+        leaf.resize(slash);
+    }
+    return limit_bytes > 0;
+}
+
 static std::string GenerateSessionId()
 {
     std::random_device rd;
@@ -169,17 +239,36 @@ static std::string GenerateSessionId()
 // a table name, SQL text, or free-form message, only a bounded prefix escapes.
 static constexpr size_t kMaxPropertyValueLen = 512;
 
-static void ClampProperty(PropertyValue &v)
+// Default budget for one event's serialised properties (SetMaxEventBytes). The
+// per-value clamp alone doesn't bound an event: a caller can attach thousands
+// of properties, which would dominate chunk sizes and the buffer's memory.
+static constexpr size_t kMaxEventBytes = 64 * 1024;
+
+// Cardinality guard (SetCardinalityLimit): distinct values a string property
+// may carry per event before it is bucketed, the bucket, and a cap on the
+// (event, key) sketches tracked (256 bytes each); pairs past it go unguarded.
+static constexpr uint32_t kDefaultCardinalityLimit = 200;
+static constexpr const char* kCardinalityOther = "__other__";
+static constexpr size_t kMaxCardinalitySketches = 4096;
+
+static void ClampUtf8(std::string &s, size_t max_len)
 {
-    if (v.kind == PropertyValue::Kind::String && v.s.size() > kMaxPropertyValueLen) {
+    if (s.size() > max_len) {
         // Truncate to the largest UTF-8 char boundary <= the limit so we never
         // emit a half-character (which would be invalid JSON). If the byte at
         // the cut is a continuation byte (10xxxxxx), back up to the lead byte.
-        size_t n = kMaxPropertyValueLen;
-        while (n > 0 && (static_cast<unsigned char>(v.s[n]) & 0xC0) == 0x80) {
+        size_t n = max_len;
+        while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xC0) == 0x80) {
             n--;
         }
-        v.s.resize(n);
+        s.resize(n);
+    }
+}
+
+static void ClampProperty(PropertyValue &v)
+{
+    if (v.kind == PropertyValue::Kind::String) {
+        ClampUtf8(v.s, kMaxPropertyValueLen);
     }
 }
 
@@ -248,6 +337,38 @@ std::string PropertyValue::ToJson() const
     }
 }
 
+// Length of EscapeJsonString(in), without building it.
+static size_t JsonStringSize(const std::string& in)
+{
+    size_t n = 2;
+    for (unsigned char c : in) {
+        if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t') {
+            n += 2;
+        } else if (c < 0x20) {
+            n += 6;
+        } else {
+            n += 1;
+        }
+    }
+    return n;
+}
+
+// Upper bound on one `"key": value,` member of PropertyMapToJson (numbers at
+// their widest), so an event trimmed to the budget never exceeds it.
+static size_t PropertyJsonSize(const std::string& key, const PropertyValue& v)
+{
+    size_t n = JsonStringSize(key) + 3;
+    switch (v.kind) {
+        case PropertyValue::Kind::Bool:   return n + 5;
+        case PropertyValue::Kind::Int:
+        case PropertyValue::Kind::UInt:   return n + 20;
+        case PropertyValue::Kind::Double: return n + 24;
+        case PropertyValue::Kind::Json:   return n + v.s.size();
+        case PropertyValue::Kind::String:
+        default:                          return n + JsonStringSize(v.s);
+    }
+}
+
 // Serialise a PropertyMap as a JSON object. Shared by event serialization and
 // group-set construction.
 static std::string PropertyMapToJson(const PropertyMap &props)
@@ -303,10 +424,9 @@ static bool TelemetryDisabledByEnv()
                                  std::string(disable_telemetry) == "yes");
 }
 
-// POST events[begin, end) as one {api_key, batch:[…]} request. Best-effort.
-static void PostOneChunk(const std::string &api_key, const std::string &host,
-                         const std::vector<PostHogEvent> &events,
-                         size_t begin, size_t end)
+// Encode events[begin, end) as one {api_key, batch:[…]} request body.
+static std::string EncodeChunk(const std::string &api_key, const std::vector<PostHogEvent> &events,
+                               size_t begin, size_t end)
 {
     std::string batch;
     for (size_t i = begin; i < end; i++) {
@@ -325,7 +445,13 @@ static void PostOneChunk(const std::string &api_key, const std::string &host,
     }
     std::string payload = "{\"api_key\":" + EscapeJsonString(api_key) +
                           ",\"batch\":[" + batch + "]}";
+    TELEMETRY_PROBE2(chunk_encode, end - begin, payload.size());
+    return payload;
+}
 
+// POST one encoded request body. Best-effort.
+static void PostPayload(const std::string &host, const std::string &payload)
+{
     try {
         std::string h = host.empty() ? kDefaultHost : host;
         auto cli = duckdb_httplib_openssl::Client(h.c_str());
@@ -340,6 +466,8 @@ static void PostOneChunk(const std::string &api_key, const std::string &host,
         cli.set_read_timeout(3);
         cli.set_write_timeout(3);
         auto res = cli.Post("/batch/", payload, "application/json");
+        // status -1 = no HTTP response (connect/TLS/timeout failure).
+        TELEMETRY_PROBE2(post_complete, res ? res->status : -1, payload.size());
         (void)res;
         cli.stop();
     } catch (...) {
@@ -347,20 +475,83 @@ static void PostOneChunk(const std::string &api_key, const std::string &host,
     }
 }
 
+// PostHog's payload limit, in events per /batch/ request.
+static constexpr size_t kMaxEventsPerPost = 250;
+
+std::vector<std::string> PostHogEncodeBatch(const std::string &api_key,
+                                            const std::vector<PostHogEvent> &events,
+                                            const TelemetryParallelFor &parallel_for)
+{
+    size_t chunks = (events.size() + kMaxEventsPerPost - 1) / kMaxEventsPerPost;
+    std::vector<std::string> payloads(chunks);
+    auto encode = [&](size_t c) {
+        size_t begin = c * kMaxEventsPerPost;
+        size_t end = std::min(begin + kMaxEventsPerPost, events.size());
+        try {
+            payloads[c] = EncodeChunk(api_key, events, begin, end);
+        } catch (...) {
+            payloads[c].clear();   // e.g. bad_alloc: that chunk is skipped
+        }
+    };
+    if (parallel_for && chunks > 1) {
+        parallel_for(chunks, encode);
+    } else {
+        for (size_t c = 0; c < chunks; c++) {
+            encode(c);
+        }
+    }
+    return payloads;
+}
+
+TelemetryParallelFor TelemetryThreadParallelFor(size_t max_threads)
+{
+    if (max_threads <= 1) {
+        return {};
+    }
+    return [max_threads](size_t n, const std::function<void(size_t)> &fn) {
+        // Helpers pull indices from a shared counter; the caller works too, so
+        // max_threads counts it. The threads live only for this call: large
+        // drains are rare and a parked pool would cost every host a thread.
+        std::atomic<size_t> next{0};
+        auto work = [&] {
+            for (size_t i = next++; i < n; i = next++) {
+                fn(i);
+            }
+        };
+        std::vector<std::thread> helpers;
+        size_t extra = std::min(max_threads, n) - 1;
+        helpers.reserve(extra);
+        for (size_t t = 0; t < extra; t++) {
+            try {
+                helpers.emplace_back(work);
+            } catch (...) {
+                break;   // couldn't spawn: the caller finishes the rest alone
+            }
+        }
+        work();
+        for (auto &h : helpers) {
+            h.join();
+        }
+    };
+}
+
 // Coalesced transport: POST N events to host + "/batch/". Splits large batches
 // into bounded chunks so one request never exceeds PostHog's payload limit (a
 // backlog accumulated during a network outage would otherwise be rejected
-// wholesale). This is the only place that touches the network. Never throws.
+// wholesale); the chunks are encoded up front (concurrently through
+// `parallel_for`, if given) and posted in order. This is the only place that
+// touches the network. Never throws.
 void PostHogProcessBatch(const std::string &api_key, const std::string &host,
-                         const std::vector<PostHogEvent> &events)
+                         const std::vector<PostHogEvent> &events,
+                         const TelemetryParallelFor &parallel_for)
 {
     if (TelemetryDisabledByEnv() || events.empty()) {
         return;
     }
-    static constexpr size_t kMaxEventsPerPost = 250;
-    for (size_t i = 0; i < events.size(); i += kMaxEventsPerPost) {
-        size_t end = std::min(i + kMaxEventsPerPost, events.size());
-        PostOneChunk(api_key, host, events, i, end);
+    for (auto &payload : PostHogEncodeBatch(api_key, events, parallel_for)) {
+        if (!payload.empty()) {
+            PostPayload(host, payload);
+        }
     }
 }
 
@@ -372,12 +563,88 @@ void PostHogProcess(const std::string api_key, const PostHogEvent &event)
 
 // PostHogTelemetry Implementation --------------------------------------------------------
 
+// Upper bound on the in-memory buffer so a stalled worker (network outage) can't
+// grow it without limit and OOM the host. Excess events are dropped (best-effort
+// telemetry) rather than crashing the program. A cgroup memory limit lowers it
+// (RefreshMemoryBudget).
+static constexpr size_t kMaxPendingEvents = 10000;
+// Defensive cap on how many distinct function names we track, so a caller that
+// (against the cardinality contract) passes unbounded/generated names can't grow
+// the aggregator maps without limit in a long-running process. Also lowered by
+// a cgroup memory limit.
+static constexpr size_t kMaxTrackedFunctions = 10000;
+// Duration reservoir per function window (RecordFunctionCall(s), folds).
+static constexpr size_t kMaxDurationSamples = 256;
+// Distinct operator types tracked per process. DuckDB has a few dozen physical
+// operator types; the headroom absorbs new versions, the cap a hostile file.
+static constexpr size_t kMaxOperatorTypes = 128;
+static constexpr size_t kMaxOperatorSamples = 256;
+
+// CPU governor levels (GovernorTick). Each level doubles the sampling stride
+// and lengthens the send linger; from kGovernorShedLevel the per-call prompt
+// events are shed (the calls still aggregate), and at the top level query
+// profiles are ignored.
+static constexpr int kGovernorMaxLevel = 3;
+static constexpr int kGovernorShedLevel = 2;
+
+namespace {
+
+// Times 1 in kEvery capture-path calls per thread and charges the elapsed time
+// times kEvery to `sink`, so the governor sees the capture cost the host pays
+// without two clock reads on every call.
+class CaptureCostProbe {
+public:
+    explicit CaptureCostProbe(std::atomic<uint64_t>& sink) {
+        static thread_local uint32_t calls = 0;
+        if ((++calls & (kEvery - 1)) == 0) {
+            _sink = &sink;
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+    ~CaptureCostProbe() {
+        if (_sink) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - _start).count();
+            _sink->fetch_add(static_cast<uint64_t>(ns) * kEvery, std::memory_order_relaxed);
+        }
+    }
+    CaptureCostProbe(const CaptureCostProbe&) = delete;
+    CaptureCostProbe& operator=(const CaptureCostProbe&) = delete;
+
+private:
+    static constexpr uint32_t kEvery = 64;   // power of two
+    std::atomic<uint64_t>* _sink = nullptr;
+    std::chrono::steady_clock::time_point _start;
+};
+
+} // namespace
+
 PostHogTelemetry::PostHogTelemetry()
     : _telemetry_enabled(true),
       _shutdown_requested(false),
       _api_key("phc_t3wwRLtpyEmLHYaZCSszG0MqVr74J6wnCrj9D41zk2t"),
-      _queue(nullptr)
-{  }
+      _queue(nullptr),
+      _max_pending_events(kMaxPendingEvents),
+      _max_tracked_functions(kMaxTrackedFunctions),
+      _max_event_bytes(kMaxEventBytes),
+      _cardinality_limit(kDefaultCardinalityLimit)
+{
+    // Backlog encoding: a few helpers at most; a telemetry drain must never
+    // compete with the host for every core.
+    static constexpr size_t kDefaultEncodeThreads = 4;
+    size_t hw = std::thread::hardware_concurrency();
+    _encode_parallel_for = TelemetryThreadParallelFor(std::min(kDefaultEncodeThreads, hw ? hw : 1));
+
+    // Read the environment opt-out once, here: the capture path must not call
+    // getenv per event (cost, and a data race against a concurrent setenv in
+    // the host). RecheckEnvironmentOptOut() re-reads it on request.
+    _env_opted_out = TelemetryDisabledByEnv();
+    UpdateCaptureGateLocked();
+    if (!_env_opted_out) {
+        _cgroup_dir = OwnCgroupDir();
+        RefreshMemoryBudget();
+    }
+}
 
 PostHogTelemetry::~PostHogTelemetry()
 {
@@ -391,8 +658,11 @@ void PostHogTelemetry::Shutdown()
         std::lock_guard<std::mutex> t(_thread_lock);
         _shutdown_requested = true;
         _telemetry_enabled = false;
+        UpdateCaptureGateLocked();
         queue = std::move(_queue);
+        _remote_timer = 0;
     }
+    StopShapeTrace();
     if (queue) {
         queue->Stop();  // discards pending tasks + joins the worker
     }
@@ -404,18 +674,40 @@ void PostHogTelemetry::Shutdown()
     }
     {
         std::lock_guard<std::mutex> a(_agg_lock);
-        _function_stats.clear();
-        _recorded_since_flush = 0;
+        ResetFunctionWindowsLocked();
     }
 }
 
 // True only when telemetry may do work. Cheap gate used before any enrichment,
 // grouping, aggregate drain, or send so nothing runs during atexit teardown or
-// after a runtime opt-out.
+// after a runtime / environment opt-out.
 bool PostHogTelemetry::CanAcceptTelemetry()
+{
+    return _capture_open.load(std::memory_order_relaxed);
+}
+
+// Must be called under _thread_lock (or from the constructor). Folds every
+// reason not to capture into the one flag the hot paths load.
+void PostHogTelemetry::UpdateCaptureGateLocked()
+{
+    bool open = _telemetry_enabled && !_shutdown_requested && !_env_opted_out;
+    _capture_open.store(open, std::memory_order_relaxed);
+    _capture_categories.store(open ? _category_mask : 0, std::memory_order_relaxed);
+}
+
+bool PostHogTelemetry::RecheckEnvironmentOptOut()
+{
+    bool opted_out = TelemetryDisabledByEnv();
+    std::lock_guard<std::mutex> t(_thread_lock);
+    _env_opted_out = opted_out;
+    UpdateCaptureGateLocked();
+    return opted_out;
+}
+
+bool PostHogTelemetry::IsOptedOutByEnvironment()
 {
     std::lock_guard<std::mutex> t(_thread_lock);
-    return !_shutdown_requested && _telemetry_enabled;
+    return _env_opted_out;
 }
 
 PostHogTelemetry& PostHogTelemetry::Instance()
@@ -431,6 +723,10 @@ PostHogTelemetry& PostHogTelemetry::Instance()
         { duckdb_httplib_openssl::Client warmup(kDefaultHost); }
         auto *telemetry = new PostHogTelemetry();
         std::atexit(&PostHogTelemetry::ShutdownAtExit);
+#ifndef _WIN32
+        pthread_atfork(&PostHogTelemetry::AtForkPrepare, &PostHogTelemetry::AtForkParent,
+                       &PostHogTelemetry::AtForkChild);
+#endif
         return telemetry;
     }();
     return *instance;
@@ -441,6 +737,95 @@ void PostHogTelemetry::ShutdownAtExit()
     Instance().Shutdown();
 }
 
+// fork() from a multi-threaded host (prefork servers, multiprocessing) copies
+// only the calling thread: any lock another thread held stays locked in the
+// child forever, and the worker thread is simply gone. Prepare quiesces the
+// worker (bounded: a slow POST is not worth stalling the host's fork) and then
+// takes every lock in the established order, so the child starts from
+// consistent state; Parent releases them; Child resets what must be
+// per-process and lets the next send start a worker of its own.
+static constexpr int kForkQuiesceMs = 250;
+
+void PostHogTelemetry::AtForkPrepare()
+{
+    PostHogTelemetry& t = Instance();
+    {
+        std::lock_guard<std::mutex> lock(t._thread_lock);
+        t._fork_paused_queue = t._queue;
+    }
+    // Outside _thread_lock: the in-flight task may need it to finish.
+    if (t._fork_paused_queue) {
+        t._fork_paused_queue->PauseForFork(kForkQuiesceMs);
+    }
+    t._thread_lock.lock();
+    t._batch_lock.lock();
+    if (t._queue) {
+        t._queue->LockForFork();
+    }
+    t._agg_lock.lock();
+    t._rate_lock.lock();
+    t._trace_lock.lock();
+    if (t._trace_file) {
+        std::fflush(t._trace_file);   // or the child's exit writes it again
+    }
+    t._cardinality_lock.lock();
+}
+
+void PostHogTelemetry::AtForkParent()
+{
+    PostHogTelemetry& t = Instance();
+    t._cardinality_lock.unlock();
+    t._trace_lock.unlock();
+    t._rate_lock.unlock();
+    t._agg_lock.unlock();
+    if (t._queue) {
+        t._queue->UnlockAfterFork();
+    }
+    t._batch_lock.unlock();
+    t._thread_lock.unlock();
+    if (t._fork_paused_queue) {
+        t._fork_paused_queue->Resume();
+        t._fork_paused_queue.reset();
+    }
+}
+
+void PostHogTelemetry::AtForkChild()
+{
+    PostHogTelemetry& t = Instance();
+    // The child has no worker thread, so its queues can never be stopped or
+    // destroyed (Stop() would join a thread that doesn't exist). Leak them.
+    for (auto* queue : {&t._queue, &t._fork_paused_queue}) {
+        if (*queue) {
+            new std::shared_ptr<TelemetryTaskQueue<int>>(std::move(*queue));
+        }
+    }
+    // Events and windows buffered before the fork belong to the parent, which
+    // still sends them; keeping them here would report them once per child.
+    t._pending.clear();
+    t._flush_scheduled = false;
+    t.ResetFunctionWindowsLocked();
+    // The child is a new session: each function's next call is its cold call
+    // again, with a fresh prompt phase and sampling stride.
+    for (size_t idx = 0; idx < t._functions.size(); idx++) {
+        FunctionRecord& rec = t._functions.ValueAt(idx);
+        rec.seen = 0;
+        rec.prompt_recorded = 0;
+        rec.first_call_ms = -1;
+    }
+    t._rate_buckets.clear();
+    t._remote_timer = 0;   // lived on the abandoned queue; re-armed lazily
+    SessionIdSlot() = GenerateSessionId();
+    // The trace file is the parent's; the child's stream stays open but idle.
+    t._shape_trace_on.store(false, std::memory_order_relaxed);
+    t._trace_file = nullptr;
+    t._cardinality_lock.unlock();
+    t._trace_lock.unlock();
+    t._rate_lock.unlock();
+    t._agg_lock.unlock();
+    t._batch_lock.unlock();
+    t._thread_lock.unlock();
+}
+
 void PostHogTelemetry::Cleanup()
 {
     // Same teardown as the atexit path: stop+join the worker and drop buffered
@@ -454,39 +839,243 @@ void PostHogTelemetry::ResetShutdownForTesting()
     std::lock_guard<std::mutex> t(_thread_lock);
     _shutdown_requested = false;
     _telemetry_enabled = true;
+    UpdateCaptureGateLocked();
     // _queue was moved out by Shutdown(); the next capture lazily recreates it.
 }
 
+// How often the worker re-reads the cgroup memory limit and pressure.
+static constexpr int kMemoryBudgetRefreshSeconds = 30;
+// How often the CPU governor measures and steps.
+static constexpr int kGovernorIntervalSeconds = 5;
+// Length of a change-triggered emission window (SetChangeTriggeredEmission).
+static constexpr int kChangeWindowSeconds = 60;
+// How often a window sink is refreshed without a window (a common scrape interval).
+static constexpr int kWindowSinkRefreshSeconds = 15;
+
 // Must be called under _thread_lock. Starts the background worker queue lazily.
+// A queue recreated after Shutdown or in a forked child picks the remote-config
+// refresh back up.
 void PostHogTelemetry::EnsureQueueInitialized()
 {
     if (!_queue) {
         _queue = std::make_shared<TelemetryTaskQueue<int>>();
+        ArmRemoteRefreshLocked();
+        _queue->ScheduleEvery([this](int) { RefreshMemoryBudget(); }, 0,
+                              std::chrono::seconds(kMemoryBudgetRefreshSeconds));
+        _queue->ScheduleEvery([this](int) { GovernorTick(); }, 0,
+                              std::chrono::seconds(kGovernorIntervalSeconds));
+        _queue->ScheduleEvery([this](int) { CloseChangeWindow(); }, 0,
+                              std::chrono::seconds(kChangeWindowSeconds));
+        _queue->ScheduleEvery([this](int) { RefreshWindowSink(); }, 0,
+                              std::chrono::seconds(kWindowSinkRefreshSeconds));
     }
 }
 
-// Upper bound on the in-memory buffer so a stalled worker (network outage) can't
-// grow it without limit and OOM the host. Excess events are dropped (best-effort
-// telemetry) rather than crashing the program.
-static constexpr size_t kMaxPendingEvents = 10000;
+// Must be called under _thread_lock with _queue set. No-op when not fetching or
+// already armed.
+void PostHogTelemetry::ArmRemoteRefreshLocked()
+{
+    if (_remote_config_url.empty() || _remote_timer != 0) {
+        return;
+    }
+    // An opt-out or disable since arming makes the ticks no-ops.
+    auto tick = [this](int) {
+        if (CanAcceptTelemetry()) {
+            FetchRemoteConfigNow();
+        }
+    };
+    _remote_timer = _queue->ScheduleEvery(tick, 0, std::chrono::seconds(_remote_refresh_s));
+}
 
 void PostHogTelemetry::BufferEvent(const PostHogEvent &enriched)
 {
     {
         std::lock_guard<std::mutex> t(_thread_lock);
-        if (_shutdown_requested || !_telemetry_enabled) {
+        if (!_capture_open.load(std::memory_order_relaxed)) {
             return;
         }
         EnsureQueueInitialized();
     }
     std::lock_guard<std::mutex> b(_batch_lock);
-    if (_pending.size() >= kMaxPendingEvents) {
+    if (_pending.size() >= _max_pending_events.load(std::memory_order_relaxed)) {
+        TELEMETRY_PROBE2(buffer_drop, enriched.event_name.c_str(), _pending.size());
+        _dropped_buffer_full.fetch_add(1, std::memory_order_relaxed);
         return;  // backpressure: drop rather than risk OOM in the host
     }
     _pending.push_back(enriched);
+    TELEMETRY_PROBE2(buffer_accept, enriched.event_name.c_str(), _pending.size());
+}
+
+// Telemetry's share of a cgroup memory limit, split evenly between the event
+// buffer and the aggregator. Per-item costs are rough upper bounds for an
+// enriched event and a function record with a full duration reservoir.
+static constexpr uint64_t kMemoryBudgetDivisor = 512;
+static constexpr uint64_t kBytesPerPendingEvent = 2048;
+static constexpr uint64_t kBytesPerTrackedFunction = 4096;
+static constexpr size_t kMinPendingEvents = 64;
+static constexpr size_t kMinTrackedFunctions = 64;
+// PSI "some avg10" (percent) at which the budgets halve / quarter.
+static constexpr double kMemoryPressureHigh = 10.0;
+static constexpr double kMemoryPressureSevere = 40.0;
+
+void PostHogTelemetry::RefreshMemoryBudget()
+{
+    std::string dir, top;
+    {
+        std::lock_guard<std::mutex> t(_thread_lock);
+        dir = _cgroup_dir;
+        top = _cgroup_dir_is_override ? dir : "/sys/fs/cgroup";
+    }
+    uint64_t limit = 0;
+    double pressure = 0;
+    size_t pending_cap = kMaxPendingEvents;
+    size_t function_cap = kMaxTrackedFunctions;
+    if (!dir.empty() && ReadCgroupMemory(dir, top, limit, pressure)) {
+        uint64_t share = limit / kMemoryBudgetDivisor / 2;
+        pending_cap = static_cast<size_t>(std::min<uint64_t>(share / kBytesPerPendingEvent, pending_cap));
+        function_cap = static_cast<size_t>(std::min<uint64_t>(share / kBytesPerTrackedFunction, function_cap));
+    }
+    if (pressure >= kMemoryPressureHigh) {
+        size_t shift = pressure >= kMemoryPressureSevere ? 2 : 1;
+        pending_cap >>= shift;
+        function_cap >>= shift;
+    }
+    pending_cap = std::max(pending_cap, kMinPendingEvents);
+    function_cap = std::max(function_cap, kMinTrackedFunctions);
+
+    {
+        std::lock_guard<std::mutex> t(_thread_lock);
+        _memory_limit_bytes = limit;
+        _memory_pressure_avg10 = pressure;
+        if (pending_cap < _max_pending_events.load(std::memory_order_relaxed) ||
+            function_cap < _max_tracked_functions.load(std::memory_order_relaxed)) {
+            _budget_shrinks.fetch_add(1, std::memory_order_relaxed);
+        }
+        _max_pending_events.store(pending_cap, std::memory_order_relaxed);
+        _max_tracked_functions.store(function_cap, std::memory_order_relaxed);
+    }
+    // Give the memory back now rather than at the next drain. Functions already
+    // tracked stay (the table never erases); the cap stops further growth.
+    std::lock_guard<std::mutex> b(_batch_lock);
+    if (_pending.size() > pending_cap) {
+        _dropped_buffer_full.fetch_add(_pending.size() - pending_cap, std::memory_order_relaxed);
+        _pending.resize(pending_cap);
+        _pending.shrink_to_fit();
+    }
+}
+
+// CPU time of the calling thread (the worker, when the governor ticks).
+static uint64_t ThreadCpuNs()
+{
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) {
+        return 0;
+    }
+    auto ticks = [](const FILETIME& ft) {
+        return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    };
+    return (ticks(kernel) + ticks(user)) * 100;   // 100 ns units
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+// Send linger per governor level, on top of any remote flush_interval_ms.
+static constexpr uint32_t kGovernorLingerMs[kGovernorMaxLevel + 1] = {0, 2000, 10000, 30000};
+
+uint32_t PostHogTelemetry::SendLingerMs()
+{
+    auto config = std::atomic_load(&_remote_config);
+    uint32_t linger = config ? config->flush_interval_ms : 0;
+    return std::max(linger, kGovernorLingerMs[_governor_level.load(std::memory_order_relaxed)]);
+}
+
+void PostHogTelemetry::SetCpuBudget(double fraction)
+{
+    if (!std::isfinite(fraction) || fraction < 0.0) {
+        fraction = 0.0;
+    }
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    _cpu_budget = fraction;
+    if (fraction == 0.0) {
+        _governor_level.store(0, std::memory_order_relaxed);
+        ApplySamplingLocked();
+    }
+}
+
+void PostHogTelemetry::SetCpuClockForTesting(std::function<uint64_t()> thread_cpu_ns)
+{
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    _cpu_clock = std::move(thread_cpu_ns);
+    _governor_last_tick = {};   // re-baseline on the next tick
+}
+
+// Worker timer: telemetry's CPU over the last interval is the worker thread's
+// CPU clock delta plus the encode helpers' CPU plus the extrapolated
+// capture-path cost, as a share of one core's wall time. Over budget raises the level one step; under half the
+// budget lowers it one step, so it settles instead of oscillating.
+void PostHogTelemetry::GovernorTick()
+{
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    uint64_t cpu = _cpu_clock ? _cpu_clock() : ThreadCpuNs();
+    uint64_t capture = _capture_cost_ns.load(std::memory_order_relaxed);
+    uint64_t helpers = _encode_helper_cpu_ns.load(std::memory_order_relaxed);
+    auto now = Now();
+    bool primed = _governor_last_tick != std::chrono::steady_clock::time_point{};
+    auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(now - _governor_last_tick);
+    if (primed && wall.count() <= 0) {
+        return;   // no time has passed (a frozen test clock)
+    }
+    // A new worker thread (after Shutdown or fork) restarts its CPU clock.
+    uint64_t cpu_delta = primed && cpu >= _governor_last_cpu_ns ? cpu - _governor_last_cpu_ns : 0;
+    uint64_t capture_delta = primed ? capture - _governor_last_capture_ns : 0;
+    uint64_t helper_delta = primed ? helpers - _governor_last_helper_ns : 0;
+    _governor_last_cpu_ns = cpu;
+    _governor_last_capture_ns = capture;
+    _governor_last_helper_ns = helpers;
+    _governor_last_tick = now;
+    if (!primed) {
+        return;
+    }
+    double usage = static_cast<double>(cpu_delta + helper_delta + capture_delta) /
+                   static_cast<double>(wall.count());
+    _cpu_usage_ppm.store(static_cast<uint64_t>(usage * 1e6), std::memory_order_relaxed);
+
+    int level = _governor_level.load(std::memory_order_relaxed);
+    if (_cpu_budget <= 0.0) {
+        level = 0;
+    } else if (usage > _cpu_budget) {
+        level = std::min(level + 1, kGovernorMaxLevel);
+    } else if (usage < _cpu_budget / 2) {
+        level = std::max(level - 1, 0);
+    }
+    if (level != _governor_level.load(std::memory_order_relaxed)) {
+        _governor_level.store(level, std::memory_order_relaxed);
+        ApplySamplingLocked();
+    }
+}
+
+void PostHogTelemetry::GovernorTickForTesting()
+{
+    GovernorTick();
+}
+
+void PostHogTelemetry::SetCgroupDirForTesting(const std::string& dir)
+{
+    {
+        std::lock_guard<std::mutex> t(_thread_lock);
+        _cgroup_dir = dir.empty() ? OwnCgroupDir() : dir;
+        _cgroup_dir_is_override = !dir.empty();
+    }
+    RefreshMemoryBudget();
 }
 
-void PostHogTelemetry::EnqueueTelemetryEvent(const PostHogEvent &event)
+void PostHogTelemetry::EnqueueTelemetryEvent(PostHogEvent event, bool guard_cardinality)
 {
     // Piggyback: drain any pending function aggregates into the same batch so
     // they ride along with promptly-sent regular events. This ships function
@@ -499,6 +1088,17 @@ void PostHogTelemetry::EnqueueTelemetryEvent(const PostHogEvent &event)
 
     // Merge the common envelope in exactly one place (EnrichEvent/BuildEnvelope
     // acquire _thread_lock themselves), buffer it, then schedule a prompt send.
+    if (!AdmitEvent(event.event_name)) {
+        return;
+    }
+    // After admission: remotely disabled or rate-limited events must not
+    // feed the sketches (or take their lock).
+    if (guard_cardinality) {
+        GuardCardinality(event.event_name, event.properties);
+    }
+    if (event.event_name == "$exception") {
+        AddExceptionProperties(event.properties);
+    }
     BufferEvent(EnrichEvent(event));
 
     if (_auto_flush.load()) {
@@ -519,13 +1119,22 @@ void PostHogTelemetry::ScheduleSend()
         _flush_scheduled = true;
     }
     std::lock_guard<std::mutex> t(_thread_lock);
-    if (_shutdown_requested || !_telemetry_enabled) {
+    if (!_capture_open.load(std::memory_order_relaxed)) {
         std::lock_guard<std::mutex> b(_batch_lock);
         _flush_scheduled = false;   // won't run; let a later attempt reschedule
         return;
     }
     EnsureQueueInitialized();
-    _queue->EnqueueTask([this](int) { DrainAndSend(); }, 0);
+    // A remote flush_interval_ms (or the CPU governor) trades latency for
+    // fewer, larger batches: the drain is deferred and everything captured
+    // meanwhile rides along.
+    uint32_t linger_ms = SendLingerMs();
+    if (linger_ms > 0) {
+        auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(linger_ms);
+        _queue->ScheduleAt([this](int) { DrainAndSend(); }, 0, due);
+    } else {
+        _queue->EnqueueTask([this](int) { DrainAndSend(); }, 0);
+    }
 }
 
 // Worker task body: swap the buffer and POST it as one /batch/ request. `this`
@@ -542,24 +1151,49 @@ void PostHogTelemetry::DrainAndSend()
         }
         batch.swap(_pending);
     }
+    TELEMETRY_PROBE1(drain_start, batch.size());
 
     std::string api_key, host;
-    std::function<void(const std::string&, const std::string&,
-                       const std::vector<PostHogEvent>&)> transport;
+    TelemetryTransport transport;
+    TelemetryParallelFor parallel_for;
     {
         std::lock_guard<std::mutex> t(_thread_lock);
-        if (_shutdown_requested || !_telemetry_enabled) {
+        if (!_capture_open.load(std::memory_order_relaxed)) {
+            TELEMETRY_PROBE1(drain_end, 0);
             return;  // opted out / tearing down: discard the swapped batch
         }
-        api_key   = _api_key;
-        host      = _host.empty() ? kDefaultHost : _host;
-        transport = _transport;
+        api_key      = _api_key;
+        host         = _host.empty() ? kDefaultHost : _host;
+        transport    = _transport;
+        parallel_for = _encode_parallel_for;
     }
     if (transport) {
         transport(api_key, host, batch);
     } else {
-        PostHogProcessBatch(api_key, host, batch);
+        if (parallel_for) {
+            // The governor reads the worker's CPU clock; chunks encoded on any
+            // other thread (our helpers or the host's executor) are charged
+            // here so a large drain can't hide its cost from the budget.
+            std::thread::id worker = std::this_thread::get_id();
+            parallel_for = [this, worker, inner = std::move(parallel_for)](
+                               size_t n, const std::function<void(size_t)> &fn) {
+                inner(n, [&](size_t i) {
+                    if (std::this_thread::get_id() == worker) {
+                        fn(i);
+                        return;
+                    }
+                    uint64_t start = ThreadCpuNs();
+                    fn(i);
+                    uint64_t end = ThreadCpuNs();
+                    if (end > start) {
+                        _encode_helper_cpu_ns.fetch_add(end - start, std::memory_order_relaxed);
+                    }
+                });
+            };
+        }
+        PostHogProcessBatch(api_key, host, batch, parallel_for);
     }
+    TELEMETRY_PROBE1(drain_end, batch.size());
 }
 
 // CI status can't change within a process run, so compute it once and cache it.
@@ -601,12 +1235,18 @@ const std::string& PostHogTelemetry::DetectArch()
     return arch;
 }
 
-std::string PostHogTelemetry::GetSessionId()
+// Per process: a forked child replaces it (AtForkChild), single-threaded.
+std::string& PostHogTelemetry::SessionIdSlot()
 {
     static std::string id = GenerateSessionId();
     return id;
 }
 
+std::string PostHogTelemetry::GetSessionId()
+{
+    return SessionIdSlot();
+}
+
 void PostHogTelemetry::SetProduct(const std::string& name,
                                   const std::string& version,
                                   const std::string& edition)
@@ -685,9 +1325,52 @@ PostHogEvent PostHogTelemetry::EnrichEvent(const PostHogEvent &event) const
     for (auto &kv : enriched.properties) {
         ClampProperty(kv.second);
     }
+    ApplyEventBudget(enriched.properties, env);
     return enriched;
 }
 
+void PostHogTelemetry::ApplyEventBudget(PropertyMap& props, const PropertyMap& env) const
+{
+    const size_t budget = _max_event_bytes.load(std::memory_order_relaxed);
+    size_t total = 2;   // {}
+    for (auto& kv : props) {
+        total += PropertyJsonSize(kv.first, kv.second);
+    }
+    if (total <= budget) {
+        return;
+    }
+    // Envelope keys first (their analysis depends on them), then the caller's
+    // properties smallest first, so one oversized value can't evict many small
+    // ones. Room is kept for the marker itself.
+    std::vector<std::pair<size_t, PropertyMap::iterator>> caller;
+    caller.reserve(props.size());
+    size_t used = 2 + PropertyJsonSize("properties_truncated", PropertyValue(props.size()));
+    for (auto it = props.begin(); it != props.end(); ++it) {
+        size_t size = PropertyJsonSize(it->first, it->second);
+        if (env.count(it->first)) {
+            used += size;
+        } else {
+            caller.emplace_back(size, it);
+        }
+    }
+    std::stable_sort(caller.begin(), caller.end(),
+                     [](const std::pair<size_t, PropertyMap::iterator>& a,
+                        const std::pair<size_t, PropertyMap::iterator>& b) { return a.first < b.first; });
+    size_t dropped = 0;
+    for (auto& c : caller) {
+        if (used + c.first <= budget) {
+            used += c.first;
+        } else {
+            props.erase(c.second);
+            dropped++;
+        }
+    }
+    if (dropped > 0) {
+        props["properties_truncated"] = static_cast<int64_t>(dropped);
+        _truncated_events.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
 PostHogEvent PostHogTelemetry::BuildEventForTesting(const std::string& event_name,
                                                     PropertyMap props)
 {
@@ -697,28 +1380,64 @@ PostHogEvent PostHogTelemetry::BuildEventForTesting(const std::string& event_nam
 
 void PostHogTelemetry::Capture(const std::string& event, PropertyMap props)
 {
-    // The single choke point for the runtime enabled flag; all the convenience
-    // wrappers route through here. The DATAZOO_DISABLE_TELEMETRY opt-out is
-    // enforced at the transport (PostHogProcessBatch) so it is a hard
-    // "nothing leaves the machine" guarantee regardless of this path.
-    if (!_telemetry_enabled) {
+    CaptureEvent(event, std::move(props), true);
+}
+
+void PostHogTelemetry::CaptureEvent(const std::string& event, PropertyMap props, bool guard_cardinality)
+{
+    // The single choke point for the capture gate (runtime enabled flag, the
+    // DATAZOO_DISABLE_TELEMETRY opt-out read at init, shutdown); all the
+    // convenience wrappers route through here. An opted-out process pays this
+    // one relaxed load and never starts the worker. The transport
+    // (PostHogProcessBatch) re-checks the environment as the hard "nothing
+    // leaves the machine" guarantee regardless of this path.
+    TELEMETRY_PROBE1(capture_entry, event.c_str());
+    uint32_t categories = _capture_categories.load(std::memory_order_relaxed);
+    if (categories == 0) {
         return;
     }
+    if (categories != kTelemetryAllCategories && (categories & CategoryOf(event)) == 0) {
+        return;   // name lookup only while some category is masked off
+    }
+    CaptureCostProbe cost(_capture_cost_ns);
+    if (_shape_trace_on.load(std::memory_order_relaxed)) {
+        TraceEvent(event, props);
+    }
     PostHogEvent ev = { event, GetDistinctId(), std::move(props), "" };
-    EnqueueTelemetryEvent(ev);
+    EnqueueTelemetryEvent(std::move(ev), guard_cardinality);
 }
 
 void PostHogTelemetry::CaptureFeature(const std::string& feature, PropertyMap props)
 {
+    if (!CaptureOpen(kTelemetryFeature)) {
+        return;   // before the map insert: opted-out calls stay a single load
+    }
     props["feature"] = feature;
     Capture("feature_used", std::move(props));
 }
 
 void PostHogTelemetry::CaptureError(const std::string& error_class, PropertyMap props)
 {
+    if (!CaptureOpen(kTelemetryError)) {
+        return;   // before the map insert, as in CaptureFeature
+    }
     // error_class must be an enumerated class, never a free-form message; the
-    // length clamp is a backstop but callers are responsible for the contract.
+    // length clamp and the cardinality guard are backstops but callers are
+    // responsible for the contract. The $exception_* properties are derived
+    // from it after the guard (AddExceptionProperties).
     props["error_class"] = error_class;
+    Capture("$exception", std::move(props));
+}
+
+// Runs after GuardCardinality, so a bucketed error_class can't leak through
+// the properties derived from it ($-prefixed keys skip the guard).
+void PostHogTelemetry::AddExceptionProperties(PropertyMap& props)
+{
+    auto it = props.find("error_class");
+    if (it == props.end() || it->second.kind != PropertyValue::Kind::String) {
+        return;
+    }
+    const std::string& error_class = it->second.s;
 
     // PostHog's error-tracking ingestion requires $exception_list on every
     // $exception event; without it the pipeline rejects the event (stamping
@@ -740,8 +1459,6 @@ void PostHogTelemetry::CaptureError(const std::string& error_class, PropertyMap
     if (!product.empty()) {
         props.emplace("$exception_fingerprint", product + "/" + error_class);
     }
-
-    Capture("$exception", std::move(props));
 }
 
 void PostHogTelemetry::AssociateGroup(const std::string& type,
@@ -763,7 +1480,7 @@ void PostHogTelemetry::AssociateGroup(const std::string& type,
     // Only mark the group identified when we can actually emit the
     // $groupidentify; otherwise a disabled-at-associate-time group would be
     // permanently suppressed and never re-identified once telemetry is enabled.
-    if (!_telemetry_enabled) {
+    if (!CaptureOpen(kTelemetryGroup)) {
         return;
     }
 
@@ -794,6 +1511,13 @@ void PostHogTelemetry::AssociateGroup(const std::string& type,
 
 void PostHogTelemetry::CaptureExtensionLoad(const std::string& extension_name,
                                             const std::string& extension_version)
+{
+    CaptureExtensionLoad(extension_name, extension_version, PropertyMap());
+}
+
+void PostHogTelemetry::CaptureExtensionLoad(const std::string& extension_name,
+                                            const std::string& extension_version,
+                                            PropertyMap timing)
 {
     // Store extension name as default for CaptureFunctionExecution
     SetExtensionName(extension_name);
@@ -807,8 +1531,11 @@ void PostHogTelemetry::CaptureExtensionLoad(const std::string& extension_name,
     // Attribute this install to a `deployment` group (machine hash) so
     // deployment-level analytics work out of the box, no call-site edits.
     AssociateGroup("deployment", GetDistinctId());
+    if (!CaptureOpen(kTelemetryLifecycle)) {
+        return;
+    }
 
-    PropertyMap props;
+    PropertyMap props = std::move(timing);
     props["extension_name"]     = extension_name;
     props["extension_version"]  = extension_version;
     props["extension_platform"] = GetDuckDBPlatform();
@@ -817,9 +1544,79 @@ void PostHogTelemetry::CaptureExtensionLoad(const std::string& extension_name,
     Capture("extension_load", props);     // legacy dual-emit for one release
 }
 
+ScopedExtensionLoad::ScopedExtensionLoad(std::string extension_name, std::string extension_version)
+    : _extension_name(std::move(extension_name)),
+      _extension_version(std::move(extension_version)),
+      _start(PostHogTelemetry::Instance().ClockNow()),
+      _last(_start),
+      _uncaught_at_start(std::uncaught_exceptions())
+{
+}
+
+ScopedExtensionLoad::~ScopedExtensionLoad()
+{
+    if (std::uncaught_exceptions() > _uncaught_at_start) {
+        return;
+    }
+    Finish();
+}
+
+void ScopedExtensionLoad::Mark(const std::string& phase)
+{
+    // Enumerated by the caller, so a handful of phases; the cap only stops a
+    // loop from growing the event.
+    static constexpr size_t kMaxLoadPhases = 16;
+    static constexpr size_t kMaxPhaseNameLen = 32;
+    auto now = PostHogTelemetry::Instance().ClockNow();
+    double ms = std::chrono::duration<double, std::milli>(now - _last).count();
+    _last = now;
+    if (_finished) {
+        return;
+    }
+
+    std::string name = phase.substr(0, kMaxPhaseNameLen);
+    for (char& c : name) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        } else if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_')) {
+            c = '_';
+        }
+    }
+    if (name.empty()) {
+        name = "unnamed";
+    }
+    for (auto& p : _phases) {
+        if (p.first == name) {
+            p.second += ms;
+            return;
+        }
+    }
+    if (_phases.size() < kMaxLoadPhases) {
+        _phases.emplace_back(std::move(name), ms);
+    }
+}
+
+void ScopedExtensionLoad::Finish()
+{
+    if (_finished) {
+        return;
+    }
+    _finished = true;
+    auto& telemetry = PostHogTelemetry::Instance();
+    PropertyMap timing;
+    timing["load_ms"] = std::chrono::duration<double, std::milli>(telemetry.ClockNow() - _start).count();
+    for (auto& p : _phases) {
+        timing["phase_" + p.first + "_ms"] = p.second;
+    }
+    telemetry.CaptureExtensionLoad(_extension_name, _extension_version, std::move(timing));
+}
+
 void PostHogTelemetry::CaptureApplicationStart(const std::string& app_name,
                                                const std::string& app_version)
 {
+    if (!CaptureOpen(kTelemetryLifecycle)) {
+        return;
+    }
     PropertyMap props;
     props["app_name"]    = app_name;
     props["app_version"] = app_version;
@@ -829,6 +1626,9 @@ void PostHogTelemetry::CaptureApplicationStart(const std::string& app_name,
 void PostHogTelemetry::CaptureApplicationStop(const std::string& app_name,
                                               const std::string& app_version)
 {
+    if (!CaptureOpen(kTelemetryLifecycle)) {
+        return;
+    }
     PropertyMap props;
     props["app_name"]    = app_name;
     props["app_version"] = app_version;
@@ -861,7 +1661,15 @@ void PostHogTelemetry::SetSampling(double rate)
     if (rate > 1.0) rate = 1.0;
     std::lock_guard<std::mutex> lock(_agg_lock);
     _sampling_rate = rate;
-    // Derive the integer decimation stride once and stamp the *effective* rate
+    ApplySamplingLocked();
+}
+
+// The effective rate is the stricter of the embedder's SetSampling and the
+// remote config's sampling_rate, so the fleet can only turn volume down.
+void PostHogTelemetry::ApplySamplingLocked()
+{
+    double rate = std::min(_sampling_rate, _remote_sampling_rate);
+    // Derive the integer decimation stride once and stamp the *effective* rate
     // (1/stride), not the requested rate, so scaled-up counts are exact.
     if (rate >= 1.0) {
         _sample_stride = 1;
@@ -881,23 +1689,144 @@ void PostHogTelemetry::SetSampling(double rate)
         _sample_stride = stride;
         _effective_sample_rate = 1.0 / static_cast<double>(stride);
     }
+    // The CPU governor doubles the stride per level on top of either knob.
+    int level = _governor_level.load(std::memory_order_relaxed);
+    if (level > 0 && _sample_stride != 0) {
+        _sample_stride <<= level;
+        _effective_sample_rate = 1.0 / static_cast<double>(_sample_stride);
+    }
 }
 
 // Recorded-call count that triggers a volume-based aggregate flush, so
 // function-heavy or capture-free workloads still ship stats without waiting for
 // an explicit Flush().
 static constexpr uint64_t kAggFlushThreshold = 256;
-// Defensive cap on how many distinct function names we track, so a caller that
-// (against the cardinality contract) passes unbounded/generated names can't grow
-// the aggregator maps without limit in a long-running process.
-static constexpr size_t kMaxTrackedFunctions = 10000;
 
-void PostHogTelemetry::RecordFunctionCall(const std::string& function_name,
+// Exemplar context labels are enumerations (size buckets, modes), so a short
+// bound is plenty and keeps the per-function heap small.
+static constexpr size_t kMaxExemplarLabelLen = 64;
+
+void PostHogTelemetry::SetSlowestExemplars(size_t k)
+{
+    static constexpr size_t kMaxSlowestExemplars = 64;
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    _slowest_k = std::min(k, kMaxSlowestExemplars);
+}
+
+void PostHogTelemetry::SetChangeTriggeredEmission(double relative_threshold,
+                                                  uint32_t heartbeat_windows,
+                                                  double ewma_alpha)
+{
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    _change_threshold  = relative_threshold > 0 ? relative_threshold : 0;
+    _heartbeat_windows = std::max<uint32_t>(heartbeat_windows, 1);
+    _ewma_alpha        = (ewma_alpha > 0 && ewma_alpha <= 1) ? ewma_alpha : 0.3;
+}
+
+void PostHogTelemetry::SetPackedFunctionStats(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    _packed_function_stats = enabled;
+}
+
+void PostHogTelemetry::SetMaxEventBytes(size_t bytes)
+{
+    _max_event_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+void PostHogTelemetry::SetCardinalityLimit(uint32_t limit)
+{
+    std::lock_guard<std::mutex> lock(_cardinality_lock);
+    _cardinality = TelemetryStringTable<CardinalityGuard>();
+    _cardinality_limit.store(limit, std::memory_order_relaxed);
+}
+
+void PostHogTelemetry::GuardCardinality(const std::string& event, PropertyMap& props)
+{
+    const uint32_t limit = _cardinality_limit.load(std::memory_order_relaxed);
+    if (limit == 0) {
+        return;
+    }
+    std::vector<std::pair<std::string, double>> violations;   // key, estimate
+    {
+        std::lock_guard<std::mutex> lock(_cardinality_lock);
+        for (auto& kv : props) {
+            if (kv.second.kind != PropertyValue::Kind::String || kv.first.empty() ||
+                kv.first[0] == '$') {
+                continue;
+            }
+            _cardinality_key.assign(event).append(1, '\x1f').append(kv.first);
+            uint64_t hash = TelemetryStringTable<CardinalityGuard>::Hash(_cardinality_key);
+            size_t idx = _cardinality.Find(_cardinality_key, hash);
+            if (idx == TelemetryStringTable<CardinalityGuard>::npos) {
+                if (_cardinality.size() >= kMaxCardinalitySketches) {
+                    continue;
+                }
+                idx = _cardinality.Insert(_cardinality_key, hash);
+            }
+            CardinalityGuard& guard = _cardinality.ValueAt(idx);
+            if (!guard.violated) {
+                // Only the part that survives the clamp can add cardinality.
+                std::string_view value(kv.second.s);
+                uint64_t value_hash = TelemetryStringTable<CardinalityGuard>::Hash(
+                    value.substr(0, kMaxPropertyValueLen));
+                if (!guard.sketch.Add(value_hash)) {
+                    continue;
+                }
+                double estimate = guard.sketch.Estimate();
+                if (estimate <= limit) {
+                    continue;
+                }
+                guard.violated = true;
+                violations.emplace_back(kv.first, estimate);
+            }
+            kv.second.s = kCardinalityOther;
+            _cardinality_bucketed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    for (auto& v : violations) {
+        _cardinality_violations.fetch_add(1, std::memory_order_relaxed);
+        // Unguarded: the report must not be bucketed by the guard it reports on.
+        CaptureEvent("telemetry_cardinality_violation",
+                     {{"violating_event", event},
+                      {"property_key", v.first},
+                      {"estimated_distinct", static_cast<int64_t>(std::llround(v.second))},
+                      {"cardinality_limit", static_cast<int64_t>(limit)}},
+                     false);
+    }
+}
+
+std::string PostHogTelemetry::InputSizeBucket(uint64_t n)
+{
+    if (n == 0) {
+        return "0";
+    }
+    uint64_t lo = 1;
+    for (int exp = 0; exp < 9; exp++, lo *= 10) {
+        if (n < lo * 10) {
+            return std::to_string(lo) + "-" + std::to_string(lo * 10 - 1);
+        }
+    }
+    return "1e9+";
+}
+
+void PostHogTelemetry::RecordFunctionCall(std::string_view function_name,
                                           double duration_ms)
 {
-    if (!_telemetry_enabled) {
+    RecordFunctionCall(function_name, duration_ms, std::string_view());
+}
+
+void PostHogTelemetry::RecordFunctionCall(std::string_view function_name,
+                                          double duration_ms,
+                                          std::string_view context_label)
+{
+    if (!CaptureOpen(kTelemetryFunction)) {
         return;
     }
+    CaptureCostProbe cost(_capture_cost_ns);
+    if (_shape_trace_on.load(std::memory_order_relaxed)) {
+        TraceFunctionCall(function_name, duration_ms, context_label);
+    }
 
     // Sanitize the duration: a NaN would corrupt std::sort's strict-weak-ordering
     // in MedianOf (UB → hang/crash in the host); a negative is nonsensical.
@@ -906,54 +1835,117 @@ void PostHogTelemetry::RecordFunctionCall(const std::string& function_name,
     }
 
     bool emit_prompt = false;
+    bool cold = false;
     bool flush_now = false;
+    bool packed = false;
     double eff_rate = 1.0;
     {
         std::lock_guard<std::mutex> lock(_agg_lock);
 
-        // Bound distinct-function tracking (defence against unbounded/generated
-        // names); a new function beyond the cap is dropped, existing ones keep
-        // working.
-        if (_sample_seen.find(function_name) == _sample_seen.end() &&
-            _sample_seen.size() >= kMaxTrackedFunctions) {
-            return;
+        // One hash per call, reused by the insert on first sight.
+        uint64_t hash = TelemetryStringTable<FunctionRecord>::Hash(function_name);
+        size_t idx = _functions.Find(function_name, hash);
+        if (idx == _functions.npos) {
+            // Bound distinct-function tracking (defence against unbounded/
+            // generated names); a new function beyond the cap is dropped,
+            // existing ones keep working.
+            if (_functions.size() >= _max_tracked_functions.load(std::memory_order_relaxed)) {
+                _dropped_untracked_functions.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            idx = _functions.Insert(function_name, hash);
         }
+        FunctionRecord& rec = _functions.ValueAt(idx);
 
-        // Per-function decimation counter that PERSISTS across flushes (a
-        // separate map from the drained stats), so decimation stays accurate
+        // Per-function decimation counter that PERSISTS across flushes (the
+        // window is drained, the record isn't), so decimation stays accurate
         // and doesn't reset every flush; per function keeps it unbiased across
         // interleaved functions.
-        uint64_t seen = ++_sample_seen[function_name];
+        uint64_t seen = ++rec.seen;
 
         if (_sample_stride != 1) {
             if (_sample_stride == 0) {
-                return;  // rate 0 => record nothing (and DON'T create a stat entry)
+                // rate 0 => record nothing (and DON'T touch the window)
+                TELEMETRY_PROBE1(function_sample_out, _functions.KeyAt(idx).c_str());
+                _sampled_out_calls.fetch_add(1, std::memory_order_relaxed);
+                return;
             }
             if ((seen - 1) % _sample_stride != 0) {
+                TELEMETRY_PROBE1(function_sample_out, _functions.KeyAt(idx).c_str());
+                _sampled_out_calls.fetch_add(1, std::memory_order_relaxed);
                 return;
             }
         }
+        TELEMETRY_PROBE1(function_sample_in, _functions.KeyAt(idx).c_str());
         eff_rate = _effective_sample_rate;
+        packed = _packed_function_stats;
 
         // Hybrid: the first N recorded calls per function are emitted per-call
         // (prompt) so short sessions never lose them; only once a function
         // exceeds N does it switch to aggregation (firehose prevention).
         // sum(call_count) stays correct — prompt events carry call_count=1.
-        uint64_t rec = ++_prompt_recorded[function_name];
-        if (_prompt_function_calls > 0 &&
-            rec <= static_cast<uint64_t>(_prompt_function_calls)) {
+        uint64_t recorded = ++rec.prompt_recorded;
+        // The session's first call usually pays for lazy initialization; it is
+        // kept apart as first_call_ms instead of skewing the warm percentiles.
+        cold = recorded == 1;
+        if (cold) {
+            rec.first_call_ms = duration_ms;
+        }
+        bool prompt_phase = _prompt_function_calls > 0 &&
+                            recorded <= static_cast<uint64_t>(_prompt_function_calls);
+        if (prompt_phase && _governor_level.load(std::memory_order_relaxed) >= kGovernorShedLevel) {
+            // Over the CPU budget: the call still counts, in the window.
+            _governor_shed_events.fetch_add(1, std::memory_order_relaxed);
+            prompt_phase = false;
+        }
+        if (prompt_phase) {
             emit_prompt = true;
+            // Sent as its own event, but still one of the window's calls for
+            // a window sink (the Prometheus counter).
+            if (rec.prompt_calls++ == 0) {
+                _prompted_functions.push_back(idx);
+            }
+        } else if (cold) {
+            // Counted in the window, but not sampled or kept as an exemplar.
+            if (rec.window.count++ == 0) {
+                _active_functions.push_back(idx);
+            }
+            if (++_recorded_since_flush >= kAggFlushThreshold) {
+                flush_now = true;
+            }
         } else {
-            // Only create/touch the stat entry when the call is aggregated, so
-            // dropped calls never leave count==0 entries in the aggregator.
-            static constexpr size_t kMaxDurationSamples = 256;
-            auto& st = _function_stats[function_name];
-            st.count++;
+            // Only the aggregated calls open a window, so dropped calls never
+            // leave count==0 entries in the drain.
+            auto& st = rec.window;
+            if (st.count++ == 0) {
+                _active_functions.push_back(idx);
+            }
             if (st.duration_samples.size() < kMaxDurationSamples) {
                 st.duration_samples.push_back(duration_ms);
+                if (!st.sample_weights.empty()) {
+                    st.sample_weights.push_back(1);
+                }
             } else {
-                // (count-1) so the ring cycles through every slot including 0.
-                st.duration_samples[(st.count - 1) % kMaxDurationSamples] = duration_ms;
+                size_t slot = st.ring_next++ % kMaxDurationSamples;
+                st.duration_samples[slot] = duration_ms;
+                if (!st.sample_weights.empty()) {
+                    st.sample_weights[slot] = 1;
+                }
+            }
+            // Bounded min-heap of the window's K slowest calls: O(log K) only
+            // when a call beats the current K-th slowest, O(1) otherwise.
+            auto faster = [](const Exemplar& a, const Exemplar& b) {
+                return a.duration_ms > b.duration_ms;
+            };
+            if (_slowest_k > 0 &&
+                (st.slowest.size() < _slowest_k || duration_ms > st.slowest.front().duration_ms)) {
+                if (st.slowest.size() >= _slowest_k) {
+                    std::pop_heap(st.slowest.begin(), st.slowest.end(), faster);
+                    st.slowest.pop_back();
+                }
+                st.slowest.push_back({duration_ms, std::string(context_label)});
+                ClampUtf8(st.slowest.back().label, kMaxExemplarLabelLen);
+                std::push_heap(st.slowest.begin(), st.slowest.end(), faster);
             }
             if (++_recorded_since_flush >= kAggFlushThreshold) {
                 flush_now = true;
@@ -962,11 +1954,28 @@ void PostHogTelemetry::RecordFunctionCall(const std::string& function_name,
     }
 
     // Build/enqueue outside _agg_lock (these take _thread_lock/_batch_lock).
-    if (emit_prompt) {
+    if (emit_prompt && packed) {
+        std::vector<FunctionAggregate> rows(1);
+        rows[0].name = std::string(function_name);
+        rows[0].stat.count = 1;
+        rows[0].stat.duration_samples.push_back(duration_ms);
+        rows[0].windows = 1;
+        rows[0].first_call_ms = cold ? duration_ms : -1;
+        for (auto& ev : PackFunctionStats(rows, eff_rate)) {
+            if (_auto_flush.load()) {
+                EnqueueTelemetryEvent(std::move(ev));
+            } else if (AdmitEvent(ev.event_name)) {
+                BufferEvent(EnrichEvent(ev));
+            }
+        }
+    } else if (emit_prompt) {
         PropertyMap props;
-        props["function_name"]   = function_name;
+        props["function_name"]   = std::string(function_name);
         props["call_count"]      = static_cast<int64_t>(1);
         props["duration_ms_p50"] = duration_ms;
+        if (cold) {
+            props["first_call_ms"] = duration_ms;
+        }
         std::string ext = GetExtensionName();
         if (!ext.empty()) {
             props["extension_name"] = ext;
@@ -976,8 +1985,8 @@ void PostHogTelemetry::RecordFunctionCall(const std::string& function_name,
         }
         PostHogEvent ev{"function_executed", GetDistinctId(), std::move(props), ""};
         if (_auto_flush.load()) {
-            EnqueueTelemetryEvent(ev);
-        } else {
+            EnqueueTelemetryEvent(std::move(ev));
+        } else if (AdmitEvent(ev.event_name)) {
             BufferEvent(EnrichEvent(ev));
         }
     }
@@ -987,42 +1996,509 @@ void PostHogTelemetry::RecordFunctionCall(const std::string& function_name,
     }
 }
 
-static double MedianOf(std::vector<double> v)
+PostHogTelemetry::FunctionId PostHogTelemetry::GetFunctionId(std::string_view function_name)
+{
+    if (!CaptureOpen(kTelemetryFunction)) {
+        return 0;   // opted-out / disabled processes never grow the table
+    }
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    uint64_t hash = TelemetryStringTable<FunctionRecord>::Hash(function_name);
+    size_t idx = _functions.Find(function_name, hash);
+    if (idx == _functions.npos) {
+        if (_functions.size() >= _max_tracked_functions.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        idx = _functions.Insert(function_name, hash);
+    }
+    return static_cast<FunctionId>(idx + 1);
+}
+
+void PostHogTelemetry::RecordFunctionCalls(FunctionId id, uint64_t rows, double total_ms)
+{
+    if (!CaptureOpen(kTelemetryFunction) || rows == 0) {
+        return;
+    }
+    CaptureCostProbe cost(_capture_cost_ns);
+    if (id == 0) {
+        _dropped_untracked_functions.fetch_add(rows, std::memory_order_relaxed);
+        return;
+    }
+    if (!std::isfinite(total_ms) || total_ms < 0.0) {
+        total_ms = 0.0;
+    }
+    double per_row_ms = total_ms / static_cast<double>(rows);
+
+    bool flush_now = false;
+    {
+        std::lock_guard<std::mutex> lock(_agg_lock);
+        if (id > _functions.size()) {
+            return;   // not an id this process handed out
+        }
+        size_t idx = id - 1;
+        FunctionRecord& rec = _functions.ValueAt(idx);
+        if (_shape_trace_on.load(std::memory_order_relaxed)) {
+            TraceFunctionCalls(_functions.KeyAt(idx), rows, total_ms);
+        }
+
+        // Sampling and the prompt phase count recordings (chunks), not rows:
+        // a decimated chunk drops all its rows, and sample_rate scales them back.
+        uint64_t seen = ++rec.seen;
+        if (_sample_stride != 1 && (_sample_stride == 0 || (seen - 1) % _sample_stride != 0)) {
+            TELEMETRY_PROBE1(function_sample_out, _functions.KeyAt(idx).c_str());
+            _sampled_out_calls.fetch_add(rows, std::memory_order_relaxed);
+            return;
+        }
+        TELEMETRY_PROBE1(function_sample_in, _functions.KeyAt(idx).c_str());
+
+        // Batches go straight to the window: one prompt event per chunk would
+        // be the firehose this path exists to avoid.
+        auto& st = rec.window;
+        if (st.count == 0) {
+            _active_functions.push_back(idx);
+        }
+        st.count += rows;
+        if (rec.prompt_recorded++ == 0) {
+            rec.first_call_ms = per_row_ms;   // cold chunk, as in RecordFunctionCall
+        } else {
+            // One sample for the chunk, weighted by its rows.
+            if (st.sample_weights.empty()) {
+                st.sample_weights.assign(st.duration_samples.size(), 1);
+            }
+            if (st.duration_samples.size() < kMaxDurationSamples) {
+                st.duration_samples.push_back(per_row_ms);
+                st.sample_weights.push_back(rows);
+            } else {
+                size_t slot = st.ring_next++ % kMaxDurationSamples;
+                st.duration_samples[slot] = per_row_ms;
+                st.sample_weights[slot] = rows;
+            }
+        }
+        if (++_recorded_since_flush >= kAggFlushThreshold) {
+            flush_now = true;
+        }
+    }
+    if (flush_now && _auto_flush.load()) {
+        FlushFunctionAggregates();
+    }
+}
+
+// q-quantile of an already-sorted sample (linear interpolation between the two
+// nearest ranks; q=0.5 is the classic median). 0 for an empty sample.
+static double PercentileOfSorted(const std::vector<double>& v, double q)
 {
     if (v.empty()) {
         return 0.0;
     }
-    std::sort(v.begin(), v.end());
-    size_t n = v.size();
-    return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+    double pos = q * static_cast<double>(v.size() - 1);
+    size_t lo = static_cast<size_t>(pos);
+    size_t hi = std::min(lo + 1, v.size() - 1);
+    return v[lo] + (v[hi] - v[lo]) * (pos - static_cast<double>(lo));
+}
+
+// Sort a window's reservoir by duration, keeping batch weights aligned.
+static void SortSamples(std::vector<double>& samples, std::vector<uint64_t>& weights)
+{
+    if (weights.empty()) {
+        std::sort(samples.begin(), samples.end());
+        return;
+    }
+    std::vector<std::pair<double, uint64_t>> pairs(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        pairs[i] = {samples[i], weights[i]};
+    }
+    std::sort(pairs.begin(), pairs.end());
+    for (size_t i = 0; i < pairs.size(); i++) {
+        samples[i] = pairs[i].first;
+        weights[i] = pairs[i].second;
+    }
+}
+
+// Same over a sorted reservoir that may hold batch samples (RecordFunctionCalls:
+// each stands for `weight` rows). Weighted, it is the smallest duration whose
+// cumulative weight reaches q of the total; unweighted, PercentileOfSorted.
+static double PercentileOfSorted(const std::vector<double>& v, const std::vector<uint64_t>& w,
+                                 double q)
+{
+    if (w.empty() || v.empty()) {
+        return PercentileOfSorted(v, q);
+    }
+    uint64_t total = 0;
+    for (uint64_t weight : w) {
+        total += weight;
+    }
+    double target = q * static_cast<double>(total);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < v.size(); i++) {
+        cumulative += w[i];
+        if (static_cast<double>(cumulative) >= target) {
+            return v[i];
+        }
+    }
+    return v.back();
+}
+
+static double MedianOf(std::vector<double> v, std::vector<uint64_t> w = {})
+{
+    SortSamples(v, w);
+    return PercentileOfSorted(v, w, 0.5);
+}
+
+// Render the window's slowest calls, slowest first, as a JSON number array and
+// a parallel label array. Returns whether any call carried a label.
+bool PostHogTelemetry::SlowestExemplarsJson(std::vector<Exemplar> slowest, std::string& ms,
+                                            std::string& labels)
+{
+    std::sort(slowest.begin(), slowest.end(), [](const Exemplar& a, const Exemplar& b) {
+        return a.duration_ms > b.duration_ms;
+    });
+    ms = "[";
+    labels = "[";
+    bool any_label = false;
+    for (size_t i = 0; i < slowest.size(); i++) {
+        if (i > 0) {
+            ms += ",";
+            labels += ",";
+        }
+        ms += PropertyValue(slowest[i].duration_ms).ToJson();
+        labels += EscapeJsonString(slowest[i].label);
+        any_label = any_label || !slowest[i].label.empty();
+    }
+    ms += "]";
+    labels += "]";
+    return any_label;
+}
+
+// Stamp the window's slowest calls as a `slowest_ms` number array;
+// `slowest_labels` (parallel array) only when some call carried a label.
+void PostHogTelemetry::AddSlowestExemplars(PropertyMap& props, std::vector<Exemplar> slowest)
+{
+    if (slowest.empty()) {
+        return;
+    }
+    std::string ms, labels;
+    bool any_label = SlowestExemplarsJson(std::move(slowest), ms, labels);
+    props["slowest_ms"] = PropertyValue::Json(ms);
+    if (any_label) {
+        props["slowest_labels"] = PropertyValue::Json(labels);
+    }
+}
+
+// Functions per packed event: keeps one event comfortably under PostHog's
+// per-event size limit even at the distinct-function cap. An event also closes
+// once its `functions` array reaches half the event byte budget, so the budget
+// never has to drop it.
+static constexpr size_t kMaxFunctionsPerPackedEvent = 500;
+
+std::vector<PostHogEvent> PostHogTelemetry::PackFunctionStats(std::vector<FunctionAggregate>& rows,
+                                                              double sample_rate)
+{
+    std::string distinct = GetDistinctId();
+    std::string extension_name = GetExtensionName();
+    const size_t max_array_bytes = _max_event_bytes.load(std::memory_order_relaxed) / 2;
+    std::vector<PostHogEvent> events;
+    std::string functions;
+    size_t function_count = 0;
+    int64_t total_calls = 0;
+    auto close_event = [&]() {
+        PropertyMap props;
+        props["functions"]      = PropertyValue::Json("[" + functions + "]");
+        props["function_count"] = static_cast<int64_t>(function_count);
+        props["call_count"]     = total_calls;
+        if (!extension_name.empty()) {
+            props["extension_name"] = extension_name;
+        }
+        if (sample_rate < 1.0) {
+            props["sample_rate"] = sample_rate;
+        }
+        events.push_back(PostHogEvent{"function_stats", distinct, std::move(props), ""});
+        functions.clear();
+        function_count = 0;
+        total_calls = 0;
+    };
+    for (auto& row : rows) {
+        std::vector<double>& samples = row.stat.duration_samples;
+        std::vector<uint64_t>& weights = row.stat.sample_weights;
+        SortSamples(samples, weights);
+        std::string name = row.name;
+        ClampUtf8(name, kMaxPropertyValueLen);   // Json values skip the envelope clamp
+        std::string entry = "{\"name\":" + EscapeJsonString(name);
+        entry += ",\"count\":" + std::to_string(row.stat.count);
+        if (!samples.empty()) {
+            entry += ",\"p50_ms\":" + PropertyValue(PercentileOfSorted(samples, weights, 0.50)).ToJson();
+            entry += ",\"p95_ms\":" + PropertyValue(PercentileOfSorted(samples, weights, 0.95)).ToJson();
+            entry += ",\"p99_ms\":" + PropertyValue(PercentileOfSorted(samples, weights, 0.99)).ToJson();
+        }
+        if (row.first_call_ms >= 0) {
+            entry += ",\"first_call_ms\":" + PropertyValue(row.first_call_ms).ToJson();
+        }
+        if (!row.stat.slowest.empty()) {
+            std::string ms, labels;
+            bool any_label = SlowestExemplarsJson(std::move(row.stat.slowest), ms, labels);
+            entry += ",\"slowest_ms\":" + ms;
+            if (any_label) {
+                entry += ",\"slowest_labels\":" + labels;
+            }
+        }
+        if (row.windows > 1) {
+            entry += ",\"windows\":" + std::to_string(row.windows);
+        }
+        entry += "}";
+
+        if (function_count > 0 && (function_count == kMaxFunctionsPerPackedEvent ||
+                                   functions.size() + entry.size() + 3 > max_array_bytes)) {
+            close_event();
+        }
+        if (function_count > 0) {
+            functions += ",";
+        }
+        functions += entry;
+        function_count++;
+        total_calls += static_cast<int64_t>(row.stat.count);
+    }
+    if (function_count > 0) {
+        close_event();
+    }
+    return events;
+}
+
+// Merge one window's stat into another (a suppressed window into the carried
+// record, or the carried record into the window being emitted). The reservoir
+// stays bounded: once over the cap it is thinned with an even stride, which
+// keeps the p50 representative of both windows.
+void PostHogTelemetry::FoldFunctionStat(FunctionStat& into, FunctionStat& from, size_t slowest_k)
+{
+    into.count += from.count;
+    auto& samples = into.duration_samples;
+    auto& weights = into.sample_weights;
+    if (weights.empty() != from.sample_weights.empty()) {
+        // One side holds batch samples: give the other explicit unit weights.
+        if (weights.empty()) {
+            weights.assign(samples.size(), 1);
+        } else {
+            from.sample_weights.assign(from.duration_samples.size(), 1);
+        }
+    }
+    samples.insert(samples.end(), from.duration_samples.begin(), from.duration_samples.end());
+    weights.insert(weights.end(), from.sample_weights.begin(), from.sample_weights.end());
+    if (samples.size() > kMaxDurationSamples) {
+        std::vector<double> thinned;
+        std::vector<uint64_t> thinned_weights;
+        thinned.reserve(kMaxDurationSamples);
+        double step = static_cast<double>(samples.size()) / kMaxDurationSamples;
+        for (size_t i = 0; i < kMaxDurationSamples; i++) {
+            size_t at = static_cast<size_t>(i * step);
+            thinned.push_back(samples[at]);
+            if (!weights.empty()) {
+                thinned_weights.push_back(weights[at]);
+            }
+        }
+        samples.swap(thinned);
+        weights.swap(thinned_weights);
+    }
+    auto faster = [](const Exemplar& a, const Exemplar& b) {
+        return a.duration_ms > b.duration_ms;
+    };
+    for (auto& ex : from.slowest) {
+        if (slowest_k == 0) {
+            break;
+        }
+        if (into.slowest.size() < slowest_k) {
+            into.slowest.push_back(std::move(ex));
+            std::push_heap(into.slowest.begin(), into.slowest.end(), faster);
+        } else if (ex.duration_ms > into.slowest.front().duration_ms) {
+            std::pop_heap(into.slowest.begin(), into.slowest.end(), faster);
+            into.slowest.back() = std::move(ex);
+            std::push_heap(into.slowest.begin(), into.slowest.end(), faster);
+        }
+    }
+}
+
+std::chrono::steady_clock::time_point PostHogTelemetry::Now() const
+{
+    return _clock ? _clock() : std::chrono::steady_clock::now();
+}
+
+std::chrono::steady_clock::time_point PostHogTelemetry::ClockNow()
+{
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    return Now();
+}
+
+// |x - base| relative to the baseline. The floor keeps near-zero baselines
+// (sub-microsecond latencies, idle functions) from flagging every window.
+static double RelativeChange(double x, double base)
+{
+    static constexpr double kFloor = 1e-3;
+    return std::fabs(x - base) / std::max(std::fabs(base), kFloor);
+}
+
+void PostHogTelemetry::ResetFunctionWindowsLocked()
+{
+    for (size_t idx : _active_functions) {
+        _functions.ValueAt(idx).window = FunctionStat();
+    }
+    _active_functions.clear();
+    for (size_t idx : _prompted_functions) {
+        _functions.ValueAt(idx).prompt_calls = 0;
+    }
+    _prompted_functions.clear();
+    for (size_t idx : _active_operators) {
+        _operators.ValueAt(idx) = OperatorRecord();
+    }
+    _active_operators.clear();
+    if (_baselines_active) {
+        for (size_t idx = 0; idx < _functions.size(); idx++) {
+            _functions.ValueAt(idx).baseline = FunctionBaseline();
+        }
+        _baselines_active = false;
+    }
+    _recorded_since_flush = 0;
 }
 
-std::vector<PostHogEvent> PostHogTelemetry::BuildFunctionAggregateEvents()
+std::vector<PostHogEvent> PostHogTelemetry::BuildFunctionAggregateEvents(bool force, bool close_window)
 {
-    std::map<std::string, FunctionStat> snapshot;
+    std::vector<FunctionAggregate> emit;
+    std::vector<PromptedCalls> prompted;
     double sample_rate;
+    bool packed;
     {
         std::lock_guard<std::mutex> lock(_agg_lock);
-        snapshot.swap(_function_stats);
         _recorded_since_flush = 0;
+        // Change-triggered windows are a fixed length: the piggyback and
+        // volume drains on the capture path leave them open, so the baseline
+        // pass below runs once per window on the worker.
+        if (_change_threshold > 0 && !force && !close_window) {
+            return {};
+        }
+        std::vector<size_t> active;
+        active.swap(_active_functions);
         sample_rate = _effective_sample_rate;  // 1/stride, not the requested rate
+        packed = _packed_function_stats;
+        prompted.reserve(_prompted_functions.size());
+        for (size_t idx : _prompted_functions) {
+            FunctionRecord& rec = _functions.ValueAt(idx);
+            prompted.push_back(PromptedCalls{_functions.KeyAt(idx), rec.prompt_calls, rec.first_call_ms});
+            rec.prompt_calls = 0;
+        }
+        _prompted_functions.clear();
+
+        auto now = Now();
+        double window_s = std::chrono::duration<double>(now - _window_start).count();
+        if (_window_start == std::chrono::steady_clock::time_point{} || window_s <= 0) {
+            window_s = 1.0;  // first window: no meaningful duration yet
+        }
+        _window_start = now;
+
+        if (_change_threshold <= 0 && !_baselines_active) {
+            emit.reserve(active.size());
+            for (size_t idx : active) {
+                FunctionRecord& rec = _functions.ValueAt(idx);
+                emit.push_back(FunctionAggregate{_functions.KeyAt(idx), std::move(rec.window), 1,
+                                                 rec.first_call_ms});
+                rec.window = FunctionStat();
+            }
+        } else {
+            // Decide per function against its EWMA baseline. Runs under
+            // _agg_lock so concurrent drains (worker + Flush) see one baseline.
+            // The heartbeat is wall time since a function's last emission, with
+            // half a window of slack for timer jitter.
+            auto window = std::chrono::seconds(kChangeWindowSeconds);
+            auto heartbeat_after = window * _heartbeat_windows - window / 2;
+            std::vector<bool>& in_window = _in_closing_window;   // reused: no per-close allocation
+            in_window.assign(_functions.size(), false);
+            for (size_t idx : active) {
+                in_window[idx] = true;
+                FunctionRecord& rec = _functions.ValueAt(idx);
+                FunctionBaseline& b = rec.baseline;
+                double rate = static_cast<double>(rec.window.count) / window_s;
+                double p50  = MedianOf(rec.window.duration_samples, rec.window.sample_weights);
+                bool changed = !b.primed ||
+                               RelativeChange(rate, b.rate_ewma) > _change_threshold ||
+                               RelativeChange(p50, b.p50_ewma) > _change_threshold;
+                bool heartbeat = now - b.last_emit >= heartbeat_after;
+                // The EWMA follows slow drift; a detected shift re-seeds it, so
+                // a new steady level is emitted once rather than for every
+                // window the average takes to catch up.
+                if (b.primed && !changed) {
+                    b.rate_ewma += _ewma_alpha * (rate - b.rate_ewma);
+                    b.p50_ewma  += _ewma_alpha * (p50 - b.p50_ewma);
+                } else {
+                    b.rate_ewma = rate;
+                    b.p50_ewma  = p50;
+                    b.primed    = true;
+                }
+                FoldFunctionStat(b.carried, rec.window, _slowest_k);
+                rec.window = FunctionStat();
+                b.carried_windows++;
+                if (force || changed || heartbeat || _change_threshold <= 0) {
+                    emit.push_back(FunctionAggregate{_functions.KeyAt(idx), std::move(b.carried),
+                                                     b.carried_windows, rec.first_call_ms});
+                    b.carried = FunctionStat();
+                    b.carried_windows = 0;
+                    b.last_emit = now;
+                } else {
+                    _suppressed_aggregates.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            // Functions that went quiet still owe their folded counts: ship them
+            // on the heartbeat (or a forced flush) even without new calls.
+            for (size_t idx = 0; idx < _functions.size(); idx++) {
+                FunctionRecord& rec = _functions.ValueAt(idx);
+                FunctionBaseline& b = rec.baseline;
+                // A quiet window adds no calls, so it isn't counted in `windows`.
+                if (!in_window[idx] && b.carried_windows > 0) {
+                    if (force || now - b.last_emit >= heartbeat_after || _change_threshold <= 0) {
+                        emit.push_back(FunctionAggregate{_functions.KeyAt(idx), std::move(b.carried),
+                                                         b.carried_windows, rec.first_call_ms});
+                        b.carried = FunctionStat();
+                        b.carried_windows = 0;
+                        b.last_emit = now;
+                    }
+                }
+                // Turning the feature off lets the baselines drain away (every
+                // carried window was emitted just above).
+                if (_change_threshold <= 0) {
+                    b = FunctionBaseline();
+                }
+            }
+            _baselines_active = _change_threshold > 0;
+        }
+    }
+    // Name order, independent of first-call order in the table.
+    std::sort(emit.begin(), emit.end(), [](const FunctionAggregate& a, const FunctionAggregate& b) {
+        return a.name < b.name;
+    });
+    NotifyWindowSink(emit, prompted, sample_rate);
+
+    if (packed) {
+        return PackFunctionStats(emit, sample_rate);
     }
 
     std::string distinct = GetDistinctId();
     std::string extension_name = GetExtensionName();  // continuity dimension
     std::vector<PostHogEvent> events;
-    events.reserve(snapshot.size());
-    for (auto& kv : snapshot) {
+    events.reserve(emit.size());
+    for (auto& p : emit) {
         PropertyMap props;
-        props["function_name"]   = kv.first;
-        props["call_count"]      = static_cast<int64_t>(kv.second.count);
-        props["duration_ms_p50"] = MedianOf(kv.second.duration_samples);
+        props["function_name"]   = p.name;
+        props["call_count"]      = static_cast<int64_t>(p.stat.count);
+        // Warm calls only; absent when the window held nothing but the cold one.
+        if (!p.stat.duration_samples.empty()) {
+            props["duration_ms_p50"] = MedianOf(p.stat.duration_samples, p.stat.sample_weights);
+        }
+        if (p.first_call_ms >= 0) {
+            props["first_call_ms"] = p.first_call_ms;
+        }
         if (!extension_name.empty()) {
             props["extension_name"] = extension_name;
         }
         if (sample_rate < 1.0) {
             props["sample_rate"] = sample_rate;
         }
+        if (p.windows > 1) {
+            props["windows"] = static_cast<int64_t>(p.windows);
+        }
+        AddSlowestExemplars(props, std::move(p.stat.slowest));
         // Only the new `function_executed` name. We deliberately do NOT dual-emit
         // the legacy `function_execution`: aggregation changes its shape from
         // per-call to per-function-count, so reusing the old name would silently
@@ -1032,29 +2508,395 @@ std::vector<PostHogEvent> PostHogTelemetry::BuildFunctionAggregateEvents()
     return events;
 }
 
-bool PostHogTelemetry::BufferFunctionAggregates()
+void PostHogTelemetry::NotifyWindowSink(const std::vector<FunctionAggregate>& emit,
+                                        const std::vector<PromptedCalls>& prompted,
+                                        double sample_rate)
+{
+    // Empty windows are skipped: the piggyback drain runs on every capture.
+    if (emit.empty() && prompted.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> t(_thread_lock);
+        if (!_window_sink) {
+            return;
+        }
+    }
+    // Both lists are short (active functions only); `emit` is in name order.
+    std::vector<TelemetryWindowFunction> rows;
+    rows.reserve(emit.size() + prompted.size());
+    for (const auto& p : emit) {
+        rows.push_back(TelemetryWindowFunction{p.name, p.stat.count, p.stat.duration_samples,
+                                               p.stat.sample_weights, p.first_call_ms,
+                                               sample_rate});
+    }
+    size_t aggregated = rows.size();
+    for (const auto& p : prompted) {
+        auto it = std::lower_bound(rows.begin(), rows.begin() + aggregated, p.name,
+                                   [](const TelemetryWindowFunction& row, const std::string& name) {
+                                       return row.function_name < name;
+                                   });
+        if (it != rows.begin() + aggregated && it->function_name == p.name) {
+            it->call_count += p.calls;
+        } else {
+            TelemetryWindowFunction row;
+            row.function_name = p.name;
+            row.call_count = p.calls;
+            row.first_call_ms = p.first_call_ms;
+            row.sample_rate = sample_rate;
+            rows.push_back(std::move(row));
+        }
+    }
+    TelemetryStats pipeline;
+    FillPipelineStats(pipeline);
+    // Sinks do I/O (the Prometheus textfile rewrites a file): hand the window
+    // to the worker so the capturing thread never waits on a disk. The queue
+    // is FIFO, so Flush() still returns after the sink has seen its window.
+    std::lock_guard<std::mutex> t(_thread_lock);
+    if (!_window_sink || !_capture_open.load(std::memory_order_relaxed)) {
+        return;
+    }
+    EnsureQueueInitialized();
+    _queue->EnqueueTask([sink = _window_sink, rows = std::move(rows), pipeline](int) {
+        sink(rows, pipeline);
+    }, 0);
+}
+
+// Profiles nest two JSON levels per plan level (node + children array), so the
+// reader's default cap would reject ordinary deep join trees.
+static constexpr int kMaxProfileJsonDepth = 512;
+
+namespace {
+
+struct ProfiledOperator {
+    std::string type;
+    double ms;
+    uint64_t rows;
+};
+
+// Operator types are upper-case enum names (HASH_JOIN, TABLE_SCAN). Anything
+// else (a display name, a future free-form label) becomes OTHER, so no
+// user-derived string can leave through this path.
+std::string NormalizeOperatorType(const std::string& raw)
+{
+    static constexpr size_t kMaxOperatorTypeLen = 48;
+    size_t b = raw.find_first_not_of(' ');
+    size_t e = raw.find_last_not_of(' ');
+    if (b == std::string::npos || e - b + 1 > kMaxOperatorTypeLen) {
+        return "OTHER";
+    }
+    std::string type = raw.substr(b, e - b + 1);
+    for (char c : type) {
+        if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')) {
+            return "OTHER";
+        }
+    }
+    return type;
+}
+
+// First of two keys that holds a finite non-negative number, else 0.
+double ProfileMetric(const JsonValue& node, const char* key, const char* legacy_key)
+{
+    for (const char* k : {key, legacy_key}) {
+        const JsonValue* v = node.Find(k);
+        if (v && v->IsNumber() && v->n >= 0 && std::isfinite(v->n)) {
+            return v->n;
+        }
+    }
+    return 0;
+}
+
+// Walk the plan below a query root. DuckDB 1.1+ writes operator_type /
+// operator_timing / operator_cardinality; older releases name / timing /
+// cardinality. Timings are seconds. extra_info is never read.
+void CollectProfileOperators(const JsonValue& node, bool is_root, std::vector<ProfiledOperator>& out)
+{
+    if (!is_root) {
+        const JsonValue* type = node.Find("operator_type");
+        if (!type) {
+            type = node.Find("name");
+        }
+        if (type && type->IsString()) {
+            double rows = std::min(ProfileMetric(node, "operator_cardinality", "cardinality"), 1e18);
+            out.push_back({NormalizeOperatorType(type->s),
+                           ProfileMetric(node, "operator_timing", "timing") * 1000.0,
+                           static_cast<uint64_t>(rows)});
+        }
+    }
+    const JsonValue* children = node.Find("children");
+    if (children && children->IsArray()) {
+        for (auto& child : children->items) {
+            if (child.IsObject()) {
+                CollectProfileOperators(child, false, out);
+            }
+        }
+    }
+}
+
+} // namespace
+
+bool PostHogTelemetry::IngestQueryProfile(const std::string& profile_json)
+{
+    if (!CaptureOpen(kTelemetryMetric)) {
+        return false;
+    }
+    if (_governor_level.load(std::memory_order_relaxed) >= kGovernorMaxLevel) {
+        _governor_shed_events.fetch_add(1, std::memory_order_relaxed);
+        return false;   // a profile walk is the costliest capture there is
+    }
+    // Parse and walk outside _agg_lock; only the fold below holds it.
+    JsonValue doc;
+    if (!JsonReader::Parse(profile_json, doc, kMaxProfileJsonDepth)) {
+        return false;
+    }
+    std::vector<ProfiledOperator> ops;
+    bool is_profile = false;
+    auto collect_root = [&](const JsonValue& root) {
+        const JsonValue* children = root.Find("children");
+        if (children && children->IsArray()) {
+            is_profile = true;
+            CollectProfileOperators(root, true, ops);
+        }
+    };
+    if (doc.IsArray()) {
+        for (auto& root : doc.items) {   // EXPLAIN ANALYZE: one root per statement
+            collect_root(root);
+        }
+    } else {
+        collect_root(doc);
+    }
+    if (!is_profile) {
+        return false;
+    }
+
+    bool flush_now = false;
+    {
+        std::lock_guard<std::mutex> lock(_agg_lock);
+        for (auto& op : ops) {
+            uint64_t hash = TelemetryStringTable<OperatorRecord>::Hash(op.type);
+            size_t idx = _operators.Find(op.type, hash);
+            if (idx == _operators.npos) {
+                if (_operators.size() >= kMaxOperatorTypes) {
+                    op.type = "OTHER";
+                    hash = TelemetryStringTable<OperatorRecord>::Hash(op.type);
+                }
+                idx = _operators.Insert(op.type, hash);
+            }
+            OperatorRecord& rec = _operators.ValueAt(idx);
+            FunctionStat& st = rec.window;
+            if (st.count++ == 0) {
+                _active_operators.push_back(idx);
+            }
+            if (st.duration_samples.size() < kMaxOperatorSamples) {
+                st.duration_samples.push_back(op.ms);
+            } else {
+                st.duration_samples[(st.count - 1) % kMaxOperatorSamples] = op.ms;
+            }
+            rec.rows += op.rows;
+            if (++_recorded_since_flush >= kAggFlushThreshold) {
+                flush_now = true;
+            }
+        }
+    }
+    if (flush_now && _auto_flush.load()) {
+        FlushFunctionAggregates();  // outside _agg_lock (it re-locks)
+    }
+    return true;
+}
+
+std::vector<PostHogEvent> PostHogTelemetry::BuildOperatorAggregateEvents()
+{
+    std::vector<std::pair<std::string, OperatorRecord>> rows;
+    {
+        std::lock_guard<std::mutex> lock(_agg_lock);
+        rows.reserve(_active_operators.size());
+        for (size_t idx : _active_operators) {
+            rows.emplace_back(_operators.KeyAt(idx), std::move(_operators.ValueAt(idx)));
+            _operators.ValueAt(idx) = OperatorRecord();
+        }
+        _active_operators.clear();
+    }
+    std::sort(rows.begin(), rows.end(),
+              [](const std::pair<std::string, OperatorRecord>& a,
+                 const std::pair<std::string, OperatorRecord>& b) { return a.first < b.first; });
+
+    std::string distinct = GetDistinctId();
+    std::string extension_name = GetExtensionName();
+    std::vector<PostHogEvent> events;
+    events.reserve(rows.size());
+    for (auto& row : rows) {
+        std::vector<double>& samples = row.second.window.duration_samples;
+        std::sort(samples.begin(), samples.end());
+        PropertyMap props;
+        props["operator_type"]   = row.first;
+        props["call_count"]      = static_cast<int64_t>(row.second.window.count);
+        props["duration_ms_p50"] = PercentileOfSorted(samples, 0.50);
+        props["duration_ms_p95"] = PercentileOfSorted(samples, 0.95);
+        props["rows_total"]      = static_cast<int64_t>(
+            std::min<uint64_t>(row.second.rows, std::numeric_limits<int64_t>::max()));
+        if (!extension_name.empty()) {
+            props["extension_name"] = extension_name;
+        }
+        events.push_back(PostHogEvent{"operator_executed", distinct, std::move(props), ""});
+    }
+    return events;
+}
+
+bool PostHogTelemetry::BufferFunctionAggregates(bool force, bool close_window)
+{
+    auto events = BuildFunctionAggregateEvents(force, close_window);
+    for (auto& ev : BuildOperatorAggregateEvents()) {
+        events.push_back(std::move(ev));
+    }
+    if (events.empty()) {
+        return false;
+    }
+    bool buffered = false;
+    for (auto& ev : events) {
+        if (AdmitEvent(ev.event_name)) {
+            BufferEvent(EnrichEvent(ev));
+            buffered = true;
+        }
+    }
+    return buffered;
+}
+
+void PostHogTelemetry::FlushFunctionAggregates()
+{
+    // Buffer all aggregated events, then schedule one coalesced send.
+    if (BufferFunctionAggregates()) {
+        ScheduleSend();
+    }
+}
+
+void PostHogTelemetry::CloseChangeWindow()
+{
+    {
+        std::lock_guard<std::mutex> lock(_agg_lock);
+        if (_change_threshold <= 0) {
+            return;   // every drain closes the window already
+        }
+    }
+    if (CanAcceptTelemetry() && BufferFunctionAggregates(false, true)) {
+        ScheduleSend();
+    }
+}
+
+// Windows only reach the sink when a function window drains, so an idle or
+// event-only process would leave its counters (queue depth, drops) stale.
+void PostHogTelemetry::RefreshWindowSink()
+{
+    TelemetryWindowSink sink;
+    {
+        std::lock_guard<std::mutex> t(_thread_lock);
+        if (!_window_sink || !_capture_open.load(std::memory_order_relaxed)) {
+            return;
+        }
+        sink = _window_sink;
+    }
+    TelemetryStats pipeline;
+    FillPipelineStats(pipeline);
+    sink({}, pipeline);
+}
+
+void PostHogTelemetry::FillPipelineStats(TelemetryStats& stats)
+{
+    {
+        std::lock_guard<std::mutex> t(_thread_lock);
+        stats.worker_running = static_cast<bool>(_queue);
+        stats.memory_limit_bytes = _memory_limit_bytes;
+        stats.memory_pressure_avg10 = _memory_pressure_avg10;
+        stats.category_mask = _category_mask;
+    }
+    {
+        std::lock_guard<std::mutex> b(_batch_lock);
+        stats.queue_depth = _pending.size();
+    }
+    stats.dropped_buffer_full         = _dropped_buffer_full.load(std::memory_order_relaxed);
+    stats.dropped_untracked_functions = _dropped_untracked_functions.load(std::memory_order_relaxed);
+    stats.sampled_out_calls           = _sampled_out_calls.load(std::memory_order_relaxed);
+    stats.suppressed_aggregates       = _suppressed_aggregates.load(std::memory_order_relaxed);
+    stats.dropped_remote_config       = _dropped_remote_config.load(std::memory_order_relaxed);
+    stats.budget_shrinks              = _budget_shrinks.load(std::memory_order_relaxed);
+    stats.governor_level              = static_cast<uint64_t>(_governor_level.load(std::memory_order_relaxed));
+    stats.cpu_usage_ppm               = _cpu_usage_ppm.load(std::memory_order_relaxed);
+    stats.governor_shed_events        = _governor_shed_events.load(std::memory_order_relaxed);
+    stats.truncated_events            = _truncated_events.load(std::memory_order_relaxed);
+    stats.cardinality_violations      = _cardinality_violations.load(std::memory_order_relaxed);
+    stats.cardinality_bucketed        = _cardinality_bucketed.load(std::memory_order_relaxed);
+    stats.max_pending_events          = _max_pending_events.load(std::memory_order_relaxed);
+    stats.max_tracked_functions       = _max_tracked_functions.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(_agg_lock);
+        stats.cpu_budget_ppm = static_cast<uint64_t>(_cpu_budget * 1e6);
+    }
+}
+
+TelemetryStats PostHogTelemetry::GetStats()
+{
+    TelemetryStats stats;
+    FillPipelineStats(stats);
+
+    // Copy the window under the lock; sort/percentiles run outside it so a
+    // stats poll never stalls RecordFunctionCall for longer than a copy.
+    std::vector<FunctionAggregate> snapshot;
+    std::vector<FunctionAggregate> operators;
+    {
+        std::lock_guard<std::mutex> lock(_agg_lock);
+        snapshot.reserve(_active_functions.size());
+        for (size_t idx : _active_functions) {
+            const FunctionRecord& rec = _functions.ValueAt(idx);
+            snapshot.push_back({_functions.KeyAt(idx), rec.window, 1, rec.first_call_ms});
+        }
+        operators.reserve(_active_operators.size());
+        for (size_t idx : _active_operators) {
+            operators.push_back({_operators.KeyAt(idx), _operators.ValueAt(idx).window, 1});
+        }
+    }
+    auto summarize = [](std::vector<FunctionAggregate>& windows,
+                        std::vector<TelemetryFunctionStats>& out) {
+        std::sort(windows.begin(), windows.end(),
+                  [](const FunctionAggregate& a, const FunctionAggregate& b) {
+                      return a.name < b.name;
+                  });
+        out.reserve(windows.size());
+        for (auto& w : windows) {
+            std::vector<double>& samples = w.stat.duration_samples;
+            std::vector<uint64_t>& weights = w.stat.sample_weights;
+            SortSamples(samples, weights);
+            TelemetryFunctionStats fs;
+            fs.function_name   = w.name;
+            fs.call_count      = w.stat.count;
+            fs.duration_ms_p50 = PercentileOfSorted(samples, weights, 0.50);
+            fs.duration_ms_p95 = PercentileOfSorted(samples, weights, 0.95);
+            fs.duration_ms_p99 = PercentileOfSorted(samples, weights, 0.99);
+            fs.first_call_ms   = w.first_call_ms;
+            out.push_back(std::move(fs));
+        }
+    };
+    summarize(snapshot, stats.functions);
+    summarize(operators, stats.operators);
+    return stats;
+}
+
+std::vector<PostHogEvent> PostHogTelemetry::DrainFunctionAggregatesForTesting()
+{
+    return BuildFunctionAggregateEvents();
+}
+
+std::vector<PostHogEvent> PostHogTelemetry::CloseChangeWindowForTesting()
 {
-    auto events = BuildFunctionAggregateEvents();
-    if (events.empty()) {
-        return false;
-    }
-    for (auto& ev : events) {
-        BufferEvent(EnrichEvent(ev));
-    }
-    return true;
+    return BuildFunctionAggregateEvents(false, true);
 }
 
-void PostHogTelemetry::FlushFunctionAggregates()
+void PostHogTelemetry::RefreshWindowSinkForTesting()
 {
-    // Buffer all aggregated events, then schedule one coalesced send.
-    if (BufferFunctionAggregates()) {
-        ScheduleSend();
-    }
+    RefreshWindowSink();
 }
 
-std::vector<PostHogEvent> PostHogTelemetry::DrainFunctionAggregatesForTesting()
+std::vector<PostHogEvent> PostHogTelemetry::DrainOperatorAggregatesForTesting()
 {
-    return BuildFunctionAggregateEvents();
+    return BuildOperatorAggregateEvents();
 }
 
 
@@ -1067,6 +2909,80 @@ void PostHogTelemetry::SetEnabled(bool enabled)
 {
     std::lock_guard<std::mutex> t(_thread_lock);
     _telemetry_enabled = enabled;
+    UpdateCaptureGateLocked();
+}
+
+void PostHogTelemetry::SetCategoryMask(uint32_t mask)
+{
+    std::lock_guard<std::mutex> t(_thread_lock);
+    _category_mask = mask & kTelemetryAllCategories;
+    UpdateCaptureGateLocked();
+}
+
+uint32_t PostHogTelemetry::GetCategoryMask()
+{
+    std::lock_guard<std::mutex> t(_thread_lock);
+    return _category_mask;
+}
+
+static const std::pair<const char*, uint32_t> kCategoryNames[] = {
+    {"lifecycle", kTelemetryLifecycle}, {"feature", kTelemetryFeature},
+    {"error", kTelemetryError},         {"function", kTelemetryFunction},
+    {"group", kTelemetryGroup},         {"metric", kTelemetryMetric},
+};
+
+bool PostHogTelemetry::ParseCategoryMask(const std::string& list, uint32_t& mask)
+{
+    uint32_t parsed = 0;
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = std::min(list.find(',', pos), list.size());
+        size_t b = pos, e = comma;
+        while (b < e && std::isspace(static_cast<unsigned char>(list[b]))) b++;
+        while (e > b && std::isspace(static_cast<unsigned char>(list[e - 1]))) e--;
+        std::string name = list.substr(b, e - b);
+        for (char& c : name) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        if (name == "all") {
+            parsed |= kTelemetryAllCategories;
+        } else if (!name.empty() && name != "none") {
+            bool known = false;
+            for (auto& category : kCategoryNames) {
+                if (name == category.first) {
+                    parsed |= category.second;
+                    known = true;
+                }
+            }
+            if (!known) {
+                return false;
+            }
+        }
+        pos = comma + 1;
+    }
+    mask = parsed;
+    return true;
+}
+
+uint32_t PostHogTelemetry::CategoryOf(const std::string& event)
+{
+    if (event == "feature_used") {
+        return kTelemetryFeature;
+    }
+    if (event == "$exception") {
+        return kTelemetryError;
+    }
+    if (event == "function_executed" || event == "function_stats") {
+        return kTelemetryFunction;
+    }
+    if (event == "$groupidentify") {
+        return kTelemetryGroup;
+    }
+    if (event == "extension_loaded" || event == "extension_load" ||
+        event == "application_start" || event == "application_stop") {
+        return kTelemetryLifecycle;
+    }
+    return kTelemetryMetric;
 }
 
 std::string PostHogTelemetry::GetAPIKey()
@@ -1093,14 +3009,156 @@ std::string PostHogTelemetry::GetHost()
     return _host.empty() ? kDefaultHost : _host;
 }
 
-void PostHogTelemetry::SetTransportForTesting(
-    std::function<void(const std::string&, const std::string&,
-                       const std::vector<PostHogEvent>&)> fn)
+void PostHogTelemetry::SetTransport(TelemetryTransport fn)
 {
     std::lock_guard<std::mutex> t(_thread_lock);
     _transport = std::move(fn);
 }
 
+void PostHogTelemetry::SetWindowSink(TelemetryWindowSink fn)
+{
+    std::lock_guard<std::mutex> t(_thread_lock);
+    _window_sink = std::move(fn);
+}
+
+// Shape trace ---------------------------------------------------------------
+//
+// Line-oriented, tab-separated; every name and property key is an ordinal
+// defined once by an N line before first use:
+//
+//   N  <id>  <byte length>
+//   E  <t_us>  <thread>  <event id>  <props>     props: s<key>:<len>, j<key>:<len>,
+//                                                 i<key>, u<key>, d<key>, b<key>; - if none
+//   F  <t_us>  <thread>  <function id>  <duration_ms>  <label length | -1>
+//   B  <t_us>  <thread>  <function id>  <rows>  <total_ms>
+
+static uint32_t TraceThreadOrdinal()
+{
+    static std::atomic<uint32_t> next{0};
+    thread_local uint32_t ordinal = next.fetch_add(1, std::memory_order_relaxed);
+    return ordinal;
+}
+
+bool PostHogTelemetry::StartShapeTrace(const std::string& path)
+{
+    StopShapeTrace();
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    std::fputs("# telemetry shape trace v1\n", file);
+    std::lock_guard<std::mutex> lock(_trace_lock);
+    _trace_file = file;
+    _trace_names.clear();
+    _trace_start = std::chrono::steady_clock::now();
+    _shape_trace_on.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void PostHogTelemetry::StopShapeTrace()
+{
+    std::lock_guard<std::mutex> lock(_trace_lock);
+    _shape_trace_on.store(false, std::memory_order_relaxed);
+    if (_trace_file) {
+        std::fclose(_trace_file);
+        _trace_file = nullptr;
+    }
+    _trace_names.clear();
+}
+
+uint32_t PostHogTelemetry::TraceNameLocked(std::string_view name)
+{
+    auto it = _trace_names.find(std::string(name));
+    if (it != _trace_names.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(_trace_names.size());
+    _trace_names.emplace(std::string(name), id);
+    std::fprintf(_trace_file, "N\t%u\t%zu\n", id, name.size());
+    return id;
+}
+
+void PostHogTelemetry::TraceLinePrefixLocked(char kind)
+{
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _trace_start).count();
+    std::fprintf(_trace_file, "%c\t%lld\t%u\t", kind, static_cast<long long>(us),
+                 TraceThreadOrdinal());
+}
+
+void PostHogTelemetry::TraceEvent(const std::string& event, const PropertyMap& props)
+{
+    std::lock_guard<std::mutex> lock(_trace_lock);
+    if (!_trace_file) {
+        return;
+    }
+    // Define every ordinal before the line that uses it.
+    uint32_t event_id = TraceNameLocked(event);
+    std::string shape;
+    for (auto& kv : props) {
+        uint32_t key = TraceNameLocked(kv.first);
+        if (!shape.empty()) {
+            shape += ',';
+        }
+        switch (kv.second.kind) {
+            case PropertyValue::Kind::String: shape += 's'; break;
+            case PropertyValue::Kind::Json:   shape += 'j'; break;
+            case PropertyValue::Kind::Int:    shape += 'i'; break;
+            case PropertyValue::Kind::UInt:   shape += 'u'; break;
+            case PropertyValue::Kind::Double: shape += 'd'; break;
+            case PropertyValue::Kind::Bool:   shape += 'b'; break;
+        }
+        shape += std::to_string(key);
+        if (kv.second.kind == PropertyValue::Kind::String ||
+            kv.second.kind == PropertyValue::Kind::Json) {
+            shape += ':' + std::to_string(kv.second.s.size());
+        }
+    }
+    TraceLinePrefixLocked('E');
+    std::fprintf(_trace_file, "%u\t%s\n", event_id, shape.empty() ? "-" : shape.c_str());
+}
+
+void PostHogTelemetry::TraceFunctionCall(std::string_view name, double duration_ms,
+                                         std::string_view label)
+{
+    std::lock_guard<std::mutex> lock(_trace_lock);
+    if (!_trace_file) {
+        return;
+    }
+    uint32_t id = TraceNameLocked(name);
+    TraceLinePrefixLocked('F');
+    std::fprintf(_trace_file, "%u\t%.6g\t%lld\n", id, duration_ms,
+                 label.data() ? static_cast<long long>(label.size()) : -1LL);
+}
+
+void PostHogTelemetry::TraceFunctionCalls(std::string_view name, uint64_t rows, double total_ms)
+{
+    std::lock_guard<std::mutex> lock(_trace_lock);
+    if (!_trace_file) {
+        return;
+    }
+    uint32_t id = TraceNameLocked(name);
+    TraceLinePrefixLocked('B');
+    std::fprintf(_trace_file, "%u\t%llu\t%.6g\n", id, static_cast<unsigned long long>(rows),
+                 total_ms);
+}
+
+void PostHogTelemetry::SetEncodeParallelism(size_t max_threads)
+{
+    SetEncodeExecutor(TelemetryThreadParallelFor(max_threads));
+}
+
+void PostHogTelemetry::SetEncodeExecutor(TelemetryParallelFor parallel_for)
+{
+    std::lock_guard<std::mutex> t(_thread_lock);
+    _encode_parallel_for = std::move(parallel_for);
+}
+
+void PostHogTelemetry::SetTransportForTesting(TelemetryTransport fn)
+{
+    SetTransport(std::move(fn));
+}
+
 void PostHogTelemetry::SetAutoFlushEnabledForTesting(bool enabled)
 {
     _auto_flush.store(enabled);
@@ -1112,6 +3170,228 @@ void PostHogTelemetry::SetPromptFunctionCallsForTesting(int n)
     _prompt_function_calls = n;
 }
 
+// Remote config ------------------------------------------------------------
+
+bool PostHogTelemetry::ParseRemoteConfig(const std::string& json, TelemetryRemoteConfig& out)
+{
+    JsonValue doc;
+    if (!JsonReader::Parse(json, doc) || !doc.IsObject()) {
+        return false;
+    }
+    TelemetryRemoteConfig cfg;
+    if (const JsonValue* v = doc.Find("sampling_rate")) {
+        if (!v->IsNumber() || !(v->n >= 0.0 && v->n <= 1.0)) {
+            return false;
+        }
+        cfg.sampling_rate = v->n;
+    }
+    if (const JsonValue* v = doc.Find("disabled_events")) {
+        if (!v->IsArray()) {
+            return false;
+        }
+        for (auto& item : v->items) {
+            if (!item.IsString()) {
+                return false;
+            }
+            cfg.disabled_events.insert(item.s);
+        }
+    }
+    if (const JsonValue* v = doc.Find("rate_limits")) {
+        if (!v->IsObject()) {
+            return false;
+        }
+        for (auto& kv : v->members) {
+            if (!kv.second.IsNumber() || !(kv.second.n >= 0.0 && kv.second.n <= 1e9)) {
+                return false;
+            }
+            cfg.rate_limits[kv.first] = static_cast<uint32_t>(kv.second.n);
+        }
+    }
+    if (const JsonValue* v = doc.Find("flush_interval_ms")) {
+        // Capped so a bad push can't park events for longer than a few minutes.
+        static constexpr double kMaxFlushIntervalMs = 10 * 60 * 1000;
+        if (!v->IsNumber() || !(v->n >= 0.0 && v->n <= kMaxFlushIntervalMs)) {
+            return false;
+        }
+        cfg.flush_interval_ms = static_cast<uint32_t>(v->n);
+    }
+    out = std::move(cfg);
+    return true;
+}
+
+void PostHogTelemetry::ApplyRemoteConfig(std::shared_ptr<const TelemetryRemoteConfig> config)
+{
+    {
+        std::lock_guard<std::mutex> lock(_agg_lock);
+        _remote_sampling_rate = config ? config->sampling_rate : 1.0;
+        ApplySamplingLocked();
+    }
+    {
+        std::lock_guard<std::mutex> r(_rate_lock);
+        _rate_buckets.clear();
+    }
+    std::atomic_store(&_remote_config, std::move(config));
+}
+
+TelemetryRemoteConfig PostHogTelemetry::GetRemoteConfig()
+{
+    auto config = std::atomic_load(&_remote_config);
+    return config ? *config : TelemetryRemoteConfig();
+}
+
+// Cache file: the ETag on the first line, the verbatim document after it.
+static bool ReadRemoteConfigCache(const std::string& path, TelemetryRemoteConfig& out)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::string etag;
+    std::getline(in, etag);
+    std::string body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!PostHogTelemetry::ParseRemoteConfig(body, out)) {
+        return false;
+    }
+    out.etag = etag;
+    return true;
+}
+
+static void WriteRemoteConfigCache(const std::string& path, const std::string& etag,
+                                   const std::string& body)
+{
+    WriteFileAtomically(path, etag + '\n' + body);
+}
+
+void PostHogTelemetry::SetRemoteConfig(const std::string& url, const std::string& cache_path,
+                                       uint32_t refresh_seconds)
+{
+    {
+        std::lock_guard<std::mutex> t(_thread_lock);
+        _remote_config_url   = url;
+        _remote_config_cache = cache_path;
+        _remote_refresh_s    = std::max<uint32_t>(refresh_seconds, 1);
+        if (_queue && _remote_timer) {
+            _queue->Cancel(_remote_timer);
+        }
+        _remote_timer = 0;
+    }
+    if (url.empty()) {
+        ApplyRemoteConfig(nullptr);
+        return;
+    }
+    TelemetryRemoteConfig cached;
+    if (!cache_path.empty() && ReadRemoteConfigCache(cache_path, cached)) {
+        ApplyRemoteConfig(std::make_shared<const TelemetryRemoteConfig>(std::move(cached)));
+    }
+    std::lock_guard<std::mutex> t(_thread_lock);
+    if (!_capture_open.load(std::memory_order_relaxed)) {
+        return;
+    }
+    EnsureQueueInitialized();
+    // Fetch now, then on a periodic timer; a newer SetRemoteConfig cancels it.
+    _queue->EnqueueTask([this](int) {
+        if (CanAcceptTelemetry()) {
+            FetchRemoteConfigNow();
+        }
+    }, 0);
+    ArmRemoteRefreshLocked();
+}
+
+bool PostHogTelemetry::FetchRemoteConfigNow()
+{
+    std::string url, cache_path;
+    {
+        std::lock_guard<std::mutex> t(_thread_lock);
+        url        = _remote_config_url;
+        cache_path = _remote_config_cache;
+    }
+    if (url.empty() || IsOptedOutByEnvironment() || TelemetryDisabledByEnv()) {
+        return false;
+    }
+    // "https://host[:port]/path" -> client base + request path.
+    size_t scheme = url.find("://");
+    size_t slash  = url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    std::string base = slash == std::string::npos ? url : url.substr(0, slash);
+    std::string path = slash == std::string::npos ? "/" : url.substr(slash);
+
+    auto current = std::atomic_load(&_remote_config);
+    try {
+        duckdb_httplib_openssl::Client cli(base.c_str());
+        if (!cli.is_valid()) {
+            return false;
+        }
+        cli.set_connection_timeout(3);
+        cli.set_read_timeout(3);
+        cli.set_write_timeout(3);
+        duckdb_httplib_openssl::Headers headers;
+        if (current && !current->etag.empty()) {
+            headers.emplace("If-None-Match", current->etag);
+        }
+        auto res = cli.Get(path.c_str(), headers);
+        if (!res) {
+            return false;   // network failure: keep the last good config
+        }
+        if (res->status == 304) {
+            return true;
+        }
+        TelemetryRemoteConfig config;
+        if (res->status != 200 || !ParseRemoteConfig(res->body, config)) {
+            return false;
+        }
+        config.etag = res->get_header_value("ETag");
+        ApplyRemoteConfig(std::make_shared<const TelemetryRemoteConfig>(config));
+        if (!cache_path.empty()) {
+            WriteRemoteConfigCache(cache_path, config.etag, res->body);
+        }
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+// Capture-path gate for the remote config: one atomic load when none is set.
+// Rate limits are per-event token buckets (capacity = the per-minute limit,
+// refilled continuously), so a burst up to the limit passes and sustained
+// traffic is held to it.
+bool PostHogTelemetry::AdmitEvent(const std::string& event_name)
+{
+    auto config = std::atomic_load(&_remote_config);
+    if (!config) {
+        return true;
+    }
+    if (config->disabled_events.count(event_name) != 0) {
+        _dropped_remote_config.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    auto limit = config->rate_limits.find(event_name);
+    if (limit == config->rate_limits.end()) {
+        return true;
+    }
+    double capacity = static_cast<double>(limit->second);
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> r(_rate_lock);
+    auto it = _rate_buckets.find(event_name);
+    if (it == _rate_buckets.end()) {
+        it = _rate_buckets.emplace(event_name, RateBucket{capacity, now}).first;
+    }
+    RateBucket& bucket = it->second;
+    double elapsed_s = std::chrono::duration<double>(now - bucket.last).count();
+    bucket.tokens = std::min(capacity, bucket.tokens + elapsed_s * capacity / 60.0);
+    bucket.last = now;
+    if (bucket.tokens < 1.0) {
+        _dropped_remote_config.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    bucket.tokens -= 1.0;
+    return true;
+}
+
+void PostHogTelemetry::SetClockForTesting(std::function<std::chrono::steady_clock::time_point()> now)
+{
+    std::lock_guard<std::mutex> lock(_agg_lock);
+    _clock = std::move(now);
+}
+
 void PostHogTelemetry::Flush()
 {
     // Do nothing during teardown or after a runtime opt-out: don't enrich, don't
@@ -1123,15 +3403,23 @@ void PostHogTelemetry::Flush()
             _flush_scheduled = false;
         }
         std::lock_guard<std::mutex> a(_agg_lock);
-        _function_stats.clear();
-        _recorded_since_flush = 0;
+        ResetFunctionWindowsLocked();
         return;
     }
 
-    // Drain the aggregator into the buffer, then schedule one coalesced send and
-    // block (bounded) until the worker drains it.
-    BufferFunctionAggregates();
+    // Drain the aggregator into the buffer (forced: suppressed windows of
+    // change-triggered emission go out too), then schedule one coalesced send
+    // and block (bounded) until the worker drains it.
+    BufferFunctionAggregates(true);
     ScheduleSend();
+    {
+        // A deferred send doesn't count as drained: post an immediate drain
+        // too (the deferred one then finds nothing to do).
+        std::lock_guard<std::mutex> t(_thread_lock);
+        if (SendLingerMs() > 0 && _queue) {
+            _queue->EnqueueTask([this](int) { DrainAndSend(); }, 0);
+        }
+    }
 
     // Hold a shared_ptr copy so the queue can't be destroyed by a concurrent
     // Shutdown() while we block in DrainFor (avoids a use-after-free).
@@ -1181,8 +3469,16 @@ std::string PostHogTelemetry::GetDuckDBPlatform()
     return _duckdb_platform.empty() ? DetectPlatform() : _duckdb_platform;
 }
 
+// MAC lookups so far; identity derivation only needs one without a machine id.
+static std::atomic<uint64_t>& MacScanCounter()
+{
+    static std::atomic<uint64_t> scans{0};
+    return scans;
+}
+
 std::string PostHogTelemetry::GetMacAddressSafe()
 {
+    MacScanCounter().fetch_add(1, std::memory_order_relaxed);
     try {
         return GetMacAddress();
     } catch (std::exception &e) {
@@ -1233,9 +3529,148 @@ PostHogTelemetry::Identity PostHogTelemetry::MakeIdentity(const std::string& mac
     return { Sha256Hex(salt + ":ephemeral:" + session_id), "ephemeral" };
 }
 
+// Create every missing directory on the way to `path`'s parent.
+static void MakeParentDirectories(const std::string& path)
+{
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+        std::string dir = path.substr(0, pos);
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0700);
+#endif
+    }
+}
+
+// Cache file: one line, "<key>\t<source>\t<distinct_id>".
+static bool ReadIdentityCache(const std::string& path, const std::string& key,
+                              std::string& id, std::string& source)
+{
+    std::ifstream in(path);
+    std::string cached_key;
+    if (!(in >> cached_key >> source >> id) || cached_key != key) {
+        return false;
+    }
+    return id.size() == SHA256_DIGEST_LENGTH * 2 && (source == "machine_id" || source == "mac");
+}
+
+static void WriteIdentityCache(const std::string& path, const std::string& key,
+                               const std::string& id, const std::string& source)
+{
+    MakeParentDirectories(path);
+    WriteFileAtomically(path, key + '\t' + source + '\t' + id + '\n');
+}
+
+std::string& PostHogTelemetry::IdentityCachePathSlot()
+{
+    static std::string path;   // opt-in: a host process's home stays untouched
+    return path;
+}
+
+void PostHogTelemetry::SetIdentityCachePath(const std::string& path)
+{
+    IdentityCachePathSlot() = path;
+}
+
 PostHogTelemetry::Identity PostHogTelemetry::ComputeIdentity()
 {
-    return MakeIdentity(GetMachineId(), GetMacAddressSafe(), GetSessionId());
+    return ComputeIdentity(GetMachineId(), IdentityCachePathSlot());
+}
+
+std::string& PostHogTelemetry::HostnameSlot()
+{
+    static std::string hostname;
+    return hostname;
+}
+
+void PostHogTelemetry::SetHostnameForTesting(const std::string& hostname)
+{
+    HostnameSlot() = hostname;
+}
+
+// The host's name, or "" when it has none worth telling hosts apart by.
+static std::string GetHostnameSafe(const std::string& override_name)
+{
+    std::string name = override_name;
+    if (name.empty()) {
+#ifdef _WIN32
+        char buf[256];
+        DWORD len = sizeof(buf);
+        if (GetComputerNameA(buf, &len)) {
+            name.assign(buf, len);
+        }
+#else
+        char buf[256] = {};
+        if (gethostname(buf, sizeof(buf) - 1) == 0) {
+            name = buf;
+        }
+#endif
+    }
+    if (name == "localhost" || name == "localhost.localdomain") {
+        return "";
+    }
+    return name;
+}
+
+// Same result as MakeIdentity(machine_id, GetMacAddressSafe(), GetSessionId()),
+// but each fallback is only consulted when the sources before it carry no
+// entropy: the MAC lookup scans every interface (thousands of veth devices on
+// a Kubernetes node). A machine id is hashed directly; reading a cache would
+// cost more than the one SHA-256. Without one, a MAC-derived id is cached
+// (when SetIdentityCachePath set a file) under a hash of the hostname, so
+// later starts skip the scan: a home directory shared between hosts (NFS, a
+// baked-in container image) must not hand one host's id to all of them, so
+// with no usable hostname nothing is cached. Ephemeral ids are per-process and
+// never cached.
+PostHogTelemetry::Identity PostHogTelemetry::ComputeIdentity(const std::string& machine_id,
+                                                             const std::string& cache_path)
+{
+    if (!CarriesNoEntropy(machine_id)) {
+        return MakeIdentity(machine_id, "", "");
+    }
+    std::string key;
+    Identity identity;
+    if (!cache_path.empty()) {
+        std::string host = GetHostnameSafe(HostnameSlot());
+        if (!host.empty()) {
+            key = Sha256Hex(std::string(kIdentitySalt) + ":cache:host:" + host);
+        }
+    }
+    if (!key.empty() && ReadIdentityCache(cache_path, key, identity.id, identity.source)) {
+        return identity;
+    }
+    std::string mac = GetMacAddressSafe();
+    if (CarriesNoEntropy(mac)) {
+        return MakeIdentity("", "", GetSessionId());
+    }
+    identity = MakeIdentity("", mac, "");
+    if (!key.empty()) {
+        WriteIdentityCache(cache_path, key, identity.id, identity.source);
+    }
+    return identity;
+}
+
+std::pair<std::string, std::string> PostHogTelemetry::ComputeIdentityForTesting(
+    const std::string& machine_id, const std::string& cache_path)
+{
+    Identity ident = ComputeIdentity(machine_id, cache_path);
+    return { ident.id, ident.source };
+}
+
+std::string& PostHogTelemetry::SysfsRootSlot()
+{
+    static std::string root = "/sys";
+    return root;
+}
+
+void PostHogTelemetry::SetSysfsRootForTesting(const std::string& root)
+{
+    SysfsRootSlot() = root;
+}
+
+uint64_t PostHogTelemetry::MacScansForTesting()
+{
+    return MacScanCounter().load(std::memory_order_relaxed);
 }
 
 const PostHogTelemetry::Identity& PostHogTelemetry::GetIdentity()
@@ -1281,7 +3716,7 @@ std::string PostHogTelemetry::GetMacAddress()
         return "00:00:00:00:00:00";
     }
 
-    std::ifstream file(FormatStr("/sys/class/net/%s/address", device.c_str()));
+    std::ifstream file(FormatStr("%s/class/net/%s/address", SysfsRootSlot().c_str(), device.c_str()));
 
     std::string mac_address;
     if (file >> mac_address) {
@@ -1292,15 +3727,16 @@ std::string PostHogTelemetry::GetMacAddress()
 }
 
 bool PostHogTelemetry::IsPhysicalDevice(const std::string& device) {
-    std::string path = FormatStr("/sys/class/net/%s/device/driver", device.c_str());
+    std::string path = FormatStr("%s/class/net/%s/device/driver", SysfsRootSlot().c_str(), device.c_str());
     return access(path.c_str(), F_OK) != -1;
 }
 
 std::string PostHogTelemetry::FindFirstPhysicalDevice()
 {
-    DIR* dir = opendir("/sys/class/net");
+    std::string net = SysfsRootSlot() + "/class/net";
+    DIR* dir = opendir(net.c_str());
     if (!dir) {
-        throw std::runtime_error("Could not open /sys/class/net");
+        throw std::runtime_error("Could not open " + net);
     }
 
     std::vector<std::string> devices;
@@ -0,0 +1,107 @@
+#include "telemetry_duckdb.hpp"
+
+#include "duckdb.hpp"
+#include "duckdb/function/table_function.hpp"
+#include "duckdb/main/extension/extension_loader.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace duckdb {
+
+namespace {
+
+// One output row of telemetry_stats(); percentiles are NULL for pipeline rows.
+struct TelemetryStatsRow {
+    std::string kind;
+    std::string name;
+    uint64_t value;
+    bool has_percentiles;
+    double p50, p95, p99;
+};
+
+struct TelemetryStatsGlobalState : public GlobalTableFunctionState {
+    std::vector<TelemetryStatsRow> rows;
+    idx_t offset = 0;
+};
+
+unique_ptr<FunctionData> TelemetryStatsBind(ClientContext &, TableFunctionBindInput &,
+                                            vector<LogicalType> &return_types,
+                                            vector<string> &names)
+{
+    names = {"kind", "name", "value", "p50_ms", "p95_ms", "p99_ms"};
+    return_types = {LogicalType::VARCHAR, LogicalType::VARCHAR, LogicalType::UBIGINT,
+                    LogicalType::DOUBLE,  LogicalType::DOUBLE,  LogicalType::DOUBLE};
+    return make_uniq<TableFunctionData>();
+}
+
+// Snapshot once per scan so every row of one query sees the same instant.
+unique_ptr<GlobalTableFunctionState> TelemetryStatsInit(ClientContext &, TableFunctionInitInput &)
+{
+    auto state = make_uniq<TelemetryStatsGlobalState>();
+    TelemetryStats stats = PostHogTelemetry::Instance().GetStats();
+
+    auto pipeline = [&](const char *name, uint64_t value) {
+        state->rows.push_back({"pipeline", name, value, false, 0, 0, 0});
+    };
+    pipeline("worker_running", stats.worker_running ? 1 : 0);
+    pipeline("queue_depth", stats.queue_depth);
+    pipeline("dropped_buffer_full", stats.dropped_buffer_full);
+    pipeline("dropped_untracked_functions", stats.dropped_untracked_functions);
+    pipeline("sampled_out_calls", stats.sampled_out_calls);
+    pipeline("suppressed_aggregates", stats.suppressed_aggregates);
+    pipeline("dropped_remote_config", stats.dropped_remote_config);
+    pipeline("memory_limit_bytes", stats.memory_limit_bytes);
+    pipeline("max_pending_events", stats.max_pending_events);
+    pipeline("max_tracked_functions", stats.max_tracked_functions);
+    pipeline("budget_shrinks", stats.budget_shrinks);
+    pipeline("governor_level", stats.governor_level);
+    pipeline("cpu_usage_ppm", stats.cpu_usage_ppm);
+    pipeline("cpu_budget_ppm", stats.cpu_budget_ppm);
+    pipeline("governor_shed_events", stats.governor_shed_events);
+    pipeline("truncated_events", stats.truncated_events);
+    pipeline("category_mask", stats.category_mask);
+    pipeline("cardinality_violations", stats.cardinality_violations);
+    pipeline("cardinality_bucketed", stats.cardinality_bucketed);
+
+    for (auto &fn : stats.functions) {
+        state->rows.push_back({"function", fn.function_name, fn.call_count, true,
+                               fn.duration_ms_p50, fn.duration_ms_p95, fn.duration_ms_p99});
+    }
+    for (auto &op : stats.operators) {
+        state->rows.push_back({"operator", op.function_name, op.call_count, true,
+                               op.duration_ms_p50, op.duration_ms_p95, op.duration_ms_p99});
+    }
+    return std::move(state);
+}
+
+void TelemetryStatsScan(ClientContext &, TableFunctionInput &data, DataChunk &output)
+{
+    auto &state = data.global_state->Cast<TelemetryStatsGlobalState>();
+    idx_t count = 0;
+    while (state.offset < state.rows.size() && count < STANDARD_VECTOR_SIZE) {
+        const TelemetryStatsRow &row = state.rows[state.offset++];
+        output.SetValue(0, count, Value(row.kind));
+        output.SetValue(1, count, Value(row.name));
+        output.SetValue(2, count, Value::UBIGINT(row.value));
+        for (idx_t col = 3; col < 6; col++) {
+            double v = col == 3 ? row.p50 : (col == 4 ? row.p95 : row.p99);
+            output.SetValue(col, count, row.has_percentiles ? Value::DOUBLE(v)
+                                                            : Value(LogicalType::DOUBLE));
+        }
+        count++;
+    }
+    output.SetCardinality(count);
+}
+
+} // namespace
+
+void RegisterTelemetryStatsFunction(ExtensionLoader &loader)
+{
+    TableFunction fn("telemetry_stats", {}, TelemetryStatsScan, TelemetryStatsBind,
+                     TelemetryStatsInit);
+    loader.RegisterFunction(fn);
+}
+
+} // namespace duckdb
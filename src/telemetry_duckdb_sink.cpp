@@ -0,0 +1,207 @@
+#include "telemetry_duckdb.hpp"
+
+#include "duckdb.hpp"
+#include "duckdb/common/types/date.hpp"
+#include "duckdb/common/types/time.hpp"
+#include "duckdb/common/types/timestamp.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace duckdb {
+
+namespace {
+
+// Envelope keys stored as typed VARCHAR columns, in column order after
+// (timestamp, event, distinct_id). Anything not listed here — including
+// $groups and every event-specific property — goes into `properties`.
+struct StringColumn {
+    const char *property;
+    const char *column;
+};
+const StringColumn kStringColumns[] = {
+    {"$session_id", "session_id"},
+    {"product", "product"},
+    {"product_version", "product_version"},
+    {"product_edition", "product_edition"},
+    {"duckdb_version", "duckdb_version"},
+    {"os", "os"},
+    {"arch", "arch"},
+    {"platform", "platform"},
+    {"identity_source", "identity_source"},
+};
+
+bool IsColumnProperty(const std::string &key)
+{
+    for (auto &c : kStringColumns) {
+        if (key == c.property) {
+            return true;
+        }
+    }
+    return key == "is_ci" || key == "is_container" || key == "telemetry_schema";
+}
+
+std::string QuoteIdentifier(const std::string &name)
+{
+    std::string out = "\"";
+    for (char c : name) {
+        out += c;
+        if (c == '"') {
+            out += '"';
+        }
+    }
+    return out + "\"";
+}
+
+// The library stamps "YYYY-MM-DDTHH:MM:SSZ" (UTC). Parsed by hand so the hot
+// append loop stays on typed values instead of per-row string casts.
+bool ParseEventTimestamp(const std::string &ts, timestamp_t &out)
+{
+    int y, mo, d, h, mi, s;
+    if (std::sscanf(ts.c_str(), "%d-%d-%dT%d:%d:%d", &y, &mo, &d, &h, &mi, &s) != 6) {
+        return false;
+    }
+    out = Timestamp::FromDatetime(Date::FromDate(y, mo, d), Time::FromTime(h, mi, s, 0));
+    return true;
+}
+
+void AppendString(Appender &appender, const std::string &s)
+{
+    appender.Append(string_t(s.data(), static_cast<uint32_t>(s.size())));
+}
+
+} // namespace
+
+DuckDBEventSink::DuckDBEventSink(const std::string &database_path, const std::string &table)
+    : _owned_db(new DuckDB(database_path)), _con(new Connection(*_owned_db)), _table(table)
+{
+    CreateTable();
+}
+
+DuckDBEventSink::DuckDBEventSink(DuckDB &database, const std::string &table)
+    : _con(new Connection(database)), _table(table)
+{
+    CreateTable();
+}
+
+// Out of line so the unique_ptrs can delete the (here complete) DuckDB types.
+DuckDBEventSink::~DuckDBEventSink() = default;
+
+void DuckDBEventSink::CreateTable()
+{
+    std::string columns = "timestamp TIMESTAMP, event VARCHAR, distinct_id VARCHAR";
+    for (auto &c : kStringColumns) {
+        columns += ", ";
+        columns += c.column;
+        columns += " VARCHAR";
+    }
+    columns += ", is_ci BOOLEAN, is_container BOOLEAN, telemetry_schema INTEGER";
+
+    const std::string create = "CREATE TABLE IF NOT EXISTS " + QuoteIdentifier(_table) +
+                               " (" + columns + ", properties ";
+    // JSON needs the json extension (bundled in every stock DuckDB build); fall
+    // back to VARCHAR so minimal builds still work — json_extract accepts both.
+    auto result = _con->Query(create + "JSON)");
+    if (result->HasError()) {
+        _con->Query(create + "VARCHAR)");
+    }
+}
+
+bool DuckDBEventSink::Write(const std::vector<PostHogEvent> &events)
+{
+    if (events.empty()) {
+        return true;
+    }
+    std::lock_guard<std::mutex> guard(_lock);
+    try {
+        // One Appender for the sink's lifetime: opening one resolves the table
+        // and allocates its chunk buffers, which a small batch can't amortise.
+        if (!_appender) {
+            _appender.reset(new Appender(*_con, _table));
+        }
+        Appender &appender = *_appender;
+        std::string props;
+        for (const PostHogEvent &e : events) {
+            appender.BeginRow();
+
+            timestamp_t ts;
+            if (ParseEventTimestamp(e.timestamp, ts)) {
+                appender.Append(ts);
+            } else {
+                appender.Append(nullptr);
+            }
+            AppendString(appender, e.event_name);
+            AppendString(appender, e.distinct_id);
+
+            for (auto &c : kStringColumns) {
+                auto it = e.properties.find(c.property);
+                if (it != e.properties.end() && it->second.kind == PropertyValue::Kind::String) {
+                    AppendString(appender, it->second.s);
+                } else {
+                    appender.Append(nullptr);
+                }
+            }
+            for (const char *key : {"is_ci", "is_container"}) {
+                auto it = e.properties.find(key);
+                if (it != e.properties.end() && it->second.kind == PropertyValue::Kind::Bool) {
+                    appender.Append(it->second.b);
+                } else {
+                    appender.Append(nullptr);
+                }
+            }
+            auto schema = e.properties.find("telemetry_schema");
+            if (schema != e.properties.end() && schema->second.kind == PropertyValue::Kind::Int) {
+                appender.Append(static_cast<int32_t>(schema->second.i));
+            } else {
+                appender.Append(nullptr);
+            }
+
+            // Remaining properties as one JSON object (same serialisation as
+            // the PostHog payload, minus the columns above).
+            props = "{";
+            for (auto &kv : e.properties) {
+                if (IsColumnProperty(kv.first)) {
+                    continue;
+                }
+                if (props.size() > 1) {
+                    props += ",";
+                }
+                props += PropertyValue(kv.first).ToJson();
+                props += ":";
+                props += kv.second.ToJson();
+            }
+            props += "}";
+            AppendString(appender, props);
+
+            appender.EndRow();
+        }
+        appender.Flush();   // the batch is queryable once Write returns
+        return true;
+    } catch (std::exception &) {
+        // Drop the failed batch (a half-appended row included) and close now:
+        // the Appender's destructor would try to flush what it still holds.
+        // The next batch reopens.
+        if (_appender) {
+            try {
+                _appender->Clear();
+                _appender->Close();
+            } catch (std::exception &) {
+            }
+            _appender.reset();
+        }
+        return false;
+    }
+}
+
+void UseDuckDBEventSink(std::shared_ptr<DuckDBEventSink> sink)
+{
+    PostHogTelemetry::Instance().SetTransport(
+        [sink](const std::string &, const std::string &, const std::vector<PostHogEvent> &events) {
+            sink->Write(events);
+        });
+}
+
+} // namespace duckdb
@@ -0,0 +1,52 @@
+#pragma once
+
+// Whole-file replacement for the small files the library keeps on disk
+// (remote-config and identity caches, the Prometheus textfile).
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+
+namespace duckdb {
+
+// Write `contents` to a temporary file next to `path`, then rename it over
+// `path`, so a crash or a concurrent reader never sees a torn file. Each write
+// gets its own temporary name, so concurrent writers (another thread, another
+// process sharing the cache directory) never rename each other's half-written
+// file. Windows refuses to rename over an existing file, so there the target
+// is removed and the rename retried. Returns false (and leaves no temporary
+// behind) when nothing was written.
+inline bool WriteFileAtomically(const std::string &path, const std::string &contents)
+{
+    static std::atomic<uint64_t> counter {0};
+    std::string tmp = path + ".tmp." + std::to_string(std::random_device {}()) + "." +
+                      std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << contents;
+        out.close();
+        if (!out) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+#ifdef _WIN32
+        std::remove(path.c_str());
+        if (std::rename(tmp.c_str(), path.c_str()) == 0) {
+            return true;
+        }
+#endif
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace duckdb
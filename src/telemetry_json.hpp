@@ -0,0 +1,295 @@
+#pragma once
+
+// Minimal JSON reader for the small documents the library consumes (remote
+// config, profiler output). Not a general-purpose parser: no streaming, and
+// nesting is capped so a hostile document can't exhaust the stack. Emitting
+// JSON stays with PropertyValue / EscapeJsonString in telemetry.cpp.
+
+#include <cstdint>
+#include <locale>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace duckdb {
+
+struct JsonValue {
+    enum class Kind { Null, Bool, Number, String, Array, Object };
+    Kind kind = Kind::Null;
+    bool b = false;
+    double n = 0;
+    std::string s;
+    std::vector<JsonValue> items;               // Array
+    std::map<std::string, JsonValue> members;   // Object (duplicate keys: last wins)
+
+    bool IsObject() const { return kind == Kind::Object; }
+    bool IsArray() const { return kind == Kind::Array; }
+    bool IsString() const { return kind == Kind::String; }
+    bool IsNumber() const { return kind == Kind::Number; }
+
+    // Member lookup; nullptr when absent or when this is not an object.
+    const JsonValue* Find(const std::string& key) const {
+        if (kind != Kind::Object) {
+            return nullptr;
+        }
+        auto it = members.find(key);
+        return it == members.end() ? nullptr : &it->second;
+    }
+};
+
+class JsonReader {
+public:
+    // Parse a complete document. Returns false on malformed input, trailing
+    // garbage or nesting deeper than `max_depth`; `out` is only meaningful on
+    // success.
+    static bool Parse(const std::string& text, JsonValue& out, int max_depth = kMaxDepth) {
+        JsonReader r(text, max_depth);
+        r.SkipWs();
+        if (!r.ParseValue(out, 0)) {
+            return false;
+        }
+        r.SkipWs();
+        return r._pos == r._text.size();
+    }
+
+private:
+    static constexpr int kMaxDepth = 64;
+
+    JsonReader(const std::string& text, int max_depth) : _text(text), _max_depth(max_depth) {}
+
+    void SkipWs() {
+        while (_pos < _text.size() &&
+               (_text[_pos] == ' ' || _text[_pos] == '\t' || _text[_pos] == '\n' || _text[_pos] == '\r')) {
+            _pos++;
+        }
+    }
+
+    bool Consume(char c) {
+        if (_pos < _text.size() && _text[_pos] == c) {
+            _pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool Literal(const char* lit) {
+        size_t i = 0;
+        for (; lit[i]; i++) {
+            if (_pos + i >= _text.size() || _text[_pos + i] != lit[i]) {
+                return false;
+            }
+        }
+        _pos += i;
+        return true;
+    }
+
+    bool ParseValue(JsonValue& out, int depth) {
+        if (depth > _max_depth || _pos >= _text.size()) {
+            return false;
+        }
+        char c = _text[_pos];
+        if (c == '{') {
+            return ParseObject(out, depth);
+        }
+        if (c == '[') {
+            return ParseArray(out, depth);
+        }
+        if (c == '"') {
+            out.kind = JsonValue::Kind::String;
+            return ParseString(out.s);
+        }
+        if (c == 't' || c == 'f') {
+            out.kind = JsonValue::Kind::Bool;
+            out.b = (c == 't');
+            return Literal(out.b ? "true" : "false");
+        }
+        if (c == 'n') {
+            out.kind = JsonValue::Kind::Null;
+            return Literal("null");
+        }
+        return ParseNumber(out);
+    }
+
+    bool ParseObject(JsonValue& out, int depth) {
+        out.kind = JsonValue::Kind::Object;
+        _pos++;  // '{'
+        SkipWs();
+        if (Consume('}')) {
+            return true;
+        }
+        while (true) {
+            SkipWs();
+            std::string key;
+            if (_pos >= _text.size() || _text[_pos] != '"' || !ParseString(key)) {
+                return false;
+            }
+            SkipWs();
+            if (!Consume(':')) {
+                return false;
+            }
+            SkipWs();
+            JsonValue v;
+            if (!ParseValue(v, depth + 1)) {
+                return false;
+            }
+            out.members[key] = std::move(v);
+            SkipWs();
+            if (Consume('}')) {
+                return true;
+            }
+            if (!Consume(',')) {
+                return false;
+            }
+        }
+    }
+
+    bool ParseArray(JsonValue& out, int depth) {
+        out.kind = JsonValue::Kind::Array;
+        _pos++;  // '['
+        SkipWs();
+        if (Consume(']')) {
+            return true;
+        }
+        while (true) {
+            SkipWs();
+            JsonValue v;
+            if (!ParseValue(v, depth + 1)) {
+                return false;
+            }
+            out.items.push_back(std::move(v));
+            SkipWs();
+            if (Consume(']')) {
+                return true;
+            }
+            if (!Consume(',')) {
+                return false;
+            }
+        }
+    }
+
+    bool ParseHex4(uint32_t& cp) {
+        if (_pos + 4 > _text.size()) {
+            return false;
+        }
+        cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char h = _text[_pos++];
+            cp <<= 4;
+            if (h >= '0' && h <= '9') cp |= static_cast<uint32_t>(h - '0');
+            else if (h >= 'a' && h <= 'f') cp |= static_cast<uint32_t>(h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') cp |= static_cast<uint32_t>(h - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void AppendUtf8(std::string& s, uint32_t cp) {
+        if (cp < 0x80) {
+            s += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            s += static_cast<char>(0xC0 | (cp >> 6));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            s += static_cast<char>(0xE0 | (cp >> 12));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            s += static_cast<char>(0xF0 | (cp >> 18));
+            s += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool ParseString(std::string& out) {
+        _pos++;  // opening quote
+        while (_pos < _text.size()) {
+            char c = _text[_pos++];
+            if (c == '"') {
+                return true;
+            }
+            if (static_cast<unsigned char>(c) < 0x20) {
+                return false;  // raw control characters are not allowed
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (_pos >= _text.size()) {
+                return false;
+            }
+            char e = _text[_pos++];
+            switch (e) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!ParseHex4(cp)) {
+                    return false;
+                }
+                // Surrogate pair -> one code point; a lone surrogate becomes U+FFFD.
+                if (cp >= 0xD800 && cp <= 0xDBFF && _pos + 1 < _text.size() &&
+                    _text[_pos] == '\\' && _text[_pos + 1] == 'u') {
+                    size_t save = _pos;
+                    _pos += 2;
+                    uint32_t lo;
+                    if (ParseHex4(lo) && lo >= 0xDC00 && lo <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    } else {
+                        _pos = save;
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;
+                }
+                AppendUtf8(out, cp);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;  // unterminated
+    }
+
+    bool ParseNumber(JsonValue& out) {
+        size_t start = _pos;
+        if (_pos < _text.size() && _text[_pos] == '-') _pos++;
+        bool digits = false;
+        while (_pos < _text.size() && _text[_pos] >= '0' && _text[_pos] <= '9') { _pos++; digits = true; }
+        if (_pos < _text.size() && _text[_pos] == '.') {
+            _pos++;
+            while (_pos < _text.size() && _text[_pos] >= '0' && _text[_pos] <= '9') _pos++;
+        }
+        if (_pos < _text.size() && (_text[_pos] == 'e' || _text[_pos] == 'E')) {
+            _pos++;
+            if (_pos < _text.size() && (_text[_pos] == '+' || _text[_pos] == '-')) _pos++;
+            while (_pos < _text.size() && _text[_pos] >= '0' && _text[_pos] <= '9') _pos++;
+        }
+        if (!digits) {
+            return false;
+        }
+        // strtod follows LC_NUMERIC, so a comma-decimal host would read 0.1
+        // as 0; JSON numbers always use '.'.
+        std::istringstream in(_text.substr(start, _pos - start));
+        in.imbue(std::locale::classic());
+        double n = 0;
+        in >> n;
+        out.kind = JsonValue::Kind::Number;
+        out.n = n;
+        return true;
+    }
+
+    const std::string& _text;
+    int _max_depth;
+    size_t _pos = 0;
+};
+
+} // namespace duckdb
@@ -0,0 +1,22 @@
+#pragma once
+
+// Linux USDT (static tracepoint) probes at the pipeline stages. Compiled in only
+// when the build defines POSTHOG_TELEMETRY_USDT (CMake option of the same name);
+// otherwise every probe expands to nothing and its arguments are not evaluated.
+// With probes compiled in, an unattached site is a single NOP, so they cost
+// nothing unless a tracer (bpftrace, perf, systemtap) is watching. Provider is
+// `posthog_telemetry`; probe names are the stable contract documented in the
+// README — rename only with a doc update.
+#if defined(POSTHOG_TELEMETRY_USDT) && defined(__linux__)
+
+#include <sys/sdt.h>
+
+#define TELEMETRY_PROBE1(name, a)    DTRACE_PROBE1(posthog_telemetry, name, a)
+#define TELEMETRY_PROBE2(name, a, b) DTRACE_PROBE2(posthog_telemetry, name, a, b)
+
+#else
+
+#define TELEMETRY_PROBE1(name, a)    do { } while (0)
+#define TELEMETRY_PROBE2(name, a, b) do { } while (0)
+
+#endif
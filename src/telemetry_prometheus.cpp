@@ -0,0 +1,237 @@
+#include "telemetry_prometheus.hpp"
+#include "telemetry_file.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace duckdb {
+
+namespace {
+
+// Label values escape backslash, double quote and newline (OpenMetrics).
+std::string EscapeLabel(const std::string &value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\') {
+            out += "\\\\";
+        } else if (c == '"') {
+            out += "\\\"";
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+std::string FormatDouble(double v)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", v);
+    // A comma-decimal LC_NUMERIC would write le="0,005", which scrapers
+    // reject; %g never groups, so a ',' can only be the decimal point.
+    for (char *p = buf; *p; ++p) {
+        if (*p == ',') *p = '.';
+    }
+    return buf;
+}
+
+std::string FormatCount(uint64_t v)
+{
+    return std::to_string(v);
+}
+
+// Index of the first bucket whose upper bound holds `seconds` (+Inf = last).
+size_t BucketIndex(const std::vector<double> &bounds, double seconds)
+{
+    size_t b = 0;
+    while (b < bounds.size() && seconds > bounds[b]) {
+        b++;
+    }
+    return b;
+}
+
+void AppendFamily(std::string &out, const std::string &name, const char *type, const char *help)
+{
+    out += "# TYPE " + name + " " + type + "\n";
+    out += "# HELP " + name + " " + help + "\n";
+}
+
+} // namespace
+
+const std::vector<double> &PrometheusTextfileSink::BucketBounds()
+{
+    // 100 µs .. 5 s: scalar functions sit at the low end, table functions and
+    // whole-chunk batches at the high end.
+    static const std::vector<double> bounds = {0.0001, 0.0005, 0.001, 0.005, 0.01,
+                                               0.05,   0.1,    0.5,   1,     5};
+    return bounds;
+}
+
+PrometheusTextfileSink::PrometheusTextfileSink(const std::string &path, const std::string &prefix)
+    : _path(path), _prefix(prefix)
+{
+}
+
+bool PrometheusTextfileSink::Write(const std::vector<TelemetryWindowFunction> &functions,
+                                   const TelemetryStats &pipeline)
+{
+    const std::vector<double> &bounds = BucketBounds();
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        for (const auto &fn : functions) {
+            FunctionSeries &series = _functions[fn.function_name];
+            if (series.buckets.empty()) {
+                series.buckets.assign(bounds.size() + 1, 0);
+            }
+            // Sampling recorded every 1/sample_rate-th call: scale back up to
+            // the calls made, so the counter doesn't drop with the rate.
+            uint64_t calls = fn.call_count;
+            if (fn.sample_rate > 0 && fn.sample_rate < 1) {
+                calls = static_cast<uint64_t>(
+                    std::llround(static_cast<double>(fn.call_count) / fn.sample_rate));
+            }
+            series.calls += calls;
+            if (fn.first_call_ms >= 0) {
+                series.first_call_ms = fn.first_call_ms;
+            }
+
+            // Weighted reservoir -> bucket weights. A window holding only the
+            // cold call has no reservoir; its one observation is first_call_ms.
+            std::vector<double> weight(bounds.size() + 1, 0);
+            double total = 0;
+            double weighted_ms = 0;
+            for (size_t i = 0; i < fn.duration_ms.size(); i++) {
+                double w = fn.weights.empty() ? 1.0 : static_cast<double>(fn.weights[i]);
+                weight[BucketIndex(bounds, fn.duration_ms[i] / 1000.0)] += w;
+                total += w;
+                weighted_ms += w * fn.duration_ms[i];
+            }
+            uint64_t observed = calls;
+            if (total <= 0) {
+                // Prompt-phase calls keep no reservoir either: they share the
+                // cold call's bucket.
+                if (fn.first_call_ms < 0 || calls == 0) {
+                    continue;
+                }
+                weight[BucketIndex(bounds, fn.first_call_ms / 1000.0)] = 1;
+                total = 1;
+                weighted_ms = fn.first_call_ms;
+            }
+            // Round the cumulative shares so the buckets add up to exactly
+            // `calls` observations.
+            double cumulative = 0;
+            uint64_t assigned = 0;
+            for (size_t b = 0; b < weight.size(); b++) {
+                cumulative += weight[b];
+                uint64_t upto = b + 1 == weight.size()
+                                    ? observed
+                                    : static_cast<uint64_t>(std::llround(cumulative / total *
+                                                                         static_cast<double>(observed)));
+                if (upto < assigned) {
+                    upto = assigned;
+                }
+                series.buckets[b] += upto - assigned;
+                assigned = upto;
+            }
+            series.observations += observed;
+            series.sum_seconds += weighted_ms / total * static_cast<double>(observed) / 1000.0;
+        }
+        _pipeline = pipeline;
+        _pipeline.functions.clear();
+        _pipeline.operators.clear();
+        text = RenderLocked();
+    }
+
+    // Replaced atomically, so a scrape never reads a half-written file.
+    return WriteFileAtomically(_path, text);
+}
+
+std::string PrometheusTextfileSink::Render()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    return RenderLocked();
+}
+
+std::string PrometheusTextfileSink::RenderLocked() const
+{
+    const std::vector<double> &bounds = BucketBounds();
+    std::string out;
+
+    std::string calls = _prefix + "_function_calls";
+    AppendFamily(out, calls, "counter", "Function calls, including sampled-out calls (scaled by the sample rate).");
+    for (const auto &entry : _functions) {
+        out += calls + "_total{function=\"" + EscapeLabel(entry.first) + "\"} " +
+               FormatCount(entry.second.calls) + "\n";
+    }
+
+    std::string duration = _prefix + "_function_duration_seconds";
+    AppendFamily(out, duration, "histogram", "Function call duration.");
+    for (const auto &entry : _functions) {
+        const FunctionSeries &s = entry.second;
+        std::string label = "function=\"" + EscapeLabel(entry.first) + "\"";
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < s.buckets.size(); b++) {
+            cumulative += s.buckets[b];
+            std::string le = b < bounds.size() ? FormatDouble(bounds[b]) : "+Inf";
+            out += duration + "_bucket{" + label + ",le=\"" + le + "\"} " +
+                   FormatCount(cumulative) + "\n";
+        }
+        out += duration + "_count{" + label + "} " + FormatCount(s.observations) + "\n";
+        out += duration + "_sum{" + label + "} " + FormatDouble(s.sum_seconds) + "\n";
+    }
+
+    std::string first = _prefix + "_function_first_call_seconds";
+    AppendFamily(out, first, "gauge", "Duration of the first (cold) call of each function.");
+    for (const auto &entry : _functions) {
+        if (entry.second.first_call_ms >= 0) {
+            out += first + "{function=\"" + EscapeLabel(entry.first) + "\"} " +
+                   FormatDouble(entry.second.first_call_ms / 1000.0) + "\n";
+        }
+    }
+
+    std::string dropped = _prefix + "_dropped_events";
+    AppendFamily(out, dropped, "counter", "Telemetry events and calls dropped, by reason.");
+    const std::pair<const char *, uint64_t> reasons[] = {
+        {"buffer_full", _pipeline.dropped_buffer_full},
+        {"untracked_function", _pipeline.dropped_untracked_functions},
+        {"remote_config", _pipeline.dropped_remote_config},
+        {"governor_shed", _pipeline.governor_shed_events},
+    };
+    for (const auto &r : reasons) {
+        out += dropped + "_total{reason=\"" + r.first + "\"} " + FormatCount(r.second) + "\n";
+    }
+
+    std::string sampled = _prefix + "_sampled_out_calls";
+    AppendFamily(out, sampled, "counter", "Function calls decimated by sampling.");
+    out += sampled + "_total " + FormatCount(_pipeline.sampled_out_calls) + "\n";
+
+    std::string depth = _prefix + "_queue_depth";
+    AppendFamily(out, depth, "gauge", "Events buffered awaiting a send.");
+    out += depth + " " + FormatCount(_pipeline.queue_depth) + "\n";
+
+    out += "# EOF\n";
+    return out;
+}
+
+void UsePrometheusTextfileSink(std::shared_ptr<PrometheusTextfileSink> sink)
+{
+    auto &telemetry = PostHogTelemetry::Instance();
+    telemetry.SetWindowSink([sink](const std::vector<TelemetryWindowFunction> &functions,
+                                   const TelemetryStats &pipeline) {
+        sink->Write(functions, pipeline);
+    });
+    // Batches still drain (the buffer stays bounded) but never leave the
+    // process.
+    telemetry.SetTransport([](const std::string &, const std::string &,
+                              const std::vector<PostHogEvent> &) {});
+}
+
+} // namespace duckdb
@@ -0,0 +1,138 @@
+// Tests for the DuckDB-facing helpers (telemetry_duckdb.hpp): the local sink
+// and the telemetry_stats() table function.
+#include "catch.hpp"
+#include "telemetry.hpp"
+#include "telemetry_duckdb.hpp"
+
+#include "duckdb.hpp"
+#include "duckdb/main/extension/extension_loader.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace duckdb;
+
+TEST_CASE("DuckDB sink - envelope becomes typed columns, rest is JSON", "[duckdb][sink]") {
+    auto& t = PostHogTelemetry::Instance();
+    DuckDB db(nullptr);
+    DuckDBEventSink sink(db);
+
+    std::vector<PostHogEvent> batch;
+    batch.push_back(t.BuildEventForTesting("feature_used", {{"feature", "odata_read"},
+                                                             {"duration_ms", 12.5}}));
+    batch.push_back(t.BuildEventForTesting("function_executed", {{"function_name", "sap_read"},
+                                                                  {"call_count", 42}}));
+    REQUIRE(sink.Write(batch));
+
+    Connection con(db);
+    auto count = con.Query("SELECT count(*) FROM events");
+    REQUIRE_FALSE(count->HasError());
+    REQUIRE(count->GetValue(0, 0).GetValue<int64_t>() == 2);
+
+    auto row = con.Query(
+        "SELECT event, telemetry_schema, is_ci IS NOT NULL, session_id, "
+        "       json_extract_string(properties, '$.feature'), "
+        "       CAST(json_extract(properties, '$.duration_ms') AS DOUBLE), "
+        "       timestamp IS NOT NULL "
+        "FROM events WHERE event = 'feature_used'");
+    REQUIRE_FALSE(row->HasError());
+    REQUIRE(row->RowCount() == 1);
+    REQUIRE(row->GetValue(0, 0).ToString() == "feature_used");
+    REQUIRE(row->GetValue(1, 0).GetValue<int32_t>() == 2);
+    REQUIRE(row->GetValue(2, 0).GetValue<bool>());
+    REQUIRE(row->GetValue(3, 0).ToString() == PostHogTelemetry::GetSessionId());
+    REQUIRE(row->GetValue(4, 0).ToString() == "odata_read");
+    REQUIRE(row->GetValue(5, 0).GetValue<double>() == Approx(12.5));
+    REQUIRE(row->GetValue(6, 0).GetValue<bool>());
+
+    // Envelope keys are columns, not duplicated into the JSON blob.
+    auto dup = con.Query("SELECT count(*) FROM events WHERE properties LIKE '%\"os\"%'");
+    REQUIRE(dup->GetValue(0, 0).GetValue<int64_t>() == 0);
+
+    // The sink keeps its appender open; each batch is visible once Write returns.
+    REQUIRE(sink.Write(batch));
+    auto again = con.Query("SELECT count(*) FROM events WHERE timestamp IS NOT NULL");
+    REQUIRE(again->GetValue(0, 0).GetValue<int64_t>() == 4);
+}
+
+TEST_CASE("DuckDB sink - receives batches from the pipeline", "[duckdb][sink]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.Flush();   // clear prior-test leftovers before the sink is installed
+
+    DuckDB db(nullptr);
+    UseDuckDBEventSink(std::make_shared<DuckDBEventSink>(db, "telemetry_events"));
+
+    for (int i = 0; i < 100; i++) t.CaptureFeature("sink_feature", {});
+    t.Flush();
+
+    Connection con(db);
+    auto result = con.Query("SELECT count(*) FROM telemetry_events WHERE event = 'feature_used'");
+    REQUIRE_FALSE(result->HasError());
+    REQUIRE(result->GetValue(0, 0).GetValue<int64_t>() == 100);
+
+    t.SetTransport({});
+}
+
+TEST_CASE("telemetry_stats() - reports the live window without draining it", "[duckdb][stats]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+
+    DuckDB db(nullptr);
+    ExtensionLoader loader(*db.instance, "telemetry_test");
+    RegisterTelemetryStatsFunction(loader);
+    Connection con(db);
+
+    for (int i = 0; i < 3; i++) t.RecordFunctionCall("stats_sql_fn", 2.0);
+
+    const std::string fn_query =
+        "SELECT value, p50_ms FROM telemetry_stats() WHERE kind = 'function' AND name = 'stats_sql_fn'";
+    for (int scan = 0; scan < 2; scan++) {   // a second scan still sees the window
+        auto fn = con.Query(fn_query);
+        REQUIRE_FALSE(fn->HasError());
+        REQUIRE(fn->RowCount() == 1);
+        REQUIRE(fn->GetValue(0, 0).GetValue<uint64_t>() == 3);
+        REQUIRE(fn->GetValue(1, 0).GetValue<double>() == Approx(2.0));
+    }
+
+    // The whole table, as an operator would first look at it.
+    auto all = con.Query("SELECT * FROM telemetry_stats()");
+    REQUIRE_FALSE(all->HasError());
+    REQUIRE(all->ColumnCount() == 6);
+    const std::vector<std::string> columns = {"kind", "name", "value", "p50_ms", "p95_ms", "p99_ms"};
+    for (size_t c = 0; c < columns.size(); c++) {
+        REQUIRE(all->ColumnName(c) == columns[c]);
+    }
+    bool fn_row = false, pipeline_row = false;
+    for (idx_t r = 0; r < all->RowCount(); r++) {
+        std::string kind = all->GetValue(0, r).ToString();
+        if (kind == "function" && all->GetValue(1, r).ToString() == "stats_sql_fn") {
+            fn_row = true;
+            REQUIRE(all->GetValue(2, r).GetValue<uint64_t>() == 3);
+            REQUIRE(all->GetValue(4, r).GetValue<double>() == Approx(2.0));
+        } else if (kind == "pipeline") {
+            pipeline_row = true;
+            REQUIRE(all->GetValue(3, r).IsNull());   // no percentiles for counters
+        }
+    }
+    REQUIRE(fn_row);
+    REQUIRE(pipeline_row);
+
+    auto pipeline = con.Query(
+        "SELECT value FROM telemetry_stats() WHERE kind = 'pipeline' AND name = 'dropped_buffer_full'");
+    REQUIRE_FALSE(pipeline->HasError());
+    REQUIRE(pipeline->RowCount() == 1);
+    REQUIRE(pipeline->GetValue(0, 0).GetValue<uint64_t>() == t.GetStats().dropped_buffer_full);
+
+    // The aggregator still holds every call the scans reported.
+    int64_t drained = 0;
+    for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+        if (e.properties.at("function_name").s == "stats_sql_fn") {
+            drained = e.properties.at("call_count").i;
+        }
+    }
+    REQUIRE(drained == 3);
+}
@@ -11,14 +11,25 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <future>
+#include <iterator>
 #include <limits>
 #include <map>
 #include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
 
+#ifndef _WIN32
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 using namespace duckdb;
 
 namespace {
@@ -256,6 +267,76 @@ TEST_CASE("Cardinality guard - long property values are clamped", "[envelope][ca
     REQUIRE_FALSE(Contains(json, huge));
 }
 
+TEST_CASE("Cardinality guard - an event is trimmed to the byte budget", "[envelope][cardinality]") {
+    auto& t = PostHogTelemetry::Instance();
+    uint64_t truncated = t.GetStats().truncated_events;
+
+    // 10,000 properties: far past the default 64 KiB budget.
+    PropertyMap props;
+    for (int i = 0; i < 10000; i++) {
+        props["key_" + std::to_string(i)] = "value_" + std::to_string(i);
+    }
+    props["big"] = std::string(500, 'b');          // largest caller value goes first
+    PostHogEvent ev = t.BuildEventForTesting("feature_used", props);
+    std::string json = ev.GetPropertiesJson();
+    REQUIRE(json.size() <= 64 * 1024);
+    REQUIRE(ev.properties.count("properties_truncated") == 1);
+    int64_t dropped = ev.properties.at("properties_truncated").i;
+    REQUIRE(dropped > 0);
+    // Envelope kept; dropped + kept caller properties account for all of them.
+    REQUIRE(ev.properties.count("product") == 1);
+    REQUIRE(ev.properties.count("$session_id") == 1);
+    REQUIRE(ev.properties.count("big") == 0);
+    size_t kept = 0;
+    for (auto& kv : ev.properties) {
+        if (kv.first.compare(0, 4, "key_") == 0) kept++;
+    }
+    REQUIRE(kept + static_cast<size_t>(dropped) == 10001);
+    REQUIRE(t.GetStats().truncated_events == truncated + 1);
+
+    // Under budget: untouched, no marker, no count.
+    PostHogEvent small = t.BuildEventForTesting("feature_used", {{"feature", "x"}});
+    REQUIRE(small.properties.count("properties_truncated") == 0);
+    REQUIRE(t.GetStats().truncated_events == truncated + 1);
+
+    // A tighter budget keeps smaller values over larger ones.
+    t.SetMaxEventBytes(1024);
+    PostHogEvent tight = t.BuildEventForTesting("feature_used", {{"a", std::string(400, 'a')},
+                                                                 {"b", "short"},
+                                                                 {"c", std::string(300, 'c')}});
+    REQUIRE(tight.GetPropertiesJson().size() <= 1024);
+    REQUIRE(tight.properties.count("b") == 1);
+    REQUIRE(tight.properties.count("a") == 0);
+    t.SetMaxEventBytes(64 * 1024);
+}
+
+TEST_CASE("Packed stats - function_stats events split to fit the byte budget", "[aggregation][packed]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+    t.SetPackedFunctionStats(true);
+    t.SetMaxEventBytes(8 * 1024);
+
+    for (int i = 0; i < 300; i++) {
+        t.RecordFunctionCall("packed_budget_fn_" + std::to_string(i), 1.0);
+    }
+    auto events = t.DrainFunctionAggregatesForTesting();
+    REQUIRE(events.size() > 1);
+    int64_t functions = 0;
+    for (auto& ev : events) {
+        REQUIRE(ev.event_name == "function_stats");
+        REQUIRE(ev.properties.at("functions").s.size() <= 4 * 1024);
+        functions += ev.properties.at("function_count").i;
+        PostHogEvent enriched = t.BuildEventForTesting(ev.event_name, ev.properties);
+        REQUIRE(enriched.properties.count("properties_truncated") == 0);
+    }
+    REQUIRE(functions == 300);
+
+    t.SetMaxEventBytes(64 * 1024);
+    t.SetPackedFunctionStats(false);
+}
+
 TEST_CASE("Aggregation - 1e6 calls collapse to O(#functions) events", "[aggregation]") {
     auto& t = PostHogTelemetry::Instance();
     t.SetEnabled(true);
@@ -975,6 +1056,69 @@ TEST_CASE("Identity - validity gate never produces a colliding constant", "[iden
     REQUIRE(T::MakeIdentityForTesting("", "", "s").second == "ephemeral");
 }
 
+TEST_CASE("Identity - fallbacks are lazy and stable ids are cached per host", "[identity]") {
+    using T = PostHogTelemetry;
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / "telemetry_identity_test";
+    fs::remove_all(dir);
+    fs::path net = dir / "sys" / "class" / "net";
+    fs::create_directories(net / "veth0");                     // virtual: no device/driver
+    fs::create_directories(net / "zz0" / "device");
+    std::ofstream(net / "zz0" / "device" / "driver") << "e1000\n";
+    std::ofstream(net / "zz0" / "address") << "aa:bb:cc:00:11:22\n";
+    T::SetSysfsRootForTesting((dir / "sys").string());
+    std::string cache = (dir / "cache" / "identity").string();
+
+    // A usable machine id never reaches the MAC lookup.
+    uint64_t scans = T::MacScansForTesting();
+    auto mid = T::ComputeIdentityForTesting("abcd1234efab5678", "");
+    REQUIRE(mid == T::MakeIdentityForTesting("abcd1234efab5678", "", ""));
+    REQUIRE(T::MacScansForTesting() == scans);
+
+#ifdef __linux__
+    // No machine id: one scan, then the cached id (keyed by hostname) skips it.
+    T::SetHostnameForTesting("host-a");
+    auto mac = T::ComputeIdentityForTesting("", cache);
+    REQUIRE(mac == T::MakeIdentityForTesting("", "aa:bb:cc:00:11:22", ""));
+    REQUIRE(T::MacScansForTesting() == scans + 1);
+    REQUIRE(fs::exists(cache));
+    REQUIRE(T::ComputeIdentityForTesting("", cache) == mac);
+    REQUIRE(T::MacScansForTesting() == scans + 1);
+
+    // Another host sharing the cache file (same $HOME) rescans instead of
+    // inheriting host-a's id.
+    std::ofstream(net / "zz0" / "address") << "aa:bb:cc:00:11:33\n";
+    T::SetHostnameForTesting("host-b");
+    auto other = T::ComputeIdentityForTesting("", cache);
+    REQUIRE(other == T::MakeIdentityForTesting("", "aa:bb:cc:00:11:33", ""));
+    REQUIRE(other != mac);
+    REQUIRE(T::MacScansForTesting() == scans + 2);
+
+    // No machine id and no usable hostname: nothing host-specific to key by,
+    // so nothing is cached.
+    T::SetHostnameForTesting("localhost");
+    std::string unkeyed = (dir / "unkeyed" / "identity").string();
+    REQUIRE(T::ComputeIdentityForTesting("", unkeyed).second == "mac");
+    REQUIRE_FALSE(fs::exists(unkeyed));
+    REQUIRE(T::MacScansForTesting() == scans + 3);
+    T::SetHostnameForTesting("");
+#endif
+
+    // A machine id is hashed directly: the cache is neither read nor written.
+    std::string unused = (dir / "unused" / "identity").string();
+    REQUIRE(T::ComputeIdentityForTesting("feedbeef01", unused) == T::MakeIdentityForTesting("feedbeef01", "", ""));
+    REQUIRE_FALSE(fs::exists(unused));
+
+    // Ephemeral ids are per-process: never written to the cache.
+    T::SetSysfsRootForTesting((dir / "missing").string());
+    std::string fresh = (dir / "fresh" / "identity").string();
+    REQUIRE(T::ComputeIdentityForTesting("", fresh).second == "ephemeral");
+    REQUIRE_FALSE(fs::exists(fresh));
+
+    T::SetSysfsRootForTesting("/sys");
+    fs::remove_all(dir);
+}
+
 TEST_CASE("Envelope - identity_source present; CI/ephemeral disable person profile", "[identity][envelope]") {
     auto& t = PostHogTelemetry::Instance();
 
@@ -1099,3 +1243,1062 @@ TEST_CASE("Session id - stable within a process, UUID-shaped", "[envelope][sessi
     REQUIRE(a[18] == '-');
     REQUIRE(a[23] == '-');
 }
+
+TEST_CASE("Stats - snapshot reports the window without draining it", "[stats][aggregation]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+
+    for (int i = 1; i <= 100; i++) t.RecordFunctionCall("stats_fn", static_cast<double>(i));
+
+    TelemetryStats stats = t.GetStats();
+    const TelemetryFunctionStats* fn = nullptr;
+    for (auto& f : stats.functions) {
+        if (f.function_name == "stats_fn") fn = &f;
+    }
+    REQUIRE(fn != nullptr);
+    REQUIRE(fn->call_count == 100);
+    REQUIRE(fn->duration_ms_p50 == Approx(51.0));   // warm calls 2..100
+    REQUIRE(fn->first_call_ms == Approx(1.0));
+    REQUIRE(fn->duration_ms_p95 > fn->duration_ms_p50);
+    REQUIRE(fn->duration_ms_p99 >= fn->duration_ms_p95);
+
+    // Non-destructive: polling twice sees the same window, and the drain that
+    // follows still emits every recorded call.
+    REQUIRE(t.GetStats().functions.size() == stats.functions.size());
+    int64_t drained = 0;
+    for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+        if (e.properties.at("function_name").s == "stats_fn") drained = e.properties.at("call_count").i;
+    }
+    REQUIRE(drained == 100);
+}
+
+TEST_CASE("Stats - sampling and buffer drops are counted", "[stats]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.DrainFunctionAggregatesForTesting();
+
+    uint64_t before = t.GetStats().sampled_out_calls;
+    t.SetSampling(0.5);   // stride 2: every second call is decimated
+    for (int i = 0; i < 10; i++) t.RecordFunctionCall("stats_sampled");
+    t.SetSampling(1.0);
+    REQUIRE(t.GetStats().sampled_out_calls - before == 5);
+
+    t.Flush();
+    REQUIRE(t.GetStats().queue_depth == 0);
+    t.CaptureFeature("stats_buffered", {});   // buffered (auto-flush off in tests)
+    REQUIRE(t.GetStats().queue_depth == 1);
+    t.Flush();
+
+    // A tight memory limit floors the buffer at 64 events; the rest is dropped
+    // at capture time and counted.
+    namespace fs = std::filesystem;
+    fs::path dir = "posthog_telemetry_test_stats_cgroup";
+    fs::create_directories(dir);
+    std::ofstream(dir / "memory.max") << "1048576\n";
+    std::ofstream(dir / "memory.pressure") << "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n"
+                                              "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+    t.SetCgroupDirForTesting(dir.string());
+    REQUIRE(t.GetStats().max_pending_events == 64);
+    uint64_t dropped = t.GetStats().dropped_buffer_full;
+    for (int i = 0; i < 100; i++) t.CaptureFeature("stats_overflow", {});
+    REQUIRE(t.GetStats().queue_depth == 64);
+    REQUIRE(t.GetStats().dropped_buffer_full - dropped == 36);
+
+    t.SetCgroupDirForTesting("");
+    fs::remove_all(dir);
+    t.Flush();
+}
+
+TEST_CASE("Exemplars - slowest_ms keeps the K slowest calls of the window", "[aggregation][exemplars]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.SetSlowestExemplars(3);
+    t.DrainFunctionAggregatesForTesting();
+
+    for (int i = 1; i <= 100; i++) {
+        t.RecordFunctionCall("exemplar_fn", static_cast<double>(i % 50));   // 0..49, twice
+    }
+    t.RecordFunctionCall("exemplar_fn", 250.0, PostHogTelemetry::InputSizeBucket(123456));
+
+    auto events = t.DrainFunctionAggregatesForTesting();
+    const PostHogEvent* ev = nullptr;
+    for (auto& e : events) {
+        if (e.properties.at("function_name").s == "exemplar_fn") ev = &e;
+    }
+    REQUIRE(ev != nullptr);
+    const auto& slowest = ev->properties.at("slowest_ms");
+    REQUIRE(slowest.kind == PropertyValue::Kind::Json);   // real array, not a string
+    REQUIRE(slowest.s == "[250,49,49]");
+    REQUIRE(ev->properties.at("slowest_labels").s == "[\"100000-999999\",\"\",\"\"]");
+
+    // Heap is per window: the next window starts empty.
+    t.RecordFunctionCall("exemplar_fn", 1.0);
+    for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+        if (e.properties.at("function_name").s == "exemplar_fn") {
+            REQUIRE(e.properties.at("slowest_ms").s == "[1]");
+            REQUIRE(e.properties.count("slowest_labels") == 0);
+        }
+    }
+
+    t.SetSlowestExemplars(0);   // disabled: no exemplar properties at all
+    t.RecordFunctionCall("exemplar_fn", 5.0);
+    for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+        REQUIRE(e.properties.count("slowest_ms") == 0);
+    }
+    t.SetSlowestExemplars(5);
+}
+
+TEST_CASE("Exemplars - InputSizeBucket is a bounded enumeration", "[aggregation][exemplars]") {
+    REQUIRE(PostHogTelemetry::InputSizeBucket(0) == "0");
+    REQUIRE(PostHogTelemetry::InputSizeBucket(1) == "1-9");
+    REQUIRE(PostHogTelemetry::InputSizeBucket(10) == "10-99");
+    REQUIRE(PostHogTelemetry::InputSizeBucket(2048) == "1000-9999");
+    REQUIRE(PostHogTelemetry::InputSizeBucket(999999999) == "100000000-999999999");
+    REQUIRE(PostHogTelemetry::InputSizeBucket(UINT64_MAX) == "1e9+");
+}
+
+TEST_CASE("Change-triggered emission - stable windows fold into the heartbeat", "[aggregation][change]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+
+    // Virtual clock: every window is exactly the worker's one-minute period.
+    auto now = std::chrono::steady_clock::now();
+    t.SetClockForTesting([&now] { return now; });
+    t.SetChangeTriggeredEmission(0.25, 4);
+    uint64_t suppressed_before = t.GetStats().suppressed_aggregates;
+
+    auto window = [&](int calls, double ms) {
+        for (int i = 0; i < calls; i++) t.RecordFunctionCall("steady_fn", ms);
+        // Capture-path drains (piggyback, volume) leave the window open.
+        for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+            REQUIRE(e.properties.at("function_name").s != "steady_fn");
+        }
+        now += std::chrono::minutes(1);
+        std::vector<PostHogEvent> out;
+        for (auto& e : t.CloseChangeWindowForTesting()) {
+            if (e.properties.at("function_name").s == "steady_fn") out.push_back(e);
+        }
+        return out;
+    };
+
+    REQUIRE(window(100, 2.0).size() == 1);   // first window primes the baseline
+    REQUIRE(window(100, 2.0).empty());       // steady: suppressed
+    REQUIRE(window(105, 2.0).empty());       // within 25%
+    REQUIRE(window(95, 2.0).empty());
+    auto hb = window(100, 2.0);              // 4 minutes since the last emit: heartbeat
+    REQUIRE(hb.size() == 1);
+    REQUIRE(hb[0].properties.at("call_count").i == 400);   // folded, exact
+    REQUIRE(hb[0].properties.at("windows").i == 4);
+    REQUIRE(t.GetStats().suppressed_aggregates - suppressed_before == 3);
+
+    // A latency shift is emitted immediately, without waiting for the heartbeat.
+    auto shifted = window(100, 10.0);
+    REQUIRE(shifted.size() == 1);
+    REQUIRE(shifted[0].properties.count("windows") == 0);
+
+    // Flush() always emits what was suppressed; the quiet window in between
+    // carried no calls, so it isn't counted in `windows`.
+    int64_t flushed = 0;
+    int64_t flushed_windows = 0;
+    t.SetTransportForTesting([&](const std::string&, const std::string&,
+                                 const std::vector<PostHogEvent>& evs) {
+        for (auto& e : evs) {
+            if (e.event_name == "function_executed" &&
+                e.properties.at("function_name").s == "steady_fn") {
+                flushed += e.properties.at("call_count").i;
+                flushed_windows += e.properties.count("windows") ? e.properties.at("windows").i : 1;
+            }
+        }
+    });
+    window(100, 10.0);
+    REQUIRE(window(0, 0).empty());   // quiet, carried count not yet due
+    t.Flush();
+    REQUIRE(flushed == 100);
+    REQUIRE(flushed_windows == 1);
+
+    t.SetTransportForTesting({});
+    t.SetChangeTriggeredEmission(0);
+    t.SetClockForTesting({});
+    t.DrainFunctionAggregatesForTesting();
+}
+
+TEST_CASE("Change-triggered emission - off by default, every window emitted", "[aggregation][change]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.DrainFunctionAggregatesForTesting();
+    for (int w = 0; w < 3; w++) {
+        t.RecordFunctionCall("every_window_fn", 1.0);
+        size_t n = 0;
+        for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+            if (e.properties.at("function_name").s == "every_window_fn") n++;
+        }
+        REQUIRE(n == 1);
+    }
+}
+
+TEST_CASE("Opt-out - environment is read at init, re-read on request", "[optout][lifecycle]") {
+    auto& t = PostHogTelemetry::Instance();
+    // test_main created the instance before setting the variable.
+    REQUIRE_FALSE(t.IsOptedOutByEnvironment());
+
+    // Start from a stopped worker so we can see that opting out never starts one.
+    PostHogTelemetry::Cleanup();
+    t.ResetShutdownForTesting();
+    REQUIRE_FALSE(t.GetStats().worker_running);
+
+    SetEnv("DATAZOO_DISABLE_TELEMETRY", "1");
+    REQUIRE(t.RecheckEnvironmentOptOut());
+    t.CaptureFeature("optout_probe", {{"k", "v"}});
+    t.CaptureError("optout_error");
+    t.RecordFunctionCall("optout_fn", 1.0);
+    t.Flush();
+    TelemetryStats stats = t.GetStats();
+    REQUIRE(stats.queue_depth == 0);
+    REQUIRE_FALSE(stats.worker_running);
+    for (auto& f : stats.functions) {
+        REQUIRE(f.function_name != "optout_fn");
+    }
+
+    // Re-checking with the variable cleared reopens the gate. (The test binary
+    // keeps it set otherwise, as the transport-level guarantee.)
+    UnsetEnv("DATAZOO_DISABLE_TELEMETRY");
+    REQUIRE_FALSE(t.RecheckEnvironmentOptOut());
+    SetEnv("DATAZOO_DISABLE_TELEMETRY", "1");
+    t.CaptureFeature("optout_probe", {});
+    REQUIRE(t.GetStats().queue_depth == 1);
+    REQUIRE(t.GetStats().worker_running);
+    t.Flush();
+}
+
+TEST_CASE("Packed function stats - one function_stats event carries every function", "[aggregation][packed]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+    t.SetPackedFunctionStats(true);
+
+    for (int i = 1; i <= 100; i++) t.RecordFunctionCall("packed_a", static_cast<double>(i));
+    t.RecordFunctionCall("packed_b", 3.0);   // cold: first_call_ms only
+    t.RecordFunctionCall("packed_b", 7.0, PostHogTelemetry::InputSizeBucket(42));
+    t.RecordFunctionCall("packed \"quoted\"", 1.0);
+
+    auto events = t.DrainFunctionAggregatesForTesting();
+    t.SetPackedFunctionStats(false);
+    REQUIRE(events.size() == 1);
+    const auto& ev = events[0];
+    REQUIRE(ev.event_name == "function_stats");
+    REQUIRE(ev.properties.at("function_count").i == 3);
+    REQUIRE(ev.properties.at("call_count").i == 103);
+
+    const auto& functions = ev.properties.at("functions");
+    REQUIRE(functions.kind == PropertyValue::Kind::Json);   // real array, not a string
+    const std::string& json = functions.s;
+    REQUIRE(json.front() == '[');
+    REQUIRE(Contains(json, "{\"name\":\"packed_a\",\"count\":100,\"p50_ms\":51,"));
+    REQUIRE(Contains(json, "\"p99_ms\":"));
+    REQUIRE(Contains(json, "\"first_call_ms\":1,"));
+    REQUIRE(Contains(json, "{\"name\":\"packed_b\",\"count\":2,\"p50_ms\":7,\"p95_ms\":7,\"p99_ms\":7,"
+                           "\"first_call_ms\":3,\"slowest_ms\":[7],\"slowest_labels\":[\"10-99\"]}"));
+    REQUIRE(Contains(json, "\"name\":\"packed \\\"quoted\\\"\""));
+
+    // The enriched event still carries exactly one envelope.
+    PostHogEvent enriched = t.BuildEventForTesting(ev.event_name, ev.properties);
+    REQUIRE(enriched.properties.count("telemetry_schema") == 1);
+}
+
+TEST_CASE("Packed function stats - prompt-phase calls are packed too", "[aggregation][packed]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.Flush();
+    t.SetPackedFunctionStats(true);
+    t.SetPromptFunctionCallsForTesting(1);
+
+    std::vector<PostHogEvent> sent;
+    t.SetTransportForTesting([&](const std::string&, const std::string&,
+                                 const std::vector<PostHogEvent>& evs) {
+        sent.insert(sent.end(), evs.begin(), evs.end());
+    });
+    t.RecordFunctionCall("packed_prompt_fn", 3.0);   // prompt: emitted per call
+    t.RecordFunctionCall("packed_prompt_fn", 4.0);   // aggregated
+    t.Flush();
+    t.SetTransportForTesting({});
+    t.SetPromptFunctionCallsForTesting(0);
+    t.SetPackedFunctionStats(false);
+
+    int64_t calls = 0;
+    for (auto& e : sent) {
+        REQUIRE(e.event_name != "function_executed");
+        if (e.event_name == "function_stats") {
+            calls += e.properties.at("call_count").i;
+        }
+    }
+    REQUIRE(calls == 2);
+}
+
+TEST_CASE("String table - string_view lookup, stable indices across rehash", "[aggregation][table]") {
+    TelemetryStringTable<int> table;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 1000; i++) {
+        keys.push_back("fn_" + std::to_string(i));
+        std::string_view k = keys.back();
+        size_t idx = table.Insert(k, TelemetryStringTable<int>::Hash(k));
+        REQUIRE(idx == static_cast<size_t>(i));
+        table.ValueAt(idx) = i;
+    }
+    REQUIRE(table.size() == 1000);
+    for (int i = 0; i < 1000; i++) {
+        std::string_view k = keys[i];
+        size_t idx = table.Find(k, TelemetryStringTable<int>::Hash(k));
+        REQUIRE(idx == static_cast<size_t>(i));   // survived every rehash
+        REQUIRE(table.KeyAt(idx) == keys[i]);
+        REQUIRE(table.ValueAt(idx) == i);
+    }
+    std::string_view missing = "fn_1000";
+    REQUIRE(table.Find(missing, TelemetryStringTable<int>::Hash(missing)) == table.npos);
+    // Re-inserting an existing key returns its index without adding an entry.
+    REQUIRE(table.Insert(keys[7], TelemetryStringTable<int>::Hash(keys[7])) == 7);
+    REQUIRE(table.size() == 1000);
+}
+
+TEST_CASE("RecordFunctionCall - string_view names need not be NUL-terminated", "[aggregation][table]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+
+    // Slices of one buffer, the way a caller holding a name table would pass them.
+    std::string buffer = "view_fn_aview_fn_b";
+    std::string_view a(buffer.data(), 9);
+    std::string_view b(buffer.data() + 9, 9);
+    for (int i = 0; i < 3; i++) t.RecordFunctionCall(a, 1.0);
+    t.RecordFunctionCall(b, 2.0);   // cold call: not an exemplar
+    t.RecordFunctionCall(b, 2.0, std::string_view("label-longer-than-this", 5));
+    t.RecordFunctionCall(std::string("view_fn_a"), 1.0);   // same entry as the slice
+
+    std::map<std::string, int64_t> counts;
+    for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+        counts[e.properties.at("function_name").s] = e.properties.at("call_count").i;
+        if (e.properties.at("function_name").s == "view_fn_b") {
+            REQUIRE(Contains(e.properties.at("slowest_labels").s, "\"label\""));
+        }
+    }
+    REQUIRE(counts.size() == 2);
+    REQUIRE(counts["view_fn_a"] == 4);
+    REQUIRE(counts["view_fn_b"] == 2);
+}
+
+TEST_CASE("Query profile - operators folded by type, no query text kept", "[aggregation][operators]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.DrainOperatorAggregatesForTesting();
+
+    // DuckDB 1.1+ layout: the root is the query, operators nest under children.
+    const std::string profile = R"json({
+        "query_name": "SELECT * FROM secret_customers JOIN orders USING (id)",
+        "latency": 0.02, "rows_returned": 10,
+        "children": [{
+            "operator_type": "HASH_JOIN", "operator_timing": 0.004, "operator_cardinality": 10,
+            "extra_info": {"Join Type": "INNER", "Conditions": "id = id"},
+            "children": [
+                {"operator_type": "TABLE_SCAN", "operator_timing": 0.001, "operator_cardinality": 1000,
+                 "extra_info": {"Table": "secret_customers"}, "children": []},
+                {"operator_type": "TABLE_SCAN", "operator_timing": 0.003, "operator_cardinality": 500,
+                 "extra_info": {"Table": "orders"}, "children": []}
+            ]
+        }]
+    })json";
+    REQUIRE(t.IngestQueryProfile(profile));
+
+    auto events = t.DrainOperatorAggregatesForTesting();
+    REQUIRE(events.size() == 2);   // name order
+    REQUIRE(events[0].event_name == "operator_executed");
+    REQUIRE(events[0].properties.at("operator_type").s == "HASH_JOIN");
+    REQUIRE(events[0].properties.at("duration_ms_p50").d == Approx(4.0));
+    REQUIRE(events[1].properties.at("operator_type").s == "TABLE_SCAN");
+    REQUIRE(events[1].properties.at("call_count").i == 2);
+    REQUIRE(events[1].properties.at("rows_total").i == 1500);
+    REQUIRE(events[1].properties.at("duration_ms_p50").d == Approx(2.0));
+    for (auto& e : events) {
+        for (auto& kv : e.properties) {
+            if (kv.second.kind == PropertyValue::Kind::String) {
+                REQUIRE_FALSE(Contains(kv.second.s, "secret"));
+                REQUIRE_FALSE(Contains(kv.second.s, "SELECT"));
+            }
+        }
+    }
+    REQUIRE(t.DrainOperatorAggregatesForTesting().empty());   // drained
+}
+
+TEST_CASE("Query profile - legacy layout, unknown types and non-profiles", "[aggregation][operators]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.DrainOperatorAggregatesForTesting();
+
+    // Pre-1.1 layout (name/timing/cardinality), wrapped in an array as EXPLAIN
+    // ANALYZE (FORMAT JSON) returns it; a display name with a table in it is
+    // not an enum name and must not leak.
+    REQUIRE(t.IngestQueryProfile(R"([{"name": "Query", "timing": 0.01, "children": [
+        {"name": "PROJECTION ", "timing": 0.002, "cardinality": 3, "children": [
+            {"name": "READ_CSV my_private_file.csv", "timing": 0.001, "cardinality": 3, "children": []}
+        ]}]}])"));
+    auto events = t.DrainOperatorAggregatesForTesting();
+    REQUIRE(events.size() == 2);
+    REQUIRE(events[0].properties.at("operator_type").s == "OTHER");
+    REQUIRE(events[1].properties.at("operator_type").s == "PROJECTION");
+    REQUIRE(events[1].properties.at("rows_total").i == 3);
+
+    REQUIRE_FALSE(t.IngestQueryProfile("{\"children\": [")); // malformed
+    REQUIRE_FALSE(t.IngestQueryProfile("{\"sampling_rate\": 1}"));   // not a profile
+    REQUIRE(t.DrainOperatorAggregatesForTesting().empty());
+
+    // Deep join trees nest past the reader's default depth cap.
+    std::string deep;
+    for (int i = 0; i < 100; i++) {
+        deep += R"({"operator_type": "HASH_JOIN", "operator_timing": 0.0, "children": [)";
+    }
+    for (int i = 0; i < 100; i++) {
+        deep += "]}";
+    }
+    REQUIRE(t.IngestQueryProfile(R"({"children": [)" + deep + "]}"));
+    events = t.DrainOperatorAggregatesForTesting();
+    REQUIRE(events.size() == 1);
+    REQUIRE(events[0].properties.at("call_count").i == 100);
+}
+
+TEST_CASE("Query profile - operator window visible in GetStats, off when disabled", "[aggregation][operators]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.DrainOperatorAggregatesForTesting();
+    const std::string profile =
+        R"({"children": [{"operator_type": "FILTER", "operator_timing": 0.5, "children": []}]})";
+
+    t.SetEnabled(false);
+    REQUIRE_FALSE(t.IngestQueryProfile(profile));
+    t.SetEnabled(true);
+    REQUIRE(t.IngestQueryProfile(profile));
+
+    TelemetryStats stats = t.GetStats();
+    REQUIRE(stats.operators.size() == 1);
+    REQUIRE(stats.operators[0].function_name == "FILTER");
+    REQUIRE(stats.operators[0].duration_ms_p50 == Approx(500.0));
+    REQUIRE(t.DrainOperatorAggregatesForTesting().size() == 1);
+}
+
+TEST_CASE("ScopedExtensionLoad - load_ms and per-phase timings on extension_loaded", "[capture][load]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+
+    std::vector<PostHogEvent> captured;
+    std::mutex m;
+    t.SetTransportForTesting(
+        [&](const std::string&, const std::string&, const std::vector<PostHogEvent>& evs) {
+            std::lock_guard<std::mutex> lk(m);
+            for (auto& e : evs) captured.push_back(e);
+        });
+    t.Flush();
+    { std::lock_guard<std::mutex> lk(m); captured.clear(); }
+
+    auto now = std::chrono::steady_clock::now();
+    t.SetClockForTesting([&now] { return now; });
+    {
+        ScopedExtensionLoad load("timed_ext", "2.0.0");
+        now += std::chrono::milliseconds(40);
+        load.Mark("register_functions");
+        now += std::chrono::milliseconds(5);
+        load.Mark("Init Config");             // normalised to init_config
+        now += std::chrono::milliseconds(2);
+        load.Mark("register_functions");      // a repeated phase accumulates
+        now += std::chrono::milliseconds(3);  // unmarked tail: only in load_ms
+    }
+    // A load that throws is not reported.
+    try {
+        ScopedExtensionLoad failed("failed_ext");
+        throw std::runtime_error("load failed");
+    } catch (const std::runtime_error&) {
+    }
+    t.SetClockForTesting({});
+    t.Flush();
+
+    std::lock_guard<std::mutex> lk(m);
+    const PostHogEvent* loaded = nullptr;
+    for (auto& e : captured) {
+        REQUIRE(e.properties.at("extension_name").s != "failed_ext");
+        if (e.event_name == "extension_loaded") {
+            loaded = &e;
+        }
+    }
+    REQUIRE(loaded != nullptr);
+    REQUIRE(loaded->properties.at("extension_name").s == "timed_ext");
+    REQUIRE(loaded->properties.at("extension_version").s == "2.0.0");
+    REQUIRE(loaded->properties.at("load_ms").d == Approx(50.0));
+    REQUIRE(loaded->properties.at("phase_register_functions_ms").d == Approx(42.0));
+    REQUIRE(loaded->properties.at("phase_init_config_ms").d == Approx(5.0));
+    t.SetTransportForTesting({});
+}
+
+#ifndef _WIN32
+TEST_CASE("Fork - child gets its own session, an empty buffer and its own worker", "[capture][fork]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+
+    std::atomic<int> parent_events{0};
+    std::atomic<int> child_events{0};
+    t.SetTransportForTesting(
+        [&](const std::string&, const std::string&, const std::vector<PostHogEvent>& evs) {
+            for (auto& e : evs) {
+                auto it = e.properties.find("feature");
+                if (it == e.properties.end()) continue;
+                if (it->second.s == "fork_child") child_events++;
+                if (it->second.s == "fork_parent") parent_events++;
+            }
+        });
+    t.Flush();   // starts the parent's worker
+    const std::string parent_session = t.GetSessionId();
+
+    // Another thread keeps capturing and flushing across the forks, so the
+    // handlers run while locks and the worker are busy.
+    std::atomic<bool> stop{false};
+    std::thread busy([&] {
+        while (!stop) {
+            t.CaptureFeature("fork_noise", {});
+            t.Flush();
+        }
+    });
+
+    t.CaptureFeature("fork_parent", {});   // buffered (auto-flush off in tests)
+    std::vector<int> statuses;
+    for (int i = 0; i < 5; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            alarm(10);   // a lock inherited held would hang here: die instead
+            int code = 0;
+            TelemetryStats stats = t.GetStats();
+            if (t.GetSessionId() == parent_session) code |= 1;
+            if (stats.queue_depth != 0) code |= 2;
+            if (stats.worker_running) code |= 4;
+            child_events = 0;
+            t.CaptureFeature("fork_child", {});
+            t.Flush();
+            if (child_events != 1) code |= 8;
+            if (!t.GetStats().worker_running) code |= 16;
+            _exit(code);
+        }
+        int status = -1;
+        if (pid > 0 && waitpid(pid, &status, 0) != pid) status = -1;
+        statuses.push_back(status);
+    }
+    stop = true;
+    busy.join();
+
+    for (int status : statuses) {
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+    t.Flush();
+    REQUIRE(parent_events == 1);   // the fork did not drop the parent's buffer
+    REQUIRE(child_events == 0);
+    REQUIRE(t.GetSessionId() == parent_session);
+    t.SetTransportForTesting({});
+}
+
+TEST_CASE("Fork - the child's first call of a function is its own cold call", "[aggregation][cold][fork]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+
+    t.RecordFunctionCall("fork_cold_fn", 900.0);   // the parent's cold call
+    t.RecordFunctionCall("fork_cold_fn", 1.0);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        alarm(10);
+        int code = 0;
+        t.RecordFunctionCall("fork_cold_fn", 5.0);
+        const TelemetryFunctionStats* fn = nullptr;
+        TelemetryStats stats = t.GetStats();
+        for (auto& f : stats.functions) {
+            if (f.function_name == "fork_cold_fn") fn = &f;
+        }
+        if (!fn) code |= 1;
+        else if (fn->first_call_ms != 5.0) code |= 2;   // not the parent's 900
+        else if (fn->call_count != 1) code |= 4;
+        _exit(code);
+    }
+    int status = -1;
+    if (pid > 0 && waitpid(pid, &status, 0) != pid) status = -1;
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+
+    // The parent's session keeps its own cold call.
+    TelemetryStats stats = t.GetStats();
+    const TelemetryFunctionStats* fn = nullptr;
+    for (auto& f : stats.functions) {
+        if (f.function_name == "fork_cold_fn") fn = &f;
+    }
+    REQUIRE(fn != nullptr);
+    REQUIRE(fn->first_call_ms == Approx(900.0));
+    t.DrainFunctionAggregatesForTesting();
+}
+#endif
+
+TEST_CASE("Cold call - first_call_ms is kept apart from the warm percentiles", "[aggregation][cold]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+
+    std::vector<PostHogEvent> captured;
+    std::mutex m;
+    t.SetTransportForTesting(
+        [&](const std::string&, const std::string&, const std::vector<PostHogEvent>& evs) {
+            std::lock_guard<std::mutex> lk(m);
+            for (auto& e : evs) captured.push_back(e);
+        });
+    t.Flush();
+    { std::lock_guard<std::mutex> lk(m); captured.clear(); }
+
+    t.SetPromptFunctionCallsForTesting(2);
+    t.RecordFunctionCall("cold_fn", 900.0);                    // prompt, cold
+    t.RecordFunctionCall("cold_fn", 10.0);                     // prompt, warm
+    for (int i = 0; i < 5; i++) t.RecordFunctionCall("cold_fn", 10.0);
+    t.SetPromptFunctionCallsForTesting(0);
+    t.Flush();
+
+    std::lock_guard<std::mutex> lk(m);
+    std::vector<const PostHogEvent*> events;
+    for (auto& e : captured) {
+        if (e.event_name == "function_executed" &&
+            e.properties.at("function_name").s == "cold_fn") {
+            events.push_back(&e);
+        }
+    }
+    REQUIRE(events.size() == 3);   // two prompt events, one window
+    int64_t calls = 0;
+    int cold_prompts = 0;
+    for (auto* e : events) {
+        calls += e->properties.at("call_count").i;
+        if (e->properties.at("call_count").i == 1) {
+            if (e->properties.count("first_call_ms")) {
+                cold_prompts++;
+                REQUIRE(e->properties.at("duration_ms_p50").d == Approx(900.0));
+            }
+        } else {
+            // The window reports warm percentiles with the cold call beside them.
+            REQUIRE(e->properties.at("duration_ms_p50").d == Approx(10.0));
+            REQUIRE(e->properties.at("first_call_ms").d == Approx(900.0));
+        }
+    }
+    REQUIRE(calls == 7);
+    REQUIRE(cold_prompts == 1);
+    t.SetTransportForTesting({});
+}
+
+TEST_CASE("Memory budget - cgroup limit and pressure size the buffers", "[stats][budget]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.Flush();
+
+    namespace fs = std::filesystem;
+    fs::path dir = "posthog_telemetry_test_cgroup";
+    fs::create_directories(dir);
+    auto write = [&](const char* file, const std::string& text) {
+        std::ofstream(dir / file) << text;
+    };
+    auto pressure = [](double avg10) {
+        return "some avg10=" + std::to_string(avg10) + " avg60=0.00 avg300=0.00 total=1\n"
+               "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+    };
+
+    // 512 MiB: 1/1024 of it for each of the buffer and the aggregator.
+    write("memory.max", "536870912\n");
+    write("memory.pressure", pressure(0.5));
+    for (int i = 0; i < 300; i++) t.CaptureFeature("budget_fill", {});
+    uint64_t dropped = t.GetStats().dropped_buffer_full;
+    uint64_t shrinks = t.GetStats().budget_shrinks;
+    t.SetCgroupDirForTesting(dir.string());
+    TelemetryStats stats = t.GetStats();
+    REQUIRE(stats.memory_limit_bytes == 536870912ULL);
+    REQUIRE(stats.max_pending_events == 256);
+    REQUIRE(stats.max_tracked_functions == 128);
+    REQUIRE(stats.queue_depth == 256);                        // trimmed at once
+    REQUIRE(stats.dropped_buffer_full == dropped + 44);
+    REQUIRE(stats.budget_shrinks == shrinks + 1);
+
+    // Pressure halves, then quarters, down to the floor.
+    write("memory.pressure", pressure(15.0));
+    t.RefreshMemoryBudget();
+    stats = t.GetStats();
+    REQUIRE(stats.memory_pressure_avg10 == Approx(15.0));
+    REQUIRE(stats.max_pending_events == 128);
+    REQUIRE(stats.max_tracked_functions == 64);
+    REQUIRE(stats.budget_shrinks == shrinks + 2);
+    write("memory.pressure", pressure(60.0));
+    t.RefreshMemoryBudget();
+    REQUIRE(t.GetStats().max_pending_events == 64);
+    REQUIRE(t.GetStats().budget_shrinks == shrinks + 3);
+
+    // Pressure gone and no limit: back to the compiled caps, not a shrink.
+    write("memory.max", "max\n");
+    write("memory.pressure", pressure(0.0));
+    t.RefreshMemoryBudget();
+    stats = t.GetStats();
+    REQUIRE(stats.memory_limit_bytes == 0);
+    REQUIRE(stats.max_pending_events == 10000);
+    REQUIRE(stats.max_tracked_functions == 10000);
+    REQUIRE(stats.budget_shrinks == shrinks + 3);
+
+    t.SetCgroupDirForTesting("");
+    fs::remove_all(dir);
+    t.Flush();
+}
+
+TEST_CASE("RecordFunctionCalls - a chunk counts its rows and weighs its sample", "[aggregation][batch]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+
+    PostHogTelemetry::FunctionId id = t.GetFunctionId("batch_fn");
+    REQUIRE(id != 0);
+    REQUIRE(t.GetFunctionId(std::string("batch_fn")) == id);
+
+    t.RecordFunctionCalls(id, 2048, 2048 * 0.5);   // cold chunk
+    t.RecordFunctionCalls(id, 2048, 2048 * 1.0);
+    t.RecordFunctionCalls(id, 10, 10 * 50.0);      // unweighted, these two would
+    t.RecordFunctionCalls(id, 10, 10 * 60.0);      // make the median 50 ms
+    t.RecordFunctionCalls(id, 0, 5.0);             // empty chunk: nothing
+    t.RecordFunctionCall("batch_fn", 1.0);         // per-row calls mix in
+
+    TelemetryStats stats = t.GetStats();
+    const TelemetryFunctionStats* fn = nullptr;
+    for (auto& f : stats.functions) {
+        if (f.function_name == "batch_fn") fn = &f;
+    }
+    REQUIRE(fn != nullptr);
+    REQUIRE(fn->call_count == 2048 + 2048 + 10 + 10 + 1);
+    REQUIRE(fn->first_call_ms == Approx(0.5));
+    REQUIRE(fn->duration_ms_p50 == Approx(1.0));
+    REQUIRE(fn->duration_ms_p99 == Approx(1.0));   // the 20 slow rows are < 1%
+
+    uint64_t dropped = stats.dropped_untracked_functions;
+    t.RecordFunctionCalls(0, 7, 1.0);              // an id past the cap
+    REQUIRE(t.GetStats().dropped_untracked_functions == dropped + 7);
+
+    t.SetEnabled(false);                           // closed gate: nothing inserted
+    REQUIRE(t.GetFunctionId("batch_fn_while_off") == 0);
+    t.SetEnabled(true);
+    REQUIRE(t.GetFunctionId("batch_fn") == id);
+
+    for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+        if (e.properties.at("function_name").s == "batch_fn") {
+            REQUIRE(e.properties.at("call_count").i == 4117);
+            REQUIRE(e.properties.at("duration_ms_p50").d == Approx(1.0));
+        }
+    }
+}
+
+TEST_CASE("CPU governor - steps up over budget and back down", "[stats][governor]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t cpu_ns = 0;
+    t.SetClockForTesting([&now] { return now; });
+    t.SetCpuClockForTesting([&cpu_ns] { return cpu_ns; });
+    t.SetCpuBudget(0.005);
+    t.GovernorTickForTesting();   // first interval only primes
+    auto interval = [&](uint64_t used_ms) {
+        now += std::chrono::seconds(1);
+        cpu_ns += used_ms * 1000000;
+        t.GovernorTickForTesting();
+        return t.GetStats();
+    };
+
+    TelemetryStats stats = interval(100);   // 10% of a core
+    REQUIRE(stats.governor_level == 1);
+    REQUIRE(stats.cpu_budget_ppm == 5000);
+    REQUIRE(stats.cpu_usage_ppm >= 100000);
+    uint64_t sampled_out = stats.sampled_out_calls;
+    for (int i = 0; i < 10; i++) t.RecordFunctionCall("governed_fn", 1.0);
+    REQUIRE(t.GetStats().sampled_out_calls == sampled_out + 5);   // stride 1 -> 2
+
+    interval(100);
+    stats = interval(100);
+    REQUIRE(stats.governor_level == 3);
+    interval(100);
+    REQUIRE(t.GetStats().governor_level == 3);   // capped
+    uint64_t shed = t.GetStats().governor_shed_events;
+    REQUIRE_FALSE(t.IngestQueryProfile(R"({"children":[]})"));
+    t.SetPromptFunctionCallsForTesting(3);
+    t.RecordFunctionCall("governed_prompt_fn", 1.0);   // aggregated, not prompt
+    t.SetPromptFunctionCallsForTesting(0);
+    REQUIRE(t.GetStats().governor_shed_events == shed + 2);
+
+    // Between half the budget and the budget: hold. Under half: step down.
+    REQUIRE(interval(4).governor_level == 3);
+    REQUIRE(interval(1).governor_level == 2);
+    interval(0);
+    REQUIRE(interval(0).governor_level == 0);
+    sampled_out = t.GetStats().sampled_out_calls;
+    for (int i = 0; i < 10; i++) t.RecordFunctionCall("governed_fn", 1.0);
+    REQUIRE(t.GetStats().sampled_out_calls == sampled_out);
+
+    t.SetCpuBudget(0);
+    t.SetCpuClockForTesting({});
+    t.SetClockForTesting({});
+    t.DrainFunctionAggregatesForTesting();
+}
+
+TEST_CASE("CPU governor - counts chunks encoded off the worker", "[stats][governor]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.Flush();
+    t.SetTransportForTesting({});   // the PostHog transport is the one that encodes
+    t.SetHost("http://127.0.0.1:1");   // refused at once; only the encoding matters
+    t.SetCpuBudget(0);                 // usage is measured with the governor off too
+    UnsetEnv("DATAZOO_DISABLE_TELEMETRY");
+    // Every chunk runs on a thread of its own, never on the worker.
+    std::atomic<size_t> off_worker{0};
+    t.SetEncodeExecutor([&](size_t n, const std::function<void(size_t)>& fn) {
+        for (size_t i = 0; i < n; i++) {
+            std::thread([&, i] { fn(i); off_worker++; }).join();
+        }
+    });
+
+    auto now = std::chrono::steady_clock::now();
+    t.SetClockForTesting([&now] { return now; });
+    t.SetCpuClockForTesting([] { return uint64_t(0); });   // the worker itself is free
+    for (int i = 0; i < 1000; i++) t.CaptureFeature("governor_encoded", {{"pad", std::string(200, 'x')}});
+    t.GovernorTickForTesting();   // primes after the capture-path cost is in
+    t.Flush();
+    REQUIRE(off_worker >= 4);
+    now += std::chrono::seconds(1);
+    t.GovernorTickForTesting();
+    REQUIRE(t.GetStats().cpu_usage_ppm > 0);
+
+    SetEnv("DATAZOO_DISABLE_TELEMETRY", "1");
+    t.SetEncodeParallelism(std::min(4u, std::max(1u, std::thread::hardware_concurrency())));
+    t.SetHost("");
+    t.SetCpuClockForTesting({});
+    t.SetClockForTesting({});
+}
+
+TEST_CASE("Shape trace - records types, lengths and ordinals, never values", "[capture][trace]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.Flush();
+
+    auto path = (std::filesystem::temp_directory_path() / "telemetry_shape.trace").string();
+    REQUIRE(t.StartShapeTrace(path));
+    t.Capture("trace_secret_event", {{"trace_secret_key", "confidential-value"},
+                                     {"rows", int64_t(7)},
+                                     {"payload", PropertyValue::Json("{\"a\":1}")}});
+    t.RecordFunctionCall("trace_secret_fn", 2.5);
+    t.RecordFunctionCall("trace_secret_fn", 1.0, "S4HANA");
+    t.RecordFunctionCalls(t.GetFunctionId("trace_secret_fn"), 2048, 3.0);
+    t.StopShapeTrace();
+    t.Capture("trace_after_stop");
+
+    std::ifstream in(path);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    REQUIRE(text.rfind("# telemetry shape trace v1\n", 0) == 0);
+    for (const char* secret : {"trace_secret", "confidential", "S4HANA", "\"a\"", "trace_after"}) {
+        REQUIRE(text.find(secret) == std::string::npos);
+    }
+    // Ordinals follow first use: event, then its keys in map order.
+    REQUIRE(text.find("N\t0\t18\n") != std::string::npos);   // trace_secret_event
+    REQUIRE(text.find("N\t4\t15\n") != std::string::npos);   // trace_secret_fn
+    std::vector<std::string> tails;
+    std::istringstream lines(text);
+    for (std::string line; std::getline(lines, line);) {
+        if (line[0] == 'E' || line[0] == 'F' || line[0] == 'B') {
+            // Drop kind, time and thread; keep the shape.
+            size_t pos = 0;
+            for (int i = 0; i < 3; i++) pos = line.find('\t', pos) + 1;
+            tails.push_back(line.substr(0, 1) + " " + line.substr(pos));
+        }
+    }
+    REQUIRE(tails == std::vector<std::string>{"E 0\tj1:7,i2,s3:18",
+                                              "F 4\t2.5\t-1",
+                                              "F 4\t1\t6",
+                                              "B 4\t2048\t3"});
+    std::filesystem::remove(path);
+    t.Flush();
+}
+
+TEST_CASE("Category mask - masked categories are dropped at the gate", "[capture][categories]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.Flush();
+    t.DrainFunctionAggregatesForTesting();
+
+    uint32_t mask = 0;
+    REQUIRE(PostHogTelemetry::ParseCategoryMask(" Feature, error ,metric", mask));
+    REQUIRE(mask == (kTelemetryFeature | kTelemetryError | kTelemetryMetric));
+    REQUIRE(PostHogTelemetry::ParseCategoryMask("all", mask));
+    REQUIRE(mask == kTelemetryAllCategories);
+    REQUIRE(PostHogTelemetry::ParseCategoryMask("none", mask));
+    REQUIRE(mask == 0);
+    REQUIRE_FALSE(PostHogTelemetry::ParseCategoryMask("feature,functions", mask));
+    REQUIRE(mask == 0);   // untouched
+    REQUIRE(PostHogTelemetry::CategoryOf("$exception") == kTelemetryError);
+    REQUIRE(PostHogTelemetry::CategoryOf("extension_loaded") == kTelemetryLifecycle);
+    REQUIRE(PostHogTelemetry::CategoryOf("my_custom_event") == kTelemetryMetric);
+
+    std::vector<std::string> sent;
+    std::mutex sent_lock;
+    t.SetTransportForTesting([&](const std::string&, const std::string&,
+                                 const std::vector<PostHogEvent>& evs) {
+        std::lock_guard<std::mutex> lock(sent_lock);
+        for (auto& e : evs) sent.push_back(e.event_name);
+    });
+    t.SetCategoryMask(kTelemetryAllCategories & ~(kTelemetryFunction | kTelemetryFeature));
+    REQUIRE(t.GetStats().category_mask == (kTelemetryAllCategories & ~(kTelemetryFunction | kTelemetryFeature)));
+    t.CaptureFeature("masked_feature");
+    t.Capture("feature_used", {{"feature", "raw_masked_feature"}});   // same category by name
+    t.RecordFunctionCall("masked_fn", 1.0);
+    t.RecordFunctionCalls(t.GetFunctionId("masked_fn"), 2048, 1.0);
+    t.CaptureError("mask_kept_error");
+    t.Capture("mask_kept_custom");
+    t.Flush();
+    {
+        std::lock_guard<std::mutex> lock(sent_lock);
+        REQUIRE(std::count(sent.begin(), sent.end(), "feature_used") == 0);
+        REQUIRE(std::count(sent.begin(), sent.end(), "function_executed") == 0);
+        REQUIRE(std::count(sent.begin(), sent.end(), "$exception") == 1);
+        REQUIRE(std::count(sent.begin(), sent.end(), "mask_kept_custom") == 1);
+        sent.clear();
+    }
+
+    // Re-enabling a category takes effect on the next call; SetEnabled keeps the mask.
+    t.SetEnabled(false);
+    t.SetEnabled(true);
+    t.CaptureFeature("still_masked");
+    t.SetCategoryMask(kTelemetryAllCategories);
+    t.CaptureFeature("unmasked_feature");
+    t.RecordFunctionCall("unmasked_fn", 1.0);
+    t.Flush();
+    {
+        std::lock_guard<std::mutex> lock(sent_lock);
+        REQUIRE(std::count(sent.begin(), sent.end(), "feature_used") == 1);
+        REQUIRE(std::count(sent.begin(), sent.end(), "function_executed") == 1);
+    }
+    t.SetTransportForTesting({});
+}
+
+TEST_CASE("Cardinality guard - sketch estimates distinct values", "[capture][cardinality]") {
+    TelemetryCardinalitySketch sketch;
+    REQUIRE(sketch.Estimate() == 0);
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 40; i++) {
+            sketch.Add(TelemetryStringTable<int>::Hash("value_" + std::to_string(i)));
+        }
+    }
+    REQUIRE(sketch.Estimate() == Approx(40).epsilon(0.15));
+    for (int i = 40; i < 5000; i++) {
+        sketch.Add(TelemetryStringTable<int>::Hash("value_" + std::to_string(i)));
+    }
+    REQUIRE(sketch.Estimate() == Approx(5000).epsilon(0.2));
+}
+
+TEST_CASE("Cardinality guard - an unbounded key is bucketed and reported once", "[capture][cardinality]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.Flush();
+
+    std::vector<PostHogEvent> sent;
+    std::mutex sent_lock;
+    t.SetTransportForTesting([&](const std::string&, const std::string&,
+                                 const std::vector<PostHogEvent>& evs) {
+        std::lock_guard<std::mutex> lock(sent_lock);
+        sent.insert(sent.end(), evs.begin(), evs.end());
+    });
+    t.SetCardinalityLimit(50);
+    TelemetryStats before = t.GetStats();
+    for (int i = 0; i < 300; i++) {
+        t.Capture("card_event", {{"table", "table_" + std::to_string(i)},   // against the rule
+                                 {"mode", i % 2 ? "scan" : "lookup"},
+                                 {"$group_key", "account_" + std::to_string(i)}});
+    }
+    t.Flush();
+    TelemetryStats after = t.GetStats();
+    REQUIRE(after.cardinality_violations == before.cardinality_violations + 1);
+
+    std::lock_guard<std::mutex> lock(sent_lock);
+    size_t passed = 0, bucketed = 0, violations = 0;
+    bool other_seen = false;
+    for (auto& e : sent) {
+        if (e.event_name == "telemetry_cardinality_violation") {
+            violations++;
+            REQUIRE(e.properties.at("violating_event").s == "card_event");
+            REQUIRE(e.properties.at("property_key").s == "table");
+            REQUIRE(e.properties.at("cardinality_limit").i == 50);
+            REQUIRE(e.properties.at("estimated_distinct").i > 50);
+        }
+        if (e.event_name != "card_event") continue;
+        REQUIRE(e.properties.at("$group_key").s.rfind("account_", 0) == 0);   // exempt
+        REQUIRE(e.properties.at("mode").s != "__other__");
+        if (e.properties.at("table").s == "__other__") {
+            bucketed++;
+            other_seen = true;
+        } else {
+            REQUIRE_FALSE(other_seen);   // once tripped, every later value is bucketed
+            passed++;
+        }
+    }
+    REQUIRE(violations == 1);
+    REQUIRE(passed + bucketed == 300);
+    REQUIRE(passed >= 40);
+    REQUIRE(passed <= 60);
+    REQUIRE(after.cardinality_bucketed - before.cardinality_bucketed == bucketed);
+
+    t.SetCardinalityLimit(200);
+    t.SetTransportForTesting({});
+}
+
+TEST_CASE("Cardinality guard - a bucketed error_class doesn't leak through $exception_*",
+          "[capture][cardinality]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.Flush();
+
+    std::vector<PostHogEvent> sent;
+    std::mutex sent_lock;
+    t.SetTransportForTesting([&](const std::string&, const std::string&,
+                                 const std::vector<PostHogEvent>& evs) {
+        std::lock_guard<std::mutex> lock(sent_lock);
+        sent.insert(sent.end(), evs.begin(), evs.end());
+    });
+    t.SetCardinalityLimit(20);
+    for (int i = 0; i < 200; i++) {
+        t.CaptureError("error_" + std::to_string(i));   // against the rule
+    }
+    t.Flush();
+
+    std::lock_guard<std::mutex> lock(sent_lock);
+    size_t bucketed = 0;
+    for (auto& e : sent) {
+        if (e.event_name != "$exception") continue;
+        const std::string& error_class = e.properties.at("error_class").s;
+        REQUIRE(Contains(e.properties.at("$exception_list").s, "\"type\":\"" + error_class + "\""));
+        auto fp = e.properties.find("$exception_fingerprint");
+        if (fp != e.properties.end()) {
+            REQUIRE(fp->second.s.substr(fp->second.s.rfind('/') + 1) == error_class);
+        }
+        if (error_class == "__other__") bucketed++;
+    }
+    REQUIRE(bucketed > 100);
+
+    t.SetCardinalityLimit(200);
+    t.SetTransportForTesting({});
+}
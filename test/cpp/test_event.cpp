@@ -159,3 +159,31 @@ TEST_CASE("PostHogEvent - Long property values", "[event]") {
     REQUIRE(json.find(long_value) != std::string::npos);
     REQUIRE(json.length() > 10000);
 }
+
+TEST_CASE("PostHogEncodeBatch - parallel chunks match serial, in event order", "[event][encode]") {
+    std::vector<PostHogEvent> events;
+    for (int i = 0; i < 1234; i++) {
+        PostHogEvent e{"encode_event", "distinct", {{"seq", i}, {"label", "x\"y"}}, "2026-01-01T00:00:00Z"};
+        events.push_back(e);
+    }
+    auto serial = PostHogEncodeBatch("key", events);
+    REQUIRE(serial.size() == 5);   // 250 per request
+    REQUIRE(serial[0].find("\"seq\": 0}") != std::string::npos);
+    REQUIRE(serial[4].find("\"seq\": 1233}") != std::string::npos);
+
+    for (size_t threads : {2u, 4u, 16u}) {
+        REQUIRE(PostHogEncodeBatch("key", events, TelemetryThreadParallelFor(threads)) == serial);
+    }
+
+    // A host executor sees every chunk exactly once.
+    std::atomic<size_t> calls{0};
+    TelemetryParallelFor host = [&](size_t n, const std::function<void(size_t)>& fn) {
+        calls += n;
+        for (size_t i = n; i-- > 0;) {   // any order
+            fn(i);
+        }
+    };
+    REQUIRE(PostHogEncodeBatch("key", events, host) == serial);
+    REQUIRE(calls == serial.size());
+    REQUIRE_FALSE(TelemetryThreadParallelFor(1));   // serial: no executor
+}
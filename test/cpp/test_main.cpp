@@ -5,10 +5,17 @@
 #include "telemetry.hpp"
 
 int main(int argc, char *argv[]) {
-    // Ensure tests never send data to PostHog
+    // The opt-out is read once when the singleton is created, and an opted-out
+    // process captures nothing — so create it with the variable cleared (the
+    // pipeline under test stays live), then set it: the transport re-reads it,
+    // which is what guarantees tests never send data to PostHog.
 #ifdef _WIN32
+    _putenv_s("DATAZOO_DISABLE_TELEMETRY", "");
+    duckdb::PostHogTelemetry::Instance();
     _putenv_s("DATAZOO_DISABLE_TELEMETRY", "1");
 #else
+    unsetenv("DATAZOO_DISABLE_TELEMETRY");
+    duckdb::PostHogTelemetry::Instance();
     setenv("DATAZOO_DISABLE_TELEMETRY", "1", 1);
 #endif
 
@@ -19,6 +26,9 @@ int main(int argc, char *argv[]) {
     // Make all function calls aggregate (no per-call prompt phase) so aggregation
     // tests can assert exact counts. The dedicated prompt test overrides this.
     duckdb::PostHogTelemetry::Instance().SetPromptFunctionCallsForTesting(0);
+    // The CPU governor would react to the suite's own load (sampling strides
+    // changing under exact-count tests); its test drives it on virtual clocks.
+    duckdb::PostHogTelemetry::Instance().SetCpuBudget(0);
 
     std::cout << std::endl << "**** PostHog Telemetry Unit Tests ****" << std::endl << std::endl;
 
@@ -0,0 +1,197 @@
+// Tests for the Prometheus textfile sink (telemetry_prometheus.hpp).
+#include "catch.hpp"
+#include "telemetry.hpp"
+#include "telemetry_prometheus.hpp"
+
+#include <clocale>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace duckdb;
+
+namespace {
+
+std::string ReadFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+bool HasLine(const std::string& text, const std::string& line) {
+    return text.find(line + "\n") != std::string::npos;
+}
+
+} // namespace
+
+TEST_CASE("Prometheus sink - window becomes counters and a histogram", "[prometheus][sink]") {
+    auto dir = std::filesystem::temp_directory_path() / "telemetry_prom_test";
+    std::filesystem::create_directories(dir);
+    std::string path = (dir / "telemetry.prom").string();
+    std::filesystem::remove(path);
+
+    PrometheusTextfileSink sink(path, "ext");
+    TelemetryWindowFunction fn;
+    fn.function_name = "sap_\"read\"";
+    fn.call_count = 10;
+    fn.duration_ms = {0.05, 2.0, 2.0, 200.0};   // 100 µs, 5 ms (x2), 500 ms buckets
+    fn.weights = {1, 1, 1, 2};                  // 10 calls spread 2/2/2/4
+    fn.first_call_ms = 30.0;
+    TelemetryStats pipeline;
+    pipeline.queue_depth = 7;
+    pipeline.dropped_buffer_full = 3;
+    pipeline.sampled_out_calls = 11;
+    REQUIRE(sink.Write({fn}, pipeline));
+
+    std::string text = ReadFile(path);
+    REQUIRE(text == sink.Render());
+    REQUIRE_FALSE(std::filesystem::exists(path + ".tmp"));
+    const std::string label = "function=\"sap_\\\"read\\\"\"";
+    REQUIRE(HasLine(text, "# TYPE ext_function_calls counter"));
+    REQUIRE(HasLine(text, "ext_function_calls_total{" + label + "} 10"));
+    REQUIRE(HasLine(text, "# TYPE ext_function_duration_seconds histogram"));
+    REQUIRE(HasLine(text, "ext_function_duration_seconds_bucket{" + label + ",le=\"0.0001\"} 2"));
+    REQUIRE(HasLine(text, "ext_function_duration_seconds_bucket{" + label + ",le=\"0.001\"} 2"));
+    REQUIRE(HasLine(text, "ext_function_duration_seconds_bucket{" + label + ",le=\"0.005\"} 6"));
+    REQUIRE(HasLine(text, "ext_function_duration_seconds_bucket{" + label + ",le=\"0.5\"} 10"));
+    REQUIRE(HasLine(text, "ext_function_duration_seconds_bucket{" + label + ",le=\"+Inf\"} 10"));
+    REQUIRE(HasLine(text, "ext_function_duration_seconds_count{" + label + "} 10"));
+    REQUIRE(HasLine(text, "ext_function_first_call_seconds{" + label + "} 0.03"));
+    REQUIRE(HasLine(text, "ext_dropped_events_total{reason=\"buffer_full\"} 3"));
+    REQUIRE(HasLine(text, "ext_dropped_events_total{reason=\"untracked_function\"} 0"));
+    REQUIRE(HasLine(text, "ext_sampled_out_calls_total 11"));
+    REQUIRE(HasLine(text, "ext_queue_depth 7"));
+    REQUIRE(text.size() >= 6);
+    REQUIRE(text.compare(text.size() - 6, 6, "# EOF\n") == 0);
+
+    // Counters accumulate across windows; gauges take the latest value.
+    fn.call_count = 5;
+    fn.duration_ms = {2.0};
+    fn.weights.clear();
+    pipeline.queue_depth = 0;
+    REQUIRE(sink.Write({fn}, pipeline));
+    text = ReadFile(path);
+    REQUIRE(HasLine(text, "ext_function_calls_total{" + label + "} 15"));
+    REQUIRE(HasLine(text, "ext_function_duration_seconds_bucket{" + label + ",le=\"0.005\"} 11"));
+    REQUIRE(HasLine(text, "ext_function_duration_seconds_count{" + label + "} 15"));
+    REQUIRE(HasLine(text, "ext_queue_depth 0"));
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Prometheus sink - numbers are locale-independent (dot, not comma)", "[prometheus][sink]") {
+    char* prev = std::setlocale(LC_NUMERIC, nullptr);
+    std::string saved = prev ? prev : "C";
+    // Try a comma-decimal locale; if unavailable the test still asserts the dot.
+    std::setlocale(LC_NUMERIC, "de_DE.UTF-8");
+
+    PrometheusTextfileSink sink((std::filesystem::temp_directory_path() / "telemetry_locale.prom").string());
+    TelemetryWindowFunction fn;
+    fn.function_name = "locale_fn";
+    fn.call_count = 2;
+    fn.duration_ms = {1.5, 2.5};
+    fn.first_call_ms = 4.5;
+    sink.Write({fn}, TelemetryStats());
+    std::string text = sink.Render();
+    std::setlocale(LC_NUMERIC, saved.c_str());
+    std::filesystem::remove(std::filesystem::temp_directory_path() / "telemetry_locale.prom");
+
+    REQUIRE(HasLine(text, "telemetry_function_duration_seconds_bucket{function=\"locale_fn\",le=\"0.005\"} 2"));
+    REQUIRE(HasLine(text, "telemetry_function_duration_seconds_sum{function=\"locale_fn\"} 0.004"));
+    REQUIRE(HasLine(text, "telemetry_function_first_call_seconds{function=\"locale_fn\"} 0.0045"));
+}
+
+TEST_CASE("Prometheus sink - emitted windows rewrite the file, nothing is sent",
+          "[prometheus][sink]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.Flush();
+
+    auto dir = std::filesystem::temp_directory_path() / "telemetry_prom_live";
+    std::filesystem::create_directories(dir);
+    std::string path = (dir / "telemetry.prom").string();
+    std::filesystem::remove(path);
+
+    auto sink = std::make_shared<PrometheusTextfileSink>(path);
+    UsePrometheusTextfileSink(sink);
+    for (int i = 0; i < 4; i++) t.RecordFunctionCall("prom_fn", 3.0);
+    t.CaptureFeature("prom_feature");   // goes through the discarding transport
+    t.Flush();
+
+    std::string text = ReadFile(path);
+    REQUIRE(HasLine(text, "telemetry_function_calls_total{function=\"prom_fn\"} 4"));
+    REQUIRE(HasLine(text, "telemetry_function_duration_seconds_count{function=\"prom_fn\"} 4"));
+    REQUIRE(HasLine(text, "telemetry_function_duration_seconds_bucket{function=\"prom_fn\",le=\"0.005\"} 4"));
+    REQUIRE(text.find("# EOF\n") != std::string::npos);
+
+    // A flush with no function window leaves the file alone; the worker's
+    // refresh rewrites it anyway, so idle processes keep current counters.
+    std::filesystem::remove(path);
+    t.Flush();
+    REQUIRE_FALSE(std::filesystem::exists(path));
+    t.CaptureFeature("prom_feature");
+    t.RefreshWindowSinkForTesting();
+    text = ReadFile(path);
+    REQUIRE(HasLine(text, "telemetry_function_calls_total{function=\"prom_fn\"} 4"));
+    REQUIRE(HasLine(text, "telemetry_queue_depth 1"));
+    t.Flush();
+
+    // The sink runs on the worker, never on the thread that drained the window.
+    std::thread::id sink_thread;
+    t.SetWindowSink([&](const std::vector<TelemetryWindowFunction>&, const TelemetryStats&) {
+        sink_thread = std::this_thread::get_id();
+    });
+    t.RecordFunctionCall("prom_fn", 3.0);
+    t.Flush();
+    REQUIRE(sink_thread != std::thread::id());
+    REQUIRE(sink_thread != std::this_thread::get_id());
+
+    t.SetWindowSink({});
+    t.SetTransportForTesting({});
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Prometheus sink - counts prompt-phase and sampled-out calls", "[prometheus][sink]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.Flush();
+
+    auto dir = std::filesystem::temp_directory_path() / "telemetry_prom_counts";
+    std::filesystem::create_directories(dir);
+    std::string path = (dir / "telemetry.prom").string();
+    std::filesystem::remove(path);
+
+    auto sink = std::make_shared<PrometheusTextfileSink>(path);
+    UsePrometheusTextfileSink(sink);
+    t.SetPromptFunctionCallsForTesting(3);
+
+    // A function called fewer times than the prompt phase never reaches the
+    // window, but its calls still count.
+    t.RecordFunctionCall("prom_prompt_only", 3.0);
+    t.RecordFunctionCall("prom_prompt_only", 3.0);
+    t.Flush();
+    std::string text = ReadFile(path);
+
+    // Every other call is recorded (3 of them prompt-phase); the counter
+    // scales back to all 20.
+    t.SetSampling(0.5);
+    for (int i = 0; i < 20; i++) t.RecordFunctionCall("prom_sampled", 3.0);
+    t.Flush();
+    std::string sampled = ReadFile(path);
+    t.SetPromptFunctionCallsForTesting(0);
+    t.SetSampling(1.0);
+
+    REQUIRE(HasLine(text, "telemetry_function_calls_total{function=\"prom_prompt_only\"} 2"));
+    REQUIRE(HasLine(text, "telemetry_function_first_call_seconds{function=\"prom_prompt_only\"} 0.003"));
+    REQUIRE(HasLine(sampled, "telemetry_function_calls_total{function=\"prom_sampled\"} 20"));
+    REQUIRE(HasLine(sampled, "telemetry_function_duration_seconds_count{function=\"prom_sampled\"} 20"));
+
+    t.SetWindowSink({});
+    t.SetTransportForTesting({});
+    std::filesystem::remove_all(dir);
+}
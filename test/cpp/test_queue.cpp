@@ -1,9 +1,15 @@
 #include "catch.hpp"
 #include "telemetry.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <future>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -295,3 +301,172 @@ TEST_CASE("TelemetryTaskQueue - Double stop is safe", "[queue]") {
 
     REQUIRE(true);  // No crash
 }
+
+TEST_CASE("TelemetryTaskQueue - Deferred tasks wait for their deadline without blocking others", "[queue]") {
+    std::vector<int> results;
+    std::mutex results_mutex;
+    auto push = [&results, &results_mutex](int value) {
+        std::lock_guard<std::mutex> lock(results_mutex);
+        results.push_back(value);
+    };
+
+    TelemetryTaskQueue<int> queue;
+    auto start = std::chrono::steady_clock::now();
+    queue.ScheduleAt(push, 2, start + std::chrono::milliseconds(150));
+    queue.EnqueueTask(push, 1);   // due now: runs first despite enqueue order
+
+    // Only due work counts as "drained"; the deferred task is still pending.
+    REQUIRE(queue.DrainFor(1000));
+    {
+        std::lock_guard<std::mutex> lock(results_mutex);
+        REQUIRE(results == std::vector<int>{1});
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    std::lock_guard<std::mutex> lock(results_mutex);
+    REQUIRE(results == std::vector<int>({1, 2}));
+}
+
+TEST_CASE("TelemetryTimerWheel - fires every timer at its tick, across levels and overflow", "[queue][timer]") {
+    TelemetryTimerWheel<int> wheel;
+    std::mt19937_64 rng(42);
+    // Deadlines spread over every level and past the 2^24-tick wheel range.
+    std::vector<uint64_t> spans = {50, 3000, 200000, 10000000, 40000000};
+    std::map<uint64_t, uint64_t> due_of;   // wheel id -> due tick
+    std::set<uint64_t> cancelled;
+    for (int i = 0; i < 2000; i++) {
+        uint64_t due = 1 + rng() % spans[i % spans.size()];
+        uint64_t id = wheel.Insert(due, i);
+        due_of[id] = due;
+        if (i % 7 == 0) {
+            REQUIRE(wheel.Cancel(id));
+            REQUIRE_FALSE(wheel.Cancel(id));   // second cancel is a no-op
+            cancelled.insert(id);
+        }
+    }
+    REQUIRE(wheel.size() == due_of.size() - cancelled.size());
+
+    uint64_t fired = 0;
+    uint64_t last_due = 0;
+    auto check = [&](uint64_t id, int&&) {
+        REQUIRE(cancelled.count(id) == 0);
+        REQUIRE(due_of.at(id) <= wheel.Now());      // never early
+        REQUIRE(due_of.at(id) >= last_due);         // deadline order
+        last_due = due_of.at(id);
+        fired++;
+    };
+    // Uneven steps: some land mid-block, some jump whole levels.
+    uint64_t now = 0;
+    while (now < 50000000) {
+        now += 1 + rng() % 100000;
+        wheel.Advance(now, check);
+        // Nothing due by `now` may remain: the earliest left is in the future.
+        uint64_t next;
+        if (wheel.NextDeadline(next)) {
+            REQUIRE(next > now);
+        }
+    }
+    REQUIRE(fired == due_of.size() - cancelled.size());
+    REQUIRE(wheel.size() == 0);
+    uint64_t next;
+    REQUIRE_FALSE(wheel.NextDeadline(next));
+}
+
+TEST_CASE("TelemetryTimerWheel - NextDeadline is a safe wake-up bound", "[queue][timer]") {
+    TelemetryTimerWheel<int> wheel;
+    std::vector<uint64_t> dues = {5, 64, 65, 4095, 4096, 300000, (uint64_t(1) << 24) + 7};
+    for (size_t i = 0; i < dues.size(); i++) {
+        wheel.Insert(dues[i], static_cast<int>(i));
+    }
+    // Sleeping to each bound and advancing there must reach every timer exactly
+    // at its tick, in order, without ever overshooting one.
+    std::vector<uint64_t> fired_at;
+    uint64_t next;
+    while (wheel.NextDeadline(next)) {
+        REQUIRE(next > wheel.Now());
+        wheel.Advance(next, [&](uint64_t, int&& i) {
+            REQUIRE(wheel.Now() == dues[static_cast<size_t>(i)]);
+            fired_at.push_back(wheel.Now());
+        });
+    }
+    REQUIRE(fired_at == dues);
+}
+
+namespace {
+
+// Shared virtual clock for queue timer tests: only moves when the test says so.
+struct VirtualClock {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<int64_t> offset_ms{0};
+    std::chrono::steady_clock::time_point Now() const {
+        return start + std::chrono::milliseconds(offset_ms.load());
+    }
+};
+
+} // namespace
+
+TEST_CASE("TelemetryTaskQueue - ScheduleAt and ScheduleEvery follow a virtual clock", "[queue][timer]") {
+    VirtualClock vc;
+    std::mutex m;
+    std::vector<std::string> log;
+    auto push = [&](std::string s) {
+        std::lock_guard<std::mutex> lock(m);
+        log.push_back(s);
+    };
+    auto snapshot = [&] {
+        std::lock_guard<std::mutex> lock(m);
+        return log;
+    };
+    auto advance = [&](TelemetryTaskQueue<std::string>& q, int64_t ms) {
+        vc.offset_ms += ms;
+        q.Wake();
+        REQUIRE(q.DrainFor(2000));
+    };
+
+    TelemetryTaskQueue<std::string> queue([&vc] { return vc.Now(); });
+    queue.ScheduleAt(push, "once", vc.Now() + std::chrono::seconds(10));
+    auto every = queue.ScheduleEvery(push, "tick", std::chrono::seconds(3));
+    queue.EnqueueTask(push, "now");
+    REQUIRE(queue.DrainFor(2000));
+    REQUIRE(snapshot() == std::vector<std::string>{"now"});   // timers wait for the clock
+
+    advance(queue, 2999);
+    REQUIRE(snapshot().size() == 1);
+    advance(queue, 1);                                         // t = 3 s
+    advance(queue, 3000);                                      // t = 6 s
+    REQUIRE(snapshot() == std::vector<std::string>({"now", "tick", "tick"}));
+
+    // A long stall skips the missed beats instead of replaying them.
+    advance(queue, 5000);                                      // t = 11 s: once + one tick
+    auto after_stall = snapshot();
+    REQUIRE(std::count(after_stall.begin(), after_stall.end(), "once") == 1);
+    REQUIRE(std::count(after_stall.begin(), after_stall.end(), "tick") == 3);
+
+    REQUIRE(queue.Cancel(every));
+    REQUIRE_FALSE(queue.Cancel(every));
+    advance(queue, 60000);
+    REQUIRE(snapshot() == after_stall);                        // cancelled: no more ticks
+}
+
+TEST_CASE("TelemetryTaskQueue - a periodic task can cancel itself", "[queue][timer]") {
+    VirtualClock vc;
+    std::atomic<int> runs{0};
+    TelemetryTaskQueue<int> queue([&vc] { return vc.Now(); });
+    TelemetryTaskQueue<int>::TimerId id = 0;
+    std::mutex id_lock;
+    {
+        std::lock_guard<std::mutex> lock(id_lock);
+        id = queue.ScheduleEvery([&](int) {
+            if (++runs == 2) {
+                std::lock_guard<std::mutex> lock(id_lock);
+                queue.Cancel(id);
+            }
+        }, 0, std::chrono::milliseconds(100));
+    }
+    for (int i = 0; i < 5; i++) {
+        vc.offset_ms += 100;
+        queue.Wake();
+        REQUIRE(queue.DrainFor(2000));
+    }
+    REQUIRE(runs == 2);
+}
@@ -0,0 +1,256 @@
+// Tests for the remote runtime config (SetRemoteConfig), against a local stub
+// HTTP server.
+#include "catch.hpp"
+#include "telemetry.hpp"
+
+// Same configuration as telemetry.cpp (DuckDB's httplib namespaces on it).
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include "httplib.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace duckdb;
+
+namespace {
+
+// The test binary opts out via DATAZOO_DISABLE_TELEMETRY, which also blocks the
+// config fetch; lift it for the scope of one test (localhost only).
+struct AllowNetwork {
+#ifdef _WIN32
+    AllowNetwork() { _putenv_s("DATAZOO_DISABLE_TELEMETRY", ""); }
+    ~AllowNetwork() { _putenv_s("DATAZOO_DISABLE_TELEMETRY", "1"); }
+#else
+    AllowNetwork() { unsetenv("DATAZOO_DISABLE_TELEMETRY"); }
+    ~AllowNetwork() { setenv("DATAZOO_DISABLE_TELEMETRY", "1", 1); }
+#endif
+};
+
+// Serves one mutable document with an ETag and honours If-None-Match.
+struct StubConfigServer {
+    duckdb_httplib_openssl::Server server;
+    std::thread thread;
+    int port = 0;
+    std::mutex lock;
+    std::string body;
+    std::string etag;
+    int status = 200;
+    std::vector<std::string> if_none_match;   // per request, "" if absent
+
+    StubConfigServer() {
+        server.Get("/config.json", [this](const duckdb_httplib_openssl::Request& req,
+                                          duckdb_httplib_openssl::Response& res) {
+            std::lock_guard<std::mutex> l(lock);
+            std::string inm = req.get_header_value("If-None-Match");
+            if_none_match.push_back(inm);
+            if (status != 200) {
+                res.status = status;
+                return;
+            }
+            if (!etag.empty() && inm == etag) {
+                res.status = 304;
+                return;
+            }
+            res.set_header("ETag", etag);
+            res.set_content(body, "application/json");
+        });
+        port = server.bind_to_any_port("127.0.0.1");
+        thread = std::thread([this] { server.listen_after_bind(); });
+        while (!server.is_running()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    ~StubConfigServer() {
+        server.stop();
+        thread.join();
+    }
+    void Serve(const std::string& b, const std::string& e) {
+        std::lock_guard<std::mutex> l(lock);
+        body = b;
+        etag = e;
+        status = 200;
+    }
+    std::string Url() const { return "http://127.0.0.1:" + std::to_string(port) + "/config.json"; }
+};
+
+std::string TempPath(const char* name) {
+    return std::string("posthog_telemetry_test_") + name;   // test working dir
+}
+
+} // namespace
+
+TEST_CASE("Remote config - parse validates shape and ignores unknown keys", "[remote_config]") {
+    TelemetryRemoteConfig cfg;
+    REQUIRE(PostHogTelemetry::ParseRemoteConfig(
+        R"({"sampling_rate":0.25,"disabled_events":["feature_used"],)"
+        R"("rate_limits":{"error_occurred":60},"flush_interval_ms":5000,"future_knob":true})", cfg));
+    REQUIRE(cfg.sampling_rate == Approx(0.25));
+    REQUIRE(cfg.disabled_events.count("feature_used") == 1);
+    REQUIRE(cfg.rate_limits.at("error_occurred") == 60);
+    REQUIRE(cfg.flush_interval_ms == 5000);
+
+    TelemetryRemoteConfig untouched;
+    REQUIRE_FALSE(PostHogTelemetry::ParseRemoteConfig("{\"sampling_rate\":", untouched));
+    REQUIRE_FALSE(PostHogTelemetry::ParseRemoteConfig("{\"sampling_rate\":2}", untouched));
+    REQUIRE_FALSE(PostHogTelemetry::ParseRemoteConfig("{\"disabled_events\":\"x\"}", untouched));
+    REQUIRE_FALSE(PostHogTelemetry::ParseRemoteConfig("[1,2]", untouched));
+    REQUIRE(untouched.sampling_rate == 1.0);
+    REQUIRE(PostHogTelemetry::ParseRemoteConfig("{}", untouched));   // all defaults
+}
+
+TEST_CASE("Remote config - numbers are locale-independent (dot, not comma)", "[remote_config]") {
+    char* prev = std::setlocale(LC_NUMERIC, nullptr);
+    std::string saved = prev ? prev : "C";
+    // Try a comma-decimal locale; if unavailable the test still asserts the dot.
+    std::setlocale(LC_NUMERIC, "de_DE.UTF-8");
+
+    TelemetryRemoteConfig cfg;
+    bool ok = PostHogTelemetry::ParseRemoteConfig(R"({"sampling_rate":0.1,"flush_interval_ms":2.5e3})", cfg);
+    std::setlocale(LC_NUMERIC, saved.c_str());
+
+    REQUIRE(ok);
+    REQUIRE(cfg.sampling_rate == Approx(0.1));
+    REQUIRE(cfg.flush_interval_ms == 2500);
+}
+
+TEST_CASE("Remote config - fetched, applied, cached, revalidated with If-None-Match", "[remote_config]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.Flush();
+    AllowNetwork allow;
+    StubConfigServer stub;
+    std::string cache = TempPath("remote_config_cache.json");
+    std::remove(cache.c_str());
+
+    stub.Serve(R"({"disabled_events":["remote_disabled"],"sampling_rate":0.5})", "\"v1\"");
+    t.SetRemoteConfig(stub.Url(), cache, 3600);
+    REQUIRE(t.FetchRemoteConfigNow());
+    REQUIRE(t.GetRemoteConfig().etag == "\"v1\"");
+    REQUIRE(t.GetRemoteConfig().sampling_rate == Approx(0.5));
+
+    // Disabled events never reach the buffer.
+    uint64_t dropped = t.GetStats().dropped_remote_config;
+    size_t depth = t.GetStats().queue_depth;
+    t.Capture("remote_disabled", {});
+    REQUIRE(t.GetStats().queue_depth == depth);
+    REQUIRE(t.GetStats().dropped_remote_config == dropped + 1);
+    // ... and never feed the cardinality guard.
+    t.SetCardinalityLimit(5);
+    uint64_t violations = t.GetStats().cardinality_violations;
+    for (int i = 0; i < 50; i++) {
+        t.Capture("remote_disabled", {{"table", "t" + std::to_string(i)}});
+    }
+    REQUIRE(t.GetStats().cardinality_violations == violations);
+    t.SetCardinalityLimit(200);
+
+    // Unchanged document: conditional GET, 304, nothing re-applied.
+    REQUIRE(t.FetchRemoteConfigNow());
+    {
+        std::lock_guard<std::mutex> l(stub.lock);
+        REQUIRE(stub.if_none_match.back() == "\"v1\"");
+    }
+
+    // A changed document replaces the existing cache file.
+    stub.Serve(R"({"disabled_events":["remote_disabled"],"sampling_rate":0.5})", "\"v2\"");
+    REQUIRE(t.FetchRemoteConfigNow());
+    REQUIRE(t.GetRemoteConfig().etag == "\"v2\"");
+
+    // The cache survives a "restart": a new SetRemoteConfig against a dead
+    // server still applies the last good document.
+    std::ifstream in(cache);
+    REQUIRE(in.good());
+    std::string cached_etag;
+    std::getline(in, cached_etag);
+    REQUIRE(cached_etag == "\"v2\"");
+    for (auto& entry : std::filesystem::directory_iterator(std::filesystem::current_path())) {
+        REQUIRE(entry.path().filename().string().rfind(cache + ".tmp", 0) == std::string::npos);
+    }
+    t.SetRemoteConfig("http://127.0.0.1:1/config.json", cache, 3600);
+    REQUIRE_FALSE(t.FetchRemoteConfigNow());
+    REQUIRE(t.GetRemoteConfig().disabled_events.count("remote_disabled") == 1);
+
+    // No URL: back to compiled defaults.
+    t.SetRemoteConfig("");
+    REQUIRE(t.GetRemoteConfig().disabled_events.empty());
+    REQUIRE(t.GetRemoteConfig().sampling_rate == 1.0);
+    std::remove(cache.c_str());
+}
+
+TEST_CASE("Remote config - failures keep compiled defaults, bad documents are rejected", "[remote_config]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    AllowNetwork allow;
+    StubConfigServer stub;
+
+    stub.Serve("{not json", "\"bad\"");
+    t.SetRemoteConfig(stub.Url(), "", 3600);
+    REQUIRE_FALSE(t.FetchRemoteConfigNow());
+    REQUIRE(t.GetRemoteConfig().etag.empty());   // nothing applied
+
+    {
+        std::lock_guard<std::mutex> l(stub.lock);
+        stub.status = 500;
+    }
+    REQUIRE_FALSE(t.FetchRemoteConfigNow());
+    REQUIRE(t.GetRemoteConfig().disabled_events.empty());
+    t.SetRemoteConfig("");
+}
+
+TEST_CASE("Remote config - rate limits cap an event per minute", "[remote_config]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.Flush();
+    AllowNetwork allow;
+    StubConfigServer stub;
+    stub.Serve(R"({"rate_limits":{"remote_limited":3}})", "\"rl\"");
+    t.SetRemoteConfig(stub.Url(), "", 3600);
+    REQUIRE(t.FetchRemoteConfigNow());
+
+    size_t depth = t.GetStats().queue_depth;
+    for (int i = 0; i < 10; i++) {
+        t.Capture("remote_limited", {});
+    }
+    REQUIRE(t.GetStats().queue_depth - depth == 3);   // burst up to the limit
+    t.SetRemoteConfig("");
+    t.Flush();
+}
+
+TEST_CASE("Remote config - remote sampling caps the local rate", "[remote_config][sampling]") {
+    auto& t = PostHogTelemetry::Instance();
+    t.SetEnabled(true);
+    t.SetSampling(1.0);
+    t.DrainFunctionAggregatesForTesting();
+    AllowNetwork allow;
+    StubConfigServer stub;
+    stub.Serve(R"({"sampling_rate":0.25})", "\"s\"");
+    t.SetRemoteConfig(stub.Url(), "", 3600);
+    REQUIRE(t.FetchRemoteConfigNow());
+
+    for (int i = 0; i < 100; i++) {
+        t.RecordFunctionCall("remote_sampled_fn", 1.0);
+    }
+    for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+        if (e.properties.at("function_name").s == "remote_sampled_fn") {
+            REQUIRE(e.properties.at("call_count").i == 25);
+            REQUIRE(e.properties.at("sample_rate").d == Approx(0.25));
+        }
+    }
+    t.SetRemoteConfig("");
+    for (int i = 0; i < 4; i++) {
+        t.RecordFunctionCall("remote_sampled_fn", 1.0);
+    }
+    for (auto& e : t.DrainFunctionAggregatesForTesting()) {
+        if (e.properties.at("function_name").s == "remote_sampled_fn") {
+            REQUIRE(e.properties.at("call_count").i == 4);
+        }
+    }
+}
@@ -0,0 +1,117 @@
+// A typical embedder, compiled twice by test/CMakeLists.txt: against the real
+// API (so the POSTHOG_TELEMETRY_DISABLED stubs can't drift from it) and with
+// the flag, where check_symbols.cmake requires the object to reference no
+// telemetry symbol and no std::map — i.e. every call compiled away.
+#include "telemetry.hpp"
+#include "telemetry_prometheus.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace duckdb;
+
+void ExampleExtensionLoad(const std::string &version)
+{
+    auto &t = PostHogTelemetry::Instance();
+    t.SetAPIKey("phc_example");
+    t.SetHost("https://eu.i.posthog.com");
+    t.SetProduct("example_ext", version, "oss");
+    t.SetExtensionName("example_ext");
+    t.SetDuckDBVersion("v1.4.3");
+    t.SetDuckDBPlatform("linux_amd64");
+    t.SetSampling(0.5);
+    t.SetCategoryMask(kTelemetryAllCategories & ~kTelemetryFunction);
+    t.SetSlowestExemplars(3);
+    t.SetChangeTriggeredEmission(0.2);
+    t.SetPackedFunctionStats(true);
+    t.SetCardinalityLimit(100);
+    t.SetCpuBudget(0.01);
+    t.SetEncodeParallelism(2);
+    t.SetRemoteConfig("https://example.invalid/telemetry.json");
+
+    ScopedExtensionLoad load("example_ext", version);
+    load.Mark("catalog_attached");
+    t.CaptureExtensionLoad("example_ext", version,
+                           {{"load_mode", "autoload"}, {"threads", 8}, {"cold", true}});
+    load.Finish();
+}
+
+void ExampleQuery(const std::string &table, uint64_t rows, double ms, bool failed)
+{
+    auto &t = PostHogTelemetry::Instance();
+    if (!t.IsEnabled()) {
+        // Real callers still do work here; the stub must not need it.
+    }
+    PropertyMap props;
+    props["table"] = table;
+    props["rows"] = static_cast<int64_t>(rows);
+    props["elapsed_ms"] = ms;
+    props["payload"] = PropertyValue::Json("{\"a\":1}");
+    t.CaptureFeature("example_read", props);
+    t.Capture("custom_event", {{"size_bucket", PostHogTelemetry::InputSizeBucket(rows)}});
+    t.AssociateGroup("workspace", "acme", {{"plan", "enterprise"}});
+    if (failed) {
+        t.CaptureError("read_failed", {{"table", table}});
+    }
+
+    t.RecordFunctionCall("example_scalar", ms);
+    t.RecordFunctionCall("example_scalar", ms, "parquet");
+    PostHogTelemetry::FunctionId id = t.GetFunctionId("example_scalar");
+    t.RecordFunctionCalls(id, rows, ms);
+    t.IngestQueryProfile("{\"children\":[]}");
+    t.Flush();
+}
+
+uint64_t ExampleHealthCheck(bool local_sink)
+{
+    auto &t = PostHogTelemetry::Instance();
+    if (local_sink) {
+        t.SetTransport([](const std::string &, const std::string &,
+                          const std::vector<PostHogEvent> &events) {
+            for (auto &e : events) {
+                (void)e.event_name.size();
+            }
+        });
+        t.SetWindowSink([](const std::vector<TelemetryWindowFunction> &functions,
+                           const TelemetryStats &pipeline) {
+            (void)(functions.size() + pipeline.queue_depth);
+        });
+    } else {
+        t.SetTransport({});
+        t.SetWindowSink({});
+    }
+    TelemetryStats stats = t.GetStats();
+    uint64_t calls = 0;
+    for (auto &fn : stats.functions) {
+        calls += fn.call_count;
+    }
+    return stats.queue_depth + stats.dropped_buffer_full + stats.cardinality_violations + calls;
+}
+
+uint32_t ExampleConfigure(const std::string &categories, const std::string &config_json,
+                          const std::string &event)
+{
+    uint32_t mask = kTelemetryAllCategories;
+    if (PostHogTelemetry::ParseCategoryMask(categories, mask)) {
+        PostHogTelemetry::Instance().SetCategoryMask(mask);
+    }
+    TelemetryRemoteConfig parsed;
+    if (!PostHogTelemetry::ParseRemoteConfig(config_json, parsed)) {
+        parsed = PostHogTelemetry::Instance().GetRemoteConfig();
+    }
+    uint32_t per_minute = 0;
+    auto limit = parsed.rate_limits.find(event);
+    if (limit != parsed.rate_limits.end()) {
+        per_minute = limit->second;
+    }
+    for (auto &kv : parsed.rate_limits) {
+        per_minute += kv.second;
+    }
+    for (auto &name : parsed.disabled_events) {
+        per_minute += static_cast<uint32_t>(name.size());
+    }
+    return mask + per_minute + static_cast<uint32_t>(parsed.disabled_events.count(event)) +
+           static_cast<uint32_t>(parsed.etag.size() + parsed.flush_interval_ms) +
+           static_cast<uint32_t>(parsed.sampling_rate);
+}
@@ -0,0 +1,30 @@
+# Invoked by ctest as: cmake -DNM=<nm> -DOBJECT=<caller.o> -P check_symbols.cmake
+# Fails if the POSTHOG_TELEMETRY_DISABLED build of caller.cpp still references
+# a telemetry symbol (anything in namespace duckdb) or a std::map — i.e. a stub
+# that did not compile away, or a PropertyMap that still allocates.
+
+set(FORBIDDEN
+    "duckdb::"
+    "std::map<"
+    "std::__1::map<"
+    "_Rb_tree"
+    "__tree<"
+)
+
+execute_process(
+    COMMAND ${NM} -C ${OBJECT}
+    OUTPUT_VARIABLE symbols
+    RESULT_VARIABLE rc
+)
+if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "nm failed on ${OBJECT} (exit ${rc})")
+endif()
+
+foreach(pattern IN LISTS FORBIDDEN)
+    string(FIND "${symbols}" "${pattern}" at)
+    if(NOT at EQUAL -1)
+        message(FATAL_ERROR "Disabled telemetry left a '${pattern}' reference in ${OBJECT}:\n${symbols}")
+    endif()
+endforeach()
+
+message(STATUS "Disabled telemetry compiled away in ${OBJECT}")
@@ -0,0 +1,33 @@
+# Invoked by ctest as: cmake -DREADELF=<readelf> -DLIBRARY=<lib> -P check_probes.cmake
+# Fails unless every posthog_telemetry USDT probe appears in the ELF notes.
+
+set(EXPECTED_PROBES
+    capture_entry
+    buffer_accept
+    buffer_drop
+    function_sample_in
+    function_sample_out
+    drain_start
+    drain_end
+    chunk_encode
+    post_complete
+)
+
+execute_process(
+    COMMAND ${READELF} --notes ${LIBRARY}
+    OUTPUT_VARIABLE notes
+    RESULT_VARIABLE rc
+)
+if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "readelf failed on ${LIBRARY} (exit ${rc})")
+endif()
+
+foreach(probe IN LISTS EXPECTED_PROBES)
+    string(REGEX MATCH "Provider: posthog_telemetry[\r\n]+[ \t]*Name: ${probe}[\r\n]" found "${notes}")
+    if(NOT found)
+        message(FATAL_ERROR "USDT probe posthog_telemetry:${probe} missing from ${LIBRARY}")
+    endif()
+endforeach()
+
+list(LENGTH EXPECTED_PROBES n)
+message(STATUS "All ${n} posthog_telemetry USDT probes present")